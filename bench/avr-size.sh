@@ -0,0 +1,39 @@
+#!/bin/sh
+# Reports the flash and SRAM size of the generated code per register.
+# Usage: avr-size.sh <object file> <namespace>
+set -e
+obj=$1
+ns=$2
+
+avr-size "$obj"
+avr-nm -C -S "$obj" | awk -v ns="$ns" '
+function hex(s,    i, c, v) {
+	v = 0
+	s = tolower(s)
+	for (i = 1; i <= length(s); i++) {
+		c = index("0123456789abcdef", substr(s, i, 1)) - 1
+		v = v * 16 + c
+	}
+	return v
+}
+NF >= 4 {
+	name = $4
+	for (i = 5; i <= NF; i++) name = name " " $i
+	group = "other"
+	if (index(name, ns "::detail::") == 1 || index(name, "bigendian::") == 1) {
+		group = "(helpers)"
+	} else if (index(name, ns "::") == 1) {
+		rest = substr(name, length(ns) + 3)
+		if (match(rest, /^[A-Za-z_][A-Za-z_0-9]*::/)) group = substr(rest, 1, RLENGTH - 2)
+	}
+	size = hex($2)
+	if ($3 ~ /[TtWw]/) flash[group] += size
+	else if ($3 ~ /[Dd]/) { flash[group] += size; sram[group] += size }
+	else if ($3 ~ /[Bb]/) sram[group] += size
+	else if ($3 ~ /[Rr]/) flash[group] += size
+	seen[group] = 1
+}
+END {
+	printf "%-24s %8s %8s\n", "register", "flash", "sram"
+	for (g in seen) printf "%-24s %8d %8d\n", g, flash[g], sram[g]
+}'
@@ -0,0 +1,41 @@
+// Tiny micro-benchmark runner for the generated serializers on the host
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+namespace bench {
+
+// Keeps the compiler from optimizing out the work with the pointed memory
+inline void escape(const void* p) {
+	asm volatile("" : : "g"(p) : "memory");
+}
+
+// Runs f repeatedly for about 100ms and prints the time per call and the bytes it moved.
+// f returns the serializer result, a negative result fails the benchmark.
+template <typename F>
+void run(const char* name, F f) {
+	typedef std::chrono::steady_clock clock;
+	int bytes = f();
+	if (bytes < 0) {
+		std::printf("%-40s FAILED (%d)\n", name, bytes);
+		std::exit(1);
+	}
+	long iters = 1;
+	for (;;) {
+		clock::time_point start = clock::now();
+		for (long i = 0; i < iters; i++) {
+			escape(&bytes);
+			bytes = f();
+		}
+		double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+		if (ns > 1e8 || iters > (1L << 30)) {
+			std::printf("%-40s %10ld iters %10.1f ns/op %6d bytes/op\n", name, iters, ns / iters, bytes);
+			return;
+		}
+		iters *= 2;
+	}
+}
+
+} // namespace bench
@@ -0,0 +1,41 @@
+#include "bench.h"
+#include "sensor.h"
+
+using namespace sensor;
+
+int main() {
+	static uint8_t buf[Max_Wire_Size > 1024 ? 1024 : Max_Wire_Size];
+	static uint8_t data[64], data_in[64];
+	static int32_t samples[16], samples_in[16];
+
+	Config cfg = {};
+	cfg.mode = 3;
+	cfg.enabled = 1;
+	cfg.period_ms = 500;
+	bench::run("Config::serialize_read", [&] { bench::escape(&cfg); return cfg.serialize_read(buf, sizeof(buf)); });
+	bench::run("Config::deserialize_read", [&] { bench::escape(buf); return cfg.deserialize_read(buf, sizeof(buf)); });
+
+	Control ctl = {};
+	ctl.enable = 0x80000005;
+	ctl.temperature = -120;
+	ctl.pressure = 1013.25f;
+	for (int i = 0; i < 8; i++) ctl.calibration[i] = i * 100 - 300;
+	ctl.data_size = sizeof(data);
+	ctl.data = data;
+	ctl.samples_size = 16;
+	ctl.samples = samples;
+	ctl.cfg = cfg;
+	ctl.timestamp = 1700000000000ULL;
+	bench::run("Control::serialize_write", [&] { bench::escape(&ctl); return ctl.serialize_write(buf, sizeof(buf)); });
+	Control ctl_in = {};
+	ctl_in.data = data_in;
+	ctl_in.samples = samples_in;
+	bench::run("Control::deserialize_write", [&] { bench::escape(buf); return ctl_in.deserialize_write(buf, sizeof(buf)); });
+
+	Samples smp = {};
+	smp.count = 32;
+	for (int i = 0; i < 32; i++) smp.values[i] = i * 7 - 100;
+	bench::run("Samples::serialize_read", [&] { bench::escape(&smp); return smp.serialize_read(buf, sizeof(buf)); });
+	bench::run("Samples::deserialize_read", [&] { bench::escape(buf); return smp.deserialize_read(buf, sizeof(buf)); });
+	return 0;
+}
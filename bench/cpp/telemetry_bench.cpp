@@ -0,0 +1,45 @@
+#include "bench.h"
+#include "telemetry.h"
+
+using namespace telemetry;
+
+int main() {
+	static uint8_t buf[Max_Wire_Size];
+	static uint8_t name[16] = "calibration-01", name_in[16];
+
+	Status st = {};
+	st.mode = 2;
+	st.state = 5;
+	st.battery = 97;
+	st.temperature = -40;
+	st.flags = 0x9;
+	bench::run("Status::serialize_read", [&] { bench::escape(&st); return st.serialize_read(buf, sizeof(buf)); });
+	bench::run("Status::deserialize_read", [&] { bench::escape(buf); return st.deserialize_read(buf, sizeof(buf)); });
+
+	Counters cnt = {};
+	cnt.uptime = 86400;
+	cnt.packets = 123456;
+	cnt.errors = 3;
+	cnt.drift = -250;
+	cnt.total = 9876543210ULL;
+	bench::run("Counters::serialize_read", [&] { bench::escape(&cnt); return cnt.serialize_read(buf, sizeof(buf)); });
+	bench::run("Counters::deserialize_read", [&] { bench::escape(buf); return cnt.deserialize_read(buf, sizeof(buf)); });
+
+	Calibration cal = {};
+	for (int i = 0; i < 4; i++) {
+		cal.gain[i] = 1000 + i;
+		cal.offset[i] = -i;
+	}
+	cal.threshold = 512;
+	cal.name_len = 14;
+	cal.name = name;
+	cal.mode = 1;
+	bench::run("Calibration::serialize_write", [&] { bench::escape(&cal); return cal.serialize_write(buf, sizeof(buf)); });
+	Calibration cal_in = {};
+	cal_in.name = name_in;
+	bench::run("Calibration::deserialize_write", [&] { bench::escape(buf); return cal_in.deserialize_write(buf, sizeof(buf)); });
+	cal.mark_dirty(Calibration::threshold_dirty);
+	bench::run("Calibration::serialize_write_delta", [&] { bench::escape(&cal); return cal.serialize_write_delta(buf, sizeof(buf)); });
+	bench::run("Calibration::deserialize_write_delta", [&] { bench::escape(buf); return cal_in.deserialize_write_delta(buf, sizeof(buf)); });
+	return 0;
+}
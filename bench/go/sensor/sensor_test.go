@@ -0,0 +1,101 @@
+//go:build bench
+
+package sensor
+
+import "testing"
+
+func newControl() *Control {
+	r := &Control{
+		enable:       0x00C0000B,
+		temperature:  -40,
+		pressure:     1013.25,
+		data_size:    32,
+		data:         make([]uint8, 32),
+		samples_size: 8,
+		samples:      make([]int32, 8),
+		cfg:          Config{mode: 1, enabled: 1, period_ms: 250},
+		timestamp:    1700000000000,
+	}
+	for i := range r.calibration {
+		r.calibration[i] = int16(100 * i)
+	}
+	return r
+}
+
+func BenchmarkControlSerializeWrite(b *testing.B) {
+	r := newControl()
+	buf := make([]byte, r.BufSize4Write())
+	b.SetBytes(int64(len(buf)))
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		if _, err := r.SerializeWrite(buf); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+func BenchmarkControlAppendWrite(b *testing.B) {
+	r := newControl()
+	buf := make([]byte, 0, 16*r.BufSize4Write())
+	b.SetBytes(int64(16 * r.BufSize4Write()))
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		out := buf[:0]
+		for j := 0; j < 16; j++ {
+			var err error
+			if out, err = r.AppendWrite(out); err != nil {
+				b.Fatal(err)
+			}
+		}
+	}
+}
+
+func BenchmarkControlDeserializeWrite(b *testing.B) {
+	r := newControl()
+	buf := make([]byte, r.BufSize4Write())
+	if _, err := r.SerializeWrite(buf); err != nil {
+		b.Fatal(err)
+	}
+	var in Control
+	b.SetBytes(int64(len(buf)))
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		if _, err := in.DeserializeWrite(buf); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+func BenchmarkSamplesDeserializeRead(b *testing.B) {
+	r := &Samples{count: 32}
+	buf := make([]byte, r.BufSize4Read())
+	if _, err := r.SerializeRead(buf); err != nil {
+		b.Fatal(err)
+	}
+	b.SetBytes(int64(len(buf)))
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		if _, err := r.DeserializeRead(buf); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+// TestControlNoAllocs checks the codec doesn't allocate once the variable-length arrays have
+// the capacity for the received data
+func TestControlNoAllocs(t *testing.T) {
+	r := newControl()
+	buf := make([]byte, r.BufSize4Write())
+	var in Control
+	allocs := testing.AllocsPerRun(100, func() {
+		if _, err := r.SerializeWrite(buf); err != nil {
+			t.Fatal(err)
+		}
+		if _, err := in.DeserializeWrite(buf); err != nil {
+			t.Fatal(err)
+		}
+	})
+	if allocs != 0 {
+		t.Fatalf("%v allocations per serialize/deserialize, want 0", allocs)
+	}
+}
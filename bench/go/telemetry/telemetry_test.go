@@ -0,0 +1,74 @@
+//go:build bench
+
+package telemetry
+
+import "testing"
+
+func BenchmarkStatusSerializeRead(b *testing.B) {
+	r := &Status{mode: 2, state: 5, battery: 97, temperature: -40, flags: 0x9}
+	buf := make([]byte, r.BufSize4Read())
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		if _, err := r.SerializeRead(buf); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+func BenchmarkCountersDeserializeRead(b *testing.B) {
+	r := &Counters{uptime: 86400, packets: 123456, errors: 3, drift: -250, total: 9876543210}
+	buf := make([]byte, r.BufSize4Read())
+	if _, err := r.SerializeRead(buf); err != nil {
+		b.Fatal(err)
+	}
+	var in Counters
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		if _, err := in.DeserializeRead(buf); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+func BenchmarkCalibrationSerializeWriteDelta(b *testing.B) {
+	r := &Calibration{name_len: 14, name: []uint8("calibration-01")}
+	r.SetThreshold(512)
+	buf := make([]byte, r.BufSize4WriteDelta())
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		if _, err := r.SerializeWriteDelta(buf); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+// TestNoAllocs checks the codecs of all the registers don't allocate
+func TestNoAllocs(t *testing.T) {
+	st := &Status{mode: 1, temperature: -3}
+	cnt := &Counters{uptime: 1000, drift: -1}
+	cal := &Calibration{name_len: 4, name: []uint8("cal1")}
+	buf := make([]byte, 64)
+	allocs := testing.AllocsPerRun(100, func() {
+		if _, err := st.SerializeRead(buf); err != nil {
+			t.Fatal(err)
+		}
+		if _, err := st.DeserializeRead(buf); err != nil {
+			t.Fatal(err)
+		}
+		if _, err := cnt.SerializeRead(buf); err != nil {
+			t.Fatal(err)
+		}
+		if _, err := cnt.DeserializeRead(buf); err != nil {
+			t.Fatal(err)
+		}
+		if _, err := cal.SerializeWrite(buf); err != nil {
+			t.Fatal(err)
+		}
+		if _, err := cal.DeserializeWrite(buf); err != nil {
+			t.Fatal(err)
+		}
+	})
+	if allocs != 0 {
+		t.Fatalf("%v allocations per serialize/deserialize, want 0", allocs)
+	}
+}
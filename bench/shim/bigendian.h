@@ -0,0 +1,41 @@
+// Byte-by-byte big-endian codecs with the same interface as the bigendian library the
+// generated code is built with on the target
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace bigendian {
+
+template <typename T>
+inline size_t encode(uint8_t* buf, T v) {
+	uint8_t raw[sizeof(T)];
+	memcpy(raw, &v, sizeof(T));
+	for (size_t i = 0; i < sizeof(T); i++) buf[i] = raw[sizeof(T) - 1 - i];
+	return sizeof(T);
+}
+
+template <typename T>
+inline size_t decode(T& v, const uint8_t* buf) {
+	uint8_t raw[sizeof(T)];
+	for (size_t i = 0; i < sizeof(T); i++) raw[sizeof(T) - 1 - i] = buf[i];
+	memcpy(&v, raw, sizeof(T));
+	return sizeof(T);
+}
+
+template <typename T>
+inline size_t encode_varray(uint8_t* buf, const T* arr, size_t n) {
+	size_t offset = 0;
+	for (size_t i = 0; i < n; i++) offset += encode(buf + offset, arr[i]);
+	return offset;
+}
+
+template <typename T>
+inline size_t decode_varray(T* arr, const uint8_t* buf, size_t n) {
+	size_t offset = 0;
+	for (size_t i = 0; i < n; i++) offset += decode(arr[i], buf + offset);
+	return offset;
+}
+
+} // namespace bigendian
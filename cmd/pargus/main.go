@@ -1,32 +1,87 @@
 package main
 
 import (
+	"bytes"
+	"crypto/sha256"
+	"encoding/hex"
+	"encoding/json"
 	"flag"
 	"fmt"
 	"github.com/dspasibenko/pargus/pkg/generator"
 	"github.com/dspasibenko/pargus/pkg/parser"
+	"io"
 	"os"
 	"path/filepath"
+	"runtime"
+	"strings"
+	"sync"
 )
 
+// config is the generator settings shared by all the input files
+type config struct {
+	genType   string
+	namespace string
+	pkg       string
+	cppOpts   generator.CppOptions
+	goOpts    generator.GoOptions
+	report    bool // the C++ codecs are reported
+}
+
+// job is the generation of one input file
+type job struct {
+	input      string
+	outputBase string // the output file, without the extension for C++
+	namespace  string
+	pkg        string
+}
+
+// result is the outcome of the job: the messages to print, or the error
+type result struct {
+	messages []string
+	key      string               // the cache key of the generated files
+	report   *generator.CppReport // the report of the codecs, nil without -report
+	err      error
+}
+
 func main() {
 	var (
-		output    = flag.String("o", "", "Output file (default: input.h for C++, input.go for Go)")
-		namespace = flag.String("n", "", "C++ namespace name (required for C++)")
-		pkg       = flag.String("p", "", "Go package name (required for Go)")
-		genType   = flag.String("t", "cpp", "Generator type: cpp or go")
-		help      = flag.Bool("help", false, "Show help")
+		output     = flag.String("o", "", "Output file (default: input.h for C++, input.go for Go), the output directory for several input files")
+		namespace  = flag.String("n", "", "C++ namespace name (required for C++, defaults to the input file name for several input files)")
+		pkg        = flag.String("p", "", "Go package name (required for Go, defaults to the input file name for several input files)")
+		genType    = flag.String("t", "cpp", "Generator type: cpp, cpp-host or go")
+		headerOnly = flag.Bool("header-only", false, "C++: generate a single header with inline definitions instead of .h and .cpp")
+		views      = flag.Bool("views", false, "C++: deserialize variable-length byte arrays as views of the wire buffer (no copy)")
+		dispatch   = flag.Bool("dispatch", false, "C++: generate the request Handler and the register ID dispatch tables")
+		batch      = flag.Bool("batch", false, "C++ and Go: generate the batch frames codec for several registers in one request (C++: implies -dispatch)")
+		sortFields = flag.Bool("sort-fields", false, "C++: declare the struct members sorted by the alignment to remove the padding, and report the struct sizes")
+		crc        = flag.String("crc", "", "C++ and Go: generate the codecs followed by the checksum of the wire data: crc8, crc16 or crc32")
+		unsafe     = flag.Bool("unsafe", false, "Go: code the arrays of the multi-byte elements by copying the slices memory (imports unsafe)")
+		client     = flag.Bool("client", false, "Go: generate the typed Client which pipelines the register requests over a Transport")
+		capture    = flag.Bool("capture", false, "C++ and Go: generate the decoder of the captured register traffic (see pkg/capture)")
+		stats      = flag.Bool("stats", false, "C++ and Go: instrument the codecs: C++ counts the calls, failures and bytes if built with PARGUS_STATS, Go calls the hook set by SetHook")
+		jobs       = flag.Int("j", runtime.NumCPU(), "Number of the input files generated in parallel")
+		report     = flag.String("report", "", "C++: report the wire sizes, the bounds checks and the estimated AVR cycles and flash of the codecs to the file, in JSON if it ends with .json, - prints the text")
+		cacheFile  = flag.String("cache", "", "Cache file of the inputs hashes: the inputs not changed since the last run with the same generator and options are skipped")
+		help       = flag.Bool("help", false, "Show help")
 	)
 
 	flag.Usage = func() {
-		fmt.Fprintf(os.Stderr, "Usage: %s [options] input.pa\n\n", os.Args[0])
+		fmt.Fprintf(os.Stderr, "Usage: %s [options] input.pa [input2.pa ...]\n\n", os.Args[0])
 		fmt.Fprintf(os.Stderr, "Options:\n")
 		flag.PrintDefaults()
 		fmt.Fprintf(os.Stderr, "\nExamples:\n")
 		fmt.Fprintf(os.Stderr, "  # Generate C++ code:\n")
 		fmt.Fprintf(os.Stderr, "  %s -t cpp -n MyNamespace -o output.h input.pa\n", os.Args[0])
+		fmt.Fprintf(os.Stderr, "  # Generate C++ code for the Linux hosts:\n")
+		fmt.Fprintf(os.Stderr, "  %s -t cpp-host -n MyNamespace -o output.h input.pa\n", os.Args[0])
+		fmt.Fprintf(os.Stderr, "  # Generate header-only C++ code:\n")
+		fmt.Fprintf(os.Stderr, "  %s -t cpp -header-only -n MyNamespace -o output.h input.pa\n", os.Args[0])
 		fmt.Fprintf(os.Stderr, "  # Generate Go code:\n")
 		fmt.Fprintf(os.Stderr, "  %s -t go -p mypackage -o output.go input.pa\n", os.Args[0])
+		fmt.Fprintf(os.Stderr, "  # Report the codecs costs for CI:\n")
+		fmt.Fprintf(os.Stderr, "  %s -t cpp -n MyNamespace -report report.json -o output.h input.pa\n", os.Args[0])
+		fmt.Fprintf(os.Stderr, "  # Regenerate the C++ code of the changed devices only:\n")
+		fmt.Fprintf(os.Stderr, "  %s -t cpp -cache generated/.pargus-cache -o generated devices/*.pa\n", os.Args[0])
 	}
 
 	flag.Parse()
@@ -36,114 +91,386 @@ func main() {
 		os.Exit(0)
 	}
 
-	// Validate generator type
+	// Validate generator type, the host C++ target is the C++ generator with the host option
+	host := *genType == "cpp-host"
+	if host {
+		*genType = "cpp"
+	}
 	if *genType != "cpp" && *genType != "go" {
-		fmt.Fprintf(os.Stderr, "Error: generator type must be 'cpp' or 'go'\n")
+		fmt.Fprintf(os.Stderr, "Error: generator type must be 'cpp', 'cpp-host' or 'go'\n")
+		flag.Usage()
+		os.Exit(1)
+	}
+
+	// Get input files from command line arguments
+	args := flag.Args()
+	if len(args) == 0 {
+		fmt.Fprintf(os.Stderr, "Error: input file is required\n")
 		flag.Usage()
 		os.Exit(1)
 	}
+	multi := len(args) > 1
 
-	// Check for required parameters based on generator type
-	if *genType == "cpp" && *namespace == "" {
+	// Check for required parameters based on generator type, several input files default them
+	// to the file names
+	if *genType == "cpp" && *namespace == "" && !multi {
 		fmt.Fprintf(os.Stderr, "Error: -n (namespace) parameter is required for C++ generator\n")
 		flag.Usage()
 		os.Exit(1)
 	}
 
-	if *genType == "go" && *pkg == "" {
+	if *genType == "go" && *report != "" {
+		fmt.Fprintf(os.Stderr, "Error: -report requires the C++ generator\n")
+		os.Exit(1)
+	}
+
+	if *genType == "go" && *pkg == "" && !multi {
 		fmt.Fprintf(os.Stderr, "Error: -p (package) parameter is required for Go generator\n")
 		flag.Usage()
 		os.Exit(1)
 	}
 
-	// Get input file from command line arguments
-	args := flag.Args()
-	if len(args) == 0 {
-		fmt.Fprintf(os.Stderr, "Error: input file is required\n")
-		flag.Usage()
+	cfg := config{
+		genType:   *genType,
+		namespace: *namespace,
+		pkg:       *pkg,
+		cppOpts:   generator.CppOptions{HeaderOnly: *headerOnly, Views: *views, Dispatch: *dispatch, Batch: *batch, SortFields: *sortFields, Crc: *crc, Stats: *stats, Host: host, Capture: *capture},
+		goOpts:    generator.GoOptions{Batch: *batch, Crc: *crc, Stats: *stats, Unsafe: *unsafe, Client: *client, Capture: *capture},
+		report:    *report != "",
+	}
+	var js []job
+	for _, input := range args {
+		js = append(js, newJob(cfg, input, *output, multi))
+	}
+	if err := checkOutputs(js); err != nil {
+		fmt.Fprintf(os.Stderr, "Error: %v\n", err)
 		os.Exit(1)
 	}
-	if len(args) > 1 {
-		fmt.Fprintf(os.Stderr, "Error: only one input file is allowed\n")
-		flag.Usage()
+
+	cache, err := loadCache(*cacheFile)
+	if err != nil {
+		fmt.Fprintf(os.Stderr, "Error reading cache file %s: %v\n", *cacheFile, err)
 		os.Exit(1)
 	}
 
-	inputFile := args[0]
+	// Generate the files in parallel, the results are reported in the order of the inputs
+	results := make([]result, len(js))
+	work := make(chan int)
+	var wg sync.WaitGroup
+	for w := 0; w < min(max(*jobs, 1), len(js)); w++ {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			for i := range work {
+				results[i] = run(cfg, js[i], cache)
+			}
+		}()
+	}
+	for i := range js {
+		work <- i
+	}
+	close(work)
+	wg.Wait()
 
-	// Set default output file if not specified
-	if *output == "" {
-		ext := filepath.Ext(inputFile)
-		base := filepath.Base(inputFile)
-		if ext != "" {
-			base = base[:len(base)-len(ext)]
+	failed := false
+	var reports []*generator.CppReport
+	for i, r := range results {
+		for _, m := range r.messages {
+			fmt.Println(m)
 		}
-		if *genType == "cpp" {
-			*output = base
-		} else {
-			*output = base + ".go"
+		if r.err != nil {
+			fmt.Fprintf(os.Stderr, "Error %v\n", r.err)
+			failed = true
+			continue
+		}
+		if cache != nil {
+			cache.Files[js[i].outputBase] = r.key
+		}
+		if r.report != nil {
+			reports = append(reports, r.report)
+		}
+	}
+	if err := writeReport(*report, reports); err != nil {
+		fmt.Fprintf(os.Stderr, "Error writing report %s: %v\n", *report, err)
+		os.Exit(1)
+	}
+	if err := cache.save(*cacheFile); err != nil {
+		fmt.Fprintf(os.Stderr, "Error writing cache file %s: %v\n", *cacheFile, err)
+		os.Exit(1)
+	}
+	if failed {
+		os.Exit(1)
+	}
+}
+
+// newJob returns the job of the input file. The output of a single input is the -o file, several
+// inputs are written to the -o directory, each Go file to its own package directory.
+func newJob(cfg config, input, output string, multi bool) job {
+	base := filepath.Base(input)
+	base = base[:len(base)-len(filepath.Ext(base))]
+	j := job{input: input, outputBase: output, namespace: cfg.namespace, pkg: cfg.pkg}
+	if multi {
+		name := identifier(base)
+		if j.namespace == "" {
+			j.namespace = name
+		}
+		if j.pkg == "" {
+			j.pkg = strings.ToLower(name)
+		}
+		dir := output
+		if dir == "" {
+			dir = filepath.Dir(input)
+		}
+		j.outputBase = filepath.Join(dir, base)
+		if cfg.genType == "go" {
+			j.outputBase = filepath.Join(dir, j.pkg, base)
+		}
+	} else if j.outputBase == "" {
+		// Set default output file if not specified
+		j.outputBase = base
+	}
+	if cfg.genType == "go" {
+		if filepath.Ext(j.outputBase) != ".go" {
+			j.outputBase += ".go"
+		}
+		return j
+	}
+	// Remove extension from output if it was specified
+	if ext := filepath.Ext(j.outputBase); ext == ".h" || ext == ".hpp" || ext == ".cpp" {
+		j.outputBase = j.outputBase[:len(j.outputBase)-len(ext)]
+	}
+	return j
+}
+
+// checkOutputs returns the error if two jobs write the same files, e.g. the inputs with the
+// same name in different directories, as they would overwrite each other and the cache entry
+func checkOutputs(js []job) error {
+	inputs := make(map[string]string)
+	for _, j := range js {
+		out := filepath.Clean(j.outputBase)
+		if other, ok := inputs[out]; ok {
+			return fmt.Errorf("%s and %s are both generated to %s, rename one of them or run them separately", other, j.input, out)
+		}
+		inputs[out] = j.input
+	}
+	return nil
+}
+
+// identifier turns the file name into the namespace or package name
+func identifier(name string) string {
+	b := []byte(name)
+	for i, c := range b {
+		if !(c >= 'a' && c <= 'z' || c >= 'A' && c <= 'Z' || c >= '0' && c <= '9' || c == '_') {
+			b[i] = '_'
 		}
 	}
+	if len(b) == 0 || b[0] >= '0' && b[0] <= '9' {
+		b = append([]byte{'_'}, b...)
+	}
+	return string(b)
+}
 
+// outputs returns the files generated by the job
+func (j job) outputs(cfg config) []string {
+	switch {
+	case cfg.genType == "go":
+		return []string{j.outputBase}
+	case cfg.cppOpts.HeaderOnly:
+		return []string{j.outputBase + ".h"}
+	default:
+		return []string{j.outputBase + ".h", j.outputBase + ".cpp"}
+	}
+}
+
+func run(cfg config, j job, cache *hashCache) result {
 	// Read input file
-	inputData, err := os.ReadFile(inputFile)
+	inputData, err := os.ReadFile(j.input)
 	if err != nil {
-		fmt.Fprintf(os.Stderr, "Error reading input file %s: %v\n", inputFile, err)
-		os.Exit(1)
+		return result{err: fmt.Errorf("reading input file %s: %w", j.input, err)}
+	}
+	var res result
+	outs := j.outputs(cfg)
+	if cache != nil {
+		res.key = cache.key(cfg, j, inputData)
+		// the report needs the generated code, the outputs stay up to date
+		if cache.fresh(j.outputBase, res.key, outs) && !cfg.report {
+			res.messages = append(res.messages, fmt.Sprintf("Skipped %s, the input is not changed", j.input))
+			return res
+		}
 	}
 
 	// Parse the input
 	device, err := parser.Parse(string(inputData))
 	if err != nil {
-		fmt.Fprintf(os.Stderr, "Error parsing input: %v\n", err)
-		os.Exit(1)
+		return result{err: fmt.Errorf("parsing input %s: %w", j.input, err)}
 	}
 
 	// Generate code
-	if *genType == "cpp" {
-		// Remove extension from output if it was specified
-		outputBase := *output
-		if ext := filepath.Ext(outputBase); ext == ".h" || ext == ".hpp" || ext == ".cpp" {
-			outputBase = outputBase[:len(outputBase)-len(ext)]
-		}
-
-		hppFileName := outputBase + ".h"
-		cppFileName := outputBase + ".cpp"
-
+	var contents []string
+	if cfg.genType == "cpp" {
 		// Use only the base filename (without directory path) for includes and guards
-		baseHppFileName := filepath.Base(hppFileName)
-		hpp, cpp, err := generator.GenerateHppCpp(device, *namespace, baseHppFileName)
+		hpp, cpp, err := generator.GenerateHppCppWithOptions(device, j.namespace, filepath.Base(outs[0]), cfg.cppOpts)
+		if err != nil {
+			return result{err: fmt.Errorf("generating code for %s: %w", j.input, err)}
+		}
+		contents = []string{hpp, cpp}
+		if cfg.report {
+			if res.report, err = generator.GenerateCppReport(device, j.namespace, cfg.cppOpts); err != nil {
+				return result{err: fmt.Errorf("reporting %s: %w", j.input, err)}
+			}
+		}
+		if cfg.cppOpts.SortFields {
+			for _, s := range generator.CppStructSizes(device) {
+				res.messages = append(res.messages, fmt.Sprintf("  %s: %d bytes on the 32-bit targets, %d bytes in the declaration order", s.Register, s.Sorted, s.Declared))
+			}
+		}
+	} else {
+		code, err := generator.GenerateGoWithOptions(device, j.pkg, cfg.goOpts)
 		if err != nil {
-			fmt.Fprintf(os.Stderr, "Error generating code: %v\n", err)
-			os.Exit(1)
+			return result{err: fmt.Errorf("generating code for %s: %w", j.input, err)}
 		}
-		// Write output file
-		err = os.WriteFile(hppFileName, []byte(hpp), 0644)
+		contents = []string{code}
+	}
+
+	// Write output files, the unchanged ones keep their modification time, so the build doesn't
+	// recompile them
+	for i, name := range outs {
+		written, err := writeIfChanged(name, []byte(contents[i]))
 		if err != nil {
-			fmt.Fprintf(os.Stderr, "Error writing output file %s: %v\n", hppFileName, err)
-			os.Exit(1)
+			return result{messages: res.messages, err: fmt.Errorf("writing output file %s: %w", name, err)}
 		}
-		fmt.Printf("Successfully generated %s\n", hppFileName)
-		err = os.WriteFile(cppFileName, []byte(cpp), 0644)
+		if written {
+			res.messages = append(res.messages, fmt.Sprintf("Successfully generated %s", name))
+		} else {
+			res.messages = append(res.messages, fmt.Sprintf("%s is up to date", name))
+		}
+	}
+	return res
+}
+
+// writeReport writes the reports of the devices to the file: the JSON array of the reports for
+// the .json file, the text otherwise, "-" prints the text. The empty name does nothing.
+func writeReport(name string, reports []*generator.CppReport) error {
+	if name == "" {
+		return nil
+	}
+	var buf bytes.Buffer
+	if filepath.Ext(name) == ".json" {
+		data, err := json.MarshalIndent(reports, "", "  ")
 		if err != nil {
-			fmt.Fprintf(os.Stderr, "Error writing output file %s: %v\n", cppFileName, err)
-			os.Exit(1)
+			return err
+		}
+		buf.Write(append(data, '\n'))
+	} else {
+		for _, r := range reports {
+			if err := r.WriteText(&buf); err != nil {
+				return err
+			}
 		}
-		fmt.Printf("Successfully generated %s\n", cppFileName)
-		return
 	}
-	code, err := generator.GenerateGo(device, *pkg)
+	if name == "-" {
+		_, err := os.Stdout.Write(buf.Bytes())
+		return err
+	}
+	_, err := writeIfChanged(name, buf.Bytes())
+	return err
+}
+
+// writeIfChanged writes the file unless it has the same contents already, returns true if the
+// file was written
+func writeIfChanged(name string, data []byte) (bool, error) {
+	if old, err := os.ReadFile(name); err == nil && bytes.Equal(old, data) {
+		return false, nil
+	}
+	if err := os.MkdirAll(filepath.Dir(name), 0755); err != nil {
+		return false, err
+	}
+	return true, os.WriteFile(name, data, 0644)
+}
+
+// hashCache keeps the hashes of the inputs of the generated files between the runs. The hash
+// covers the input file, the options and the generator executable itself, so the rebuilt
+// generator regenerates everything.
+type hashCache struct {
+	Files map[string]string `json:"files"` // the output file to the hash of its inputs
+
+	generator string
+	loaded    map[string]string // Files of the previous run, read by the jobs concurrently
+}
+
+// loadCache reads the cache file, the missing file is the empty cache. Returns nil if the file
+// name is empty.
+func loadCache(name string) (*hashCache, error) {
+	if name == "" {
+		return nil, nil
+	}
+	exe, err := executableHash()
 	if err != nil {
-		fmt.Fprintf(os.Stderr, "Error generating code: %v\n", err)
-		os.Exit(1)
+		return nil, err
+	}
+	c := &hashCache{Files: map[string]string{}, generator: exe}
+	data, err := os.ReadFile(name)
+	switch {
+	case os.IsNotExist(err):
+	case err != nil:
+		return nil, err
+	case json.Unmarshal(data, c) != nil:
+		// the broken cache is dropped, everything is regenerated
+		c.Files = map[string]string{}
+	}
+	c.loaded = make(map[string]string, len(c.Files))
+	for k, v := range c.Files {
+		c.loaded[k] = v
 	}
+	return c, nil
+}
 
-	// Write output file
-	err = os.WriteFile(*output, []byte(code), 0644)
+func executableHash() (string, error) {
+	name, err := os.Executable()
 	if err != nil {
-		fmt.Fprintf(os.Stderr, "Error writing output file %s: %v\n", *output, err)
-		os.Exit(1)
+		return "", err
 	}
+	f, err := os.Open(name)
+	if err != nil {
+		return "", err
+	}
+	defer f.Close()
+	h := sha256.New()
+	if _, err := io.Copy(h, f); err != nil {
+		return "", err
+	}
+	return hex.EncodeToString(h.Sum(nil)), nil
+}
 
-	fmt.Printf("Successfully generated %s\n", *output)
+func (c *hashCache) key(cfg config, j job, input []byte) string {
+	h := sha256.New()
+	fmt.Fprintf(h, "%s\n%s\n%s\n%s\n%+v\n%+v\n", c.generator, cfg.genType, j.namespace, j.pkg, cfg.cppOpts, cfg.goOpts)
+	h.Write(input)
+	return hex.EncodeToString(h.Sum(nil))
+}
+
+// fresh returns true if the files were generated from the same inputs and still exist
+func (c *hashCache) fresh(base, key string, files []string) bool {
+	if c.loaded[base] != key {
+		return false
+	}
+	for _, f := range files {
+		if _, err := os.Stat(f); err != nil {
+			return false
+		}
+	}
+	return true
+}
+
+// save writes the cache file if it changed
+func (c *hashCache) save(name string) error {
+	if c == nil {
+		return nil
+	}
+	data, err := json.MarshalIndent(c, "", "  ")
+	if err != nil {
+		return err
+	}
+	_, err = writeIfChanged(name, append(data, '\n'))
+	return err
 }
@@ -0,0 +1,121 @@
+package main
+
+import (
+	"os"
+	"path/filepath"
+	"testing"
+	"time"
+
+	"github.com/dspasibenko/pargus/pkg/generator"
+	"github.com/stretchr/testify/require"
+)
+
+const testInput = `
+device test
+
+register Status(1):r {
+    value uint8;
+};
+`
+
+func TestNewJob(t *testing.T) {
+	cpp := config{genType: "cpp", namespace: "ns"}
+	require.Equal(t, job{input: "dev/a.pa", outputBase: "out", namespace: "ns"}, newJob(cpp, "dev/a.pa", "out.h", false))
+	require.Equal(t, job{input: "dev/a.pa", outputBase: "a", namespace: "ns"}, newJob(cpp, "dev/a.pa", "", false))
+
+	// the single Go output gets the extension
+	gocfg := config{genType: "go", pkg: "p"}
+	require.Equal(t, job{input: "a.pa", outputBase: "foo.go", pkg: "p"}, newJob(gocfg, "a.pa", "foo", false))
+	require.Equal(t, job{input: "a.pa", outputBase: "foo.go", pkg: "p"}, newJob(gocfg, "a.pa", "foo.go", false))
+
+	// several inputs default the namespaces and the packages to the file names
+	require.Equal(t, job{input: "dev/my-sensor.pa", outputBase: filepath.Join("gen", "my-sensor"), namespace: "my_sensor", pkg: "my_sensor"},
+		newJob(config{genType: "cpp"}, "dev/my-sensor.pa", "gen", true))
+	require.Equal(t, job{input: "dev/Motor.pa", outputBase: filepath.Join("gen", "motor", "Motor.go"), namespace: "Motor", pkg: "motor"},
+		newJob(config{genType: "go"}, "dev/Motor.pa", "gen", true))
+	require.Equal(t, job{input: "dev/1x.pa", outputBase: filepath.Join("dev", "1x"), namespace: "ns", pkg: "_1x"},
+		newJob(cpp, "dev/1x.pa", "", true))
+
+	// the inputs with the same name in different directories can't share the output directory
+	js := []job{newJob(cpp, "a/dev.pa", "gen", true), newJob(cpp, "b/dev.pa", "gen", true)}
+	err := checkOutputs(js)
+	require.Error(t, err)
+	require.Contains(t, err.Error(), "a/dev.pa and b/dev.pa are both generated to "+filepath.Join("gen", "dev"))
+	require.NoError(t, checkOutputs([]job{newJob(cpp, "a/dev.pa", "", true), newJob(cpp, "b/dev.pa", "", true)}))
+	require.Error(t, checkOutputs([]job{newJob(gocfg, "a/dev.pa", "gen", true), newJob(gocfg, "b/dev.pa", "gen", true)}))
+}
+
+func TestWriteIfChanged(t *testing.T) {
+	name := filepath.Join(t.TempDir(), "sub", "out.h")
+	written, err := writeIfChanged(name, []byte("a"))
+	require.NoError(t, err)
+	require.True(t, written)
+
+	old := time.Now().Add(-time.Hour).Truncate(time.Second)
+	require.NoError(t, os.Chtimes(name, old, old))
+	written, err = writeIfChanged(name, []byte("a"))
+	require.NoError(t, err)
+	require.False(t, written)
+	fi, err := os.Stat(name)
+	require.NoError(t, err)
+	require.True(t, fi.ModTime().Equal(old))
+
+	written, err = writeIfChanged(name, []byte("b"))
+	require.NoError(t, err)
+	require.True(t, written)
+	data, err := os.ReadFile(name)
+	require.NoError(t, err)
+	require.Equal(t, "b", string(data))
+}
+
+func TestCache(t *testing.T) {
+	dir := t.TempDir()
+	input := filepath.Join(dir, "test.pa")
+	require.NoError(t, os.WriteFile(input, []byte(testInput), 0644))
+	cacheFile := filepath.Join(dir, "cache")
+	cfg := config{genType: "cpp", namespace: "test"}
+	j := newJob(cfg, input, filepath.Join(dir, "out", "test.h"), false)
+
+	// run generates the job with the cache loaded from the file and saves it, as main does
+	generate := func(cfg config) result {
+		cache, err := loadCache(cacheFile)
+		require.NoError(t, err)
+		r := run(cfg, j, cache)
+		require.NoError(t, r.err)
+		cache.Files[j.outputBase] = r.key
+		require.NoError(t, cache.save(cacheFile))
+		return r
+	}
+	skipped := []string{"Skipped " + input + ", the input is not changed"}
+	generated := []string{"Successfully generated " + j.outputBase + ".h", "Successfully generated " + j.outputBase + ".cpp"}
+	upToDate := []string{j.outputBase + ".h is up to date", j.outputBase + ".cpp is up to date"}
+
+	require.Equal(t, generated, generate(cfg).messages)
+	require.Equal(t, skipped, generate(cfg).messages)
+
+	// the other options and namespaces regenerate
+	stats := cfg
+	stats.cppOpts = generator.CppOptions{Stats: true}
+	require.Len(t, generate(stats).messages, 2)
+	require.Equal(t, skipped, generate(stats).messages)
+	require.Len(t, generate(cfg).messages, 2)
+	j.namespace = "other"
+	require.Equal(t, generated, generate(cfg).messages)
+	j.namespace = "test"
+	require.Equal(t, generated, generate(cfg).messages)
+	require.Equal(t, skipped, generate(cfg).messages)
+
+	// the missing output is regenerated, the existing one is up to date
+	require.NoError(t, os.Remove(j.outputBase+".cpp"))
+	require.Equal(t, []string{upToDate[0], generated[1]}, generate(cfg).messages)
+	require.Equal(t, skipped, generate(cfg).messages)
+
+	// the changed input is regenerated
+	require.NoError(t, os.WriteFile(input, []byte(testInput+"\n"), 0644))
+	require.Equal(t, upToDate, generate(cfg).messages)
+	require.Equal(t, skipped, generate(cfg).messages)
+
+	// the broken cache file regenerates everything
+	require.NoError(t, os.WriteFile(cacheFile, []byte("{"), 0644))
+	require.Equal(t, upToDate, generate(cfg).messages)
+}
@@ -0,0 +1,309 @@
+// Package capture reads and writes the capture files of the register traffic: the register
+// requests and responses recorded by a gateway, for debugging and for replaying them through
+// the generated codecs.
+//
+// A capture file is append-only and is read in place from the mapped file. It starts with the
+// 8 bytes header "PARGCAP" followed by the format version 1, and the records follow it. Every
+// record is the 16 bytes header and the payload, padded with zeros to 8 bytes, so the record
+// headers stay aligned in the mapped pages. The header fields are little-endian:
+//
+//	offset 0   int64   the time, nanoseconds since the Unix epoch
+//	offset 8   uint32  the payload size
+//	offset 12  uint16  the device, e.g. its bus address
+//	offset 14  uint8   the register ID, see the generated Reg_<Register>_ID
+//	offset 15  uint8   the flags, bit 0 is set if the payload is the register write fields
+//
+// The payload is the serialized read or write fields of the register, the generated
+// Deserialize* methods decode it without copying.
+package capture
+
+import (
+	"bufio"
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"io"
+	"os"
+	"time"
+)
+
+const (
+	// HeaderSize is the size of the file header
+	HeaderSize = 8
+	// RecordHeaderSize is the size of the record header preceding the payload
+	RecordHeaderSize = 16
+
+	version   = 1
+	flagWrite = 1
+)
+
+var magic = [HeaderSize]byte{'P', 'A', 'R', 'G', 'C', 'A', 'P', version}
+
+// ErrTruncated is returned by Reader.Err if the file ends in the middle of a record, e.g. the
+// record which was being appended when the file was mapped, or when the writer crashed
+var ErrTruncated = errors.New("capture: truncated record")
+
+// Record is one register request or response
+type Record struct {
+	Time    int64  // nanoseconds since the Unix epoch
+	Device  uint16 // the device, e.g. its bus address
+	ID      uint8  // the register ID
+	Write   bool   // Payload is the write fields of the register, otherwise the read fields
+	Payload []byte
+}
+
+// recordSize returns the size of the record with the payload of n bytes in the file
+func recordSize(n int) int {
+	return RecordHeaderSize + (n+7)&^7
+}
+
+// Writer appends the records to the capture file
+type Writer struct {
+	w   *bufio.Writer
+	f   *os.File // the file opened by Append, nil for NewWriter
+	buf [RecordHeaderSize + 8]byte
+}
+
+// NewWriter writes the file header to w and returns the writer of the records after it
+func NewWriter(w io.Writer) (*Writer, error) {
+	cw := &Writer{w: bufio.NewWriter(w)}
+	if _, err := cw.w.Write(magic[:]); err != nil {
+		return nil, err
+	}
+	return cw, nil
+}
+
+// Append opens the capture file for appending the records, the file is created if it doesn't
+// exist. The truncated record at the end of the file, left by a crashed writer, is cut off.
+func Append(name string) (*Writer, error) {
+	end, err := validEnd(name)
+	if err != nil {
+		return nil, err
+	}
+	f, err := os.OpenFile(name, os.O_RDWR|os.O_CREATE, 0644)
+	if err != nil {
+		return nil, err
+	}
+	if end > 0 {
+		if err = f.Truncate(end); err == nil {
+			_, err = f.Seek(end, io.SeekStart)
+		}
+	}
+	if err != nil {
+		f.Close()
+		return nil, err
+	}
+	cw := &Writer{w: bufio.NewWriter(f), f: f}
+	if end == 0 {
+		if _, err := cw.w.Write(magic[:]); err != nil {
+			f.Close()
+			return nil, err
+		}
+	}
+	return cw, nil
+}
+
+// validEnd returns the end of the last complete record of the file, 0 for the empty or missing
+// file
+func validEnd(name string) (int64, error) {
+	if fi, err := os.Stat(name); os.IsNotExist(err) || err == nil && fi.Size() == 0 {
+		return 0, nil
+	}
+	f, err := Open(name)
+	if err != nil {
+		return 0, err
+	}
+	defer f.Close()
+	r := f.Reader()
+	for _, ok := r.Next(); ok; _, ok = r.Next() {
+	}
+	return int64(r.Offset()), nil
+}
+
+// Write appends the record, Time 0 is replaced with the current time
+func (w *Writer) Write(rec Record) error {
+	if uint64(len(rec.Payload)) > 0xFFFFFFFF {
+		return fmt.Errorf("capture: payload too big: %d bytes", len(rec.Payload))
+	}
+	if rec.Time == 0 {
+		rec.Time = time.Now().UnixNano()
+	}
+	h := w.buf[:RecordHeaderSize]
+	binary.LittleEndian.PutUint64(h[0:], uint64(rec.Time))
+	binary.LittleEndian.PutUint32(h[8:], uint32(len(rec.Payload)))
+	binary.LittleEndian.PutUint16(h[12:], rec.Device)
+	h[14] = rec.ID
+	h[15] = 0
+	if rec.Write {
+		h[15] = flagWrite
+	}
+	if _, err := w.w.Write(h); err != nil {
+		return err
+	}
+	if _, err := w.w.Write(rec.Payload); err != nil {
+		return err
+	}
+	pad := recordSize(len(rec.Payload)) - RecordHeaderSize - len(rec.Payload)
+	clear(w.buf[RecordHeaderSize:])
+	_, err := w.w.Write(w.buf[RecordHeaderSize : RecordHeaderSize+pad])
+	return err
+}
+
+// Flush writes the buffered records to the file
+func (w *Writer) Flush() error {
+	return w.w.Flush()
+}
+
+// Close flushes the records and closes the file opened by Append
+func (w *Writer) Close() error {
+	err := w.w.Flush()
+	if w.f != nil {
+		if cerr := w.f.Close(); err == nil {
+			err = cerr
+		}
+	}
+	return err
+}
+
+// Reader walks the records of the capture file contents, e.g. of the mapped file. The
+// payloads of the records are the slices of the contents, they are not copied.
+type Reader struct {
+	data []byte
+	off  int
+	err  error
+}
+
+// NewReader returns the reader of the capture file contents
+func NewReader(data []byte) (*Reader, error) {
+	if len(data) < HeaderSize || [HeaderSize]byte(data[:HeaderSize]) != magic {
+		return nil, errors.New("capture: not a capture file or unsupported version")
+	}
+	return &Reader{data: data, off: HeaderSize}, nil
+}
+
+// Next returns the next record, false at the end of the file or at the truncated record
+func (r *Reader) Next() (Record, bool) {
+	rest := r.data[r.off:]
+	if len(rest) == 0 {
+		return Record{}, false
+	}
+	if len(rest) < RecordHeaderSize {
+		r.err = ErrTruncated
+		return Record{}, false
+	}
+	n := binary.LittleEndian.Uint32(rest[8:])
+	if uint64(len(rest)) < RecordHeaderSize+(uint64(n)+7)&^7 {
+		r.err = ErrTruncated
+		return Record{}, false
+	}
+	rec := Record{
+		Time:    int64(binary.LittleEndian.Uint64(rest)),
+		Device:  binary.LittleEndian.Uint16(rest[12:]),
+		ID:      rest[14],
+		Write:   rest[15]&flagWrite != 0,
+		Payload: rest[RecordHeaderSize : RecordHeaderSize+int(n) : RecordHeaderSize+int(n)],
+	}
+	r.off += recordSize(int(n))
+	return rec, true
+}
+
+// Err returns ErrTruncated if Next stopped at the truncated record, nil at the end of the file
+func (r *Reader) Err() error {
+	return r.err
+}
+
+// Offset returns the offset of the next record in the contents
+func (r *Reader) Offset() int {
+	return r.off
+}
+
+// Reset rewinds the reader to the first record
+func (r *Reader) Reset() {
+	r.off, r.err = HeaderSize, nil
+}
+
+// File is the capture file mapped to the memory
+type File struct {
+	data  []byte
+	unmap func([]byte) error
+}
+
+// Open maps the capture file to the memory, read-only. The records appended after Open are not
+// visible, the record being appended may be truncated.
+func Open(name string) (*File, error) {
+	data, unmap, err := mapFile(name)
+	if err != nil {
+		return nil, err
+	}
+	if _, err := NewReader(data); err != nil {
+		unmap(data)
+		return nil, fmt.Errorf("%s: %w", name, err)
+	}
+	return &File{data: data, unmap: unmap}, nil
+}
+
+// Reader returns the reader of the file records, the payloads are valid until Close
+func (f *File) Reader() *Reader {
+	r, _ := NewReader(f.data)
+	return r
+}
+
+// Close unmaps the file
+func (f *File) Close() error {
+	data := f.data
+	f.data = nil
+	return f.unmap(data)
+}
+
+// Decoder decodes the payloads of the device registers. The generated Registers of the Go
+// target with the -capture option implement it with the Deserialize* methods.
+type Decoder interface {
+	Decode(id uint8, write bool, payload []byte) error
+}
+
+// ReplayStats is the result of Replay
+type ReplayStats struct {
+	Records  int           // the decoded records
+	Bytes    int64         // the decoded payloads size
+	Skipped  int           // the records of the devices without the decoder
+	Errors   int           // the records the decoder failed
+	FirstErr error         // the first decoder error
+	Elapsed  time.Duration // the time of the replay
+}
+
+// RecordsPerSecond returns the replay throughput in records
+func (s ReplayStats) RecordsPerSecond() float64 {
+	return float64(s.Records) / s.Elapsed.Seconds()
+}
+
+// BytesPerSecond returns the replay throughput in the payload bytes
+func (s ReplayStats) BytesPerSecond() float64 {
+	return float64(s.Bytes) / s.Elapsed.Seconds()
+}
+
+// Replay decodes the records of the reader by the decoders of their devices as fast as it can,
+// so it measures the throughput of the codecs on the real traffic as well. The records of the
+// devices without the decoder are skipped, the failed records are counted. The error is the
+// Reader error.
+func Replay(r *Reader, decoders map[uint16]Decoder) (ReplayStats, error) {
+	var s ReplayStats
+	start := time.Now()
+	for rec, ok := r.Next(); ok; rec, ok = r.Next() {
+		dec := decoders[rec.Device]
+		if dec == nil {
+			s.Skipped++
+			continue
+		}
+		if err := dec.Decode(rec.ID, rec.Write, rec.Payload); err != nil {
+			if s.Errors == 0 {
+				s.FirstErr = fmt.Errorf("record at %d, device %d, register %d: %w", r.Offset()-recordSize(len(rec.Payload)), rec.Device, rec.ID, err)
+			}
+			s.Errors++
+			continue
+		}
+		s.Records++
+		s.Bytes += int64(len(rec.Payload))
+	}
+	s.Elapsed = time.Since(start)
+	return s, r.Err()
+}
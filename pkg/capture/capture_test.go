@@ -0,0 +1,133 @@
+package capture
+
+import (
+	"bytes"
+	"errors"
+	"os"
+	"path/filepath"
+	"testing"
+
+	"github.com/stretchr/testify/assert"
+	"github.com/stretchr/testify/require"
+)
+
+func TestWriteRead(t *testing.T) {
+	recs := []Record{
+		{Time: 1, Device: 7, ID: 3, Payload: []byte{1, 2, 3}},
+		{Time: 2, Device: 0xFFFF, ID: 255, Write: true, Payload: []byte{}},
+		{Time: 3, Device: 1, ID: 1, Payload: bytes.Repeat([]byte{9}, 8)},
+	}
+	var buf bytes.Buffer
+	w, err := NewWriter(&buf)
+	require.NoError(t, err)
+	for _, rec := range recs {
+		require.NoError(t, w.Write(rec))
+	}
+	require.NoError(t, w.Flush())
+	data := buf.Bytes()
+	assert.Equal(t, HeaderSize+3*RecordHeaderSize+8+0+8, len(data))
+	assert.Equal(t, []byte{1, 0, 0, 0, 0, 0, 0, 0, 3, 0, 0, 0, 7, 0, 3, 0, 1, 2, 3, 0, 0, 0, 0, 0}, data[HeaderSize:HeaderSize+24])
+
+	r, err := NewReader(data)
+	require.NoError(t, err)
+	for i := 0; i < 2; i++ {
+		var got []Record
+		for rec, ok := r.Next(); ok; rec, ok = r.Next() {
+			got = append(got, rec)
+		}
+		require.NoError(t, r.Err())
+		assert.Equal(t, recs, got)
+		r.Reset()
+	}
+
+	// the payload is the slice of the contents
+	rec, _ := r.Next()
+	assert.Equal(t, &data[HeaderSize+RecordHeaderSize], &rec.Payload[0])
+
+	for _, n := range []int{len(data) - 1, len(data) - 12, HeaderSize + 3} {
+		r, err := NewReader(data[:n])
+		require.NoError(t, err)
+		for _, ok := r.Next(); ok; _, ok = r.Next() {
+		}
+		assert.True(t, errors.Is(r.Err(), ErrTruncated), n)
+	}
+
+	_, err = NewReader([]byte("PARGCAP\x02"))
+	assert.Error(t, err)
+}
+
+func TestAppendOpen(t *testing.T) {
+	name := filepath.Join(t.TempDir(), "traffic.cap")
+	for i := 0; i < 2; i++ {
+		w, err := Append(name)
+		require.NoError(t, err)
+		require.NoError(t, w.Write(Record{Device: 1, ID: uint8(i), Payload: []byte{byte(i)}}))
+		require.NoError(t, w.Close())
+	}
+
+	// the truncated record of a crashed writer is cut off
+	f, err := os.OpenFile(name, os.O_WRONLY|os.O_APPEND, 0)
+	require.NoError(t, err)
+	_, err = f.Write([]byte{1, 2, 3})
+	require.NoError(t, err)
+	require.NoError(t, f.Close())
+	w, err := Append(name)
+	require.NoError(t, err)
+	require.NoError(t, w.Write(Record{Device: 1, ID: 2, Write: true, Payload: []byte{2}}))
+	require.NoError(t, w.Close())
+
+	cf, err := Open(name)
+	require.NoError(t, err)
+	r := cf.Reader()
+	var ids []uint8
+	for rec, ok := r.Next(); ok; rec, ok = r.Next() {
+		assert.NotEqual(t, int64(0), rec.Time)
+		assert.Equal(t, []byte{rec.ID}, rec.Payload)
+		ids = append(ids, rec.ID)
+	}
+	require.NoError(t, r.Err())
+	assert.Equal(t, []uint8{0, 1, 2}, ids)
+	require.NoError(t, cf.Close())
+
+	require.NoError(t, os.WriteFile(name, []byte("hello"), 0644))
+	_, err = Open(name)
+	assert.Error(t, err)
+	_, err = Append(name)
+	assert.Error(t, err)
+}
+
+type decoderFunc func(id uint8, write bool, payload []byte) error
+
+func (f decoderFunc) Decode(id uint8, write bool, payload []byte) error {
+	return f(id, write, payload)
+}
+
+func TestReplay(t *testing.T) {
+	var buf bytes.Buffer
+	w, err := NewWriter(&buf)
+	require.NoError(t, err)
+	for i := 0; i < 10; i++ {
+		require.NoError(t, w.Write(Record{Device: uint16(i % 3), ID: uint8(i), Payload: make([]byte, i)}))
+	}
+	require.NoError(t, w.Flush())
+	r, err := NewReader(buf.Bytes())
+	require.NoError(t, err)
+
+	var ids []uint8
+	dec := decoderFunc(func(id uint8, write bool, payload []byte) error {
+		if id == 3 {
+			return errors.New("bad")
+		}
+		ids = append(ids, id)
+		return nil
+	})
+	s, err := Replay(r, map[uint16]Decoder{0: dec, 1: dec})
+	require.NoError(t, err)
+	assert.Equal(t, []uint8{0, 1, 4, 6, 7, 9}, ids)
+	assert.Equal(t, 6, s.Records)
+	assert.Equal(t, int64(27), s.Bytes)
+	assert.Equal(t, 3, s.Skipped)
+	assert.Equal(t, 1, s.Errors)
+	require.Error(t, s.FirstErr)
+	assert.Equal(t, "record at 72, device 0, register 3: bad", s.FirstErr.Error())
+}
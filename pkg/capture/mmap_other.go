@@ -0,0 +1,14 @@
+//go:build !unix
+
+package capture
+
+import "os"
+
+// mapFile reads the file, the platform doesn't map the files with syscall.Mmap
+func mapFile(name string) ([]byte, func([]byte) error, error) {
+	data, err := os.ReadFile(name)
+	if err != nil {
+		return nil, nil, err
+	}
+	return data, func([]byte) error { return nil }, nil
+}
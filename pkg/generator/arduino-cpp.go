@@ -3,6 +3,8 @@ package generator
 import (
 	"bytes"
 	"fmt"
+	"regexp"
+	"sort"
 	"strconv"
 	"strings"
 	"text/template"
@@ -18,8 +20,14 @@ const hppTemplate = `
 // This is auto-generated file. DO NOT EDIT. Use pargus compiler to regenerate it. 
 
 #pragma once
-
+{{if .Host}}{{template "host_prelude" .}}
+{{- if .HeaderOnly}}{{template "host_intrinsics" .}}{{end}}
+{{- else}}
 #include <Arduino.h>
+{{- if .HeaderOnly}}
+#include "bigendian.h"
+{{- end}}
+{{- end}}
  
 {{- range .Doc}}
 {{.}}
@@ -33,10 +41,74 @@ static constexpr uint8_t Reg_{{.Name}}_ID = {{.Number}};
 
 static constexpr uint8_t Max_Reg_ID = {{.MaxRegisterId}};
 
+// The biggest wire size of all registers, enough for any read or write buffer
+static constexpr size_t Max_Wire_Size = {{.MaxWireSize}};
+
+// The hash of the wire layout of all registers, the comments and the names of the registers and
+// their fields don't change it
+static constexpr uint64_t Layout_Hash = {{.LayoutHash}};
+
+// The handshake is Layout_Hash followed by the [register ID][register layout hash] entries in
+// the ID order, big-endian. The device answers it once per connection, so the gateway picks the
+// codecs of the device schema, or finds the registers it can't talk to, before the first request.
+static constexpr size_t Handshake_Size = {{.HandshakeSize}};
+
+// Serializes the handshake into buf. Returns Handshake_Size, or -1 if the buffer is too small.
+{{.Inline}}int serialize_handshake(uint8_t* buf, size_t size);
+{{- if .Stats}}
+
+#ifdef PARGUS_STATS
+// Codec_Stats counts the calls of a register codec: the failed ones, which returned -1, and the
+// bytes written or read by the others
+struct Codec_Stats {
+	uint32_t calls;
+	uint32_t failures;
+	uint32_t bytes;
+};
+
+struct Register_Stats {
+	Codec_Stats serialize_read;
+	Codec_Stats serialize_write;
+	Codec_Stats deserialize_read;
+	Codec_Stats deserialize_write;
+};
+
+// Returns the statistics of the registers codecs indexed by the register ID, Max_Reg_ID + 1
+// entries of 48 bytes
+{{.Inline}}Register_Stats* stats();
+#endif
+{{- end}}
+{{- if .Crc}}
+
+// The {{.Crc.Title}} checksum which follows the wire data of the _crc codecs, their buffers
+// need Crc_Size more bytes
+static constexpr size_t Crc_Size = {{.Crc.Size}};
+{{- end}}
+{{- if .Streams}}
+
+// Stream_State is the position of the chunked serialization or deserialization of a stream
+// register. It must be reset before the first chunk.
+struct Stream_State {
+	static constexpr uint8_t kDone = 0xFF;
+	uint8_t field;       // the current field, kDone once the register is complete
+	uint8_t pos;         // the next byte of the scratch buffer
+	uint8_t len;         // the number of bytes in the scratch buffer
+	size_t index;        // the next element of the current array field
+	uint8_t scratch[10]; // the value split between the chunks, up to the longest varint
+
+	void reset() { memset(this, 0, sizeof(*this)); }
+	bool done() const { return field == kDone; }
+};
+{{- end}}
+
 {{- range .Registers}}
 {{range .Doc}}{{.}}
 {{end -}}
 struct {{.Name}} {
+{{- if .SizeReport}}
+    // Members are sorted by the alignment, the wire order is the declaration order.
+    // {{.SizeReport}}
+{{- end}}
 {{- range .Constants}}
     {{- range .Doc}}
     {{.}}
@@ -53,12 +125,333 @@ struct {{.Name}} {
     {{.Decl}}{{if .Trailing}} {{.Trailing}}{{end}}
 {{- end}}
 
+    static constexpr uint8_t kRegId = Reg_{{.Name}}_ID;
+    static constexpr uint64_t kLayoutHash = {{.LayoutHash}}; // see Layout_Hash
+{{- if .Allocator}}
+
+    // The variable-length arrays take their elements from the memory resource, e.g. the
+    // pargus::Arena shared by a burst of frames, instead of the heap
+    {{.Name}}() = default;
+    explicit {{.Name}}(std::pmr::memory_resource* mr) : {{range $i, $m := .Allocator}}{{if $i}}, {{end}}{{$m}}{{end}} {}
+{{- end}}
+
+    // Wire sizes of the read and write fields
+{{- if ge .ReadWireSize 0}}
+    static constexpr size_t kReadWireSize = {{.ReadWireSize}};
+{{- end}}
+    static constexpr size_t kReadWireSizeMax = {{.ReadWireSizeMax}};
+{{- if ge .WriteWireSize 0}}
+    static constexpr size_t kWriteWireSize = {{.WriteWireSize}};
+{{- end}}
+    static constexpr size_t kWriteWireSizeMax = {{.WriteWireSizeMax}};
+{{- if .WireOffsets}}
+
+    // Wire offsets of the fields in the static prefix of the wire data. peek_/poke_ read and
+    // patch the field in place in the wire buffer, which must hold the field.
+{{- range .WireOffsets}}
+    static constexpr size_t {{.Name}} = {{.Value}};
+{{- end}}
+{{- range .Accessors}}
+	static {{.Type}} peek_{{.Name}}(const uint8_t* buf);
+	static void poke_{{.Name}}(uint8_t* buf, {{.Type}} v);
+{{- end}}
+{{- end}}
+{{- if .Validators}}
+
+    // Valid values of the constrained fields, deserialization rejects the other ones
+{{- range .Validators}}
+    {{.}}
+{{- end}}
+{{- end}}
+{{- if .Delta}}
+
+    // Delta writes: the presence mask of the dirty write fields followed by these fields only
+    static constexpr size_t kDirtyMaskSize = {{.Delta.MaskSize}};
+    static constexpr size_t kWriteDeltaWireSizeMax = {{.Delta.WireSizeMax}};
+{{- range .Delta.Fields}}
+    static constexpr uint8_t {{.Name}}_dirty = {{.Index}};
+{{- end}}
+    uint8_t dirty[kDirtyMaskSize]{{if $.Host}}{}{{end}};
+{{- end}}
+{{if ge .ReadWireSize 0}}
+	size_t read_size() const { return kReadWireSize; }
+{{- else}}
+	size_t read_size() const;
+{{- end}}
+{{- if ge .WriteWireSize 0}}
+	size_t write_size() const { return kWriteWireSize; }
+{{- else}}
+	size_t write_size() const;
+{{- end}}
 	int serialize_read(uint8_t* buf, size_t size) const;
 	int serialize_write(uint8_t* buf, size_t size) const;
 	int deserialize_read(const uint8_t* buf, size_t size);
 	int deserialize_write(const uint8_t* buf, size_t size);
+{{- if .Crc}}
+	// The codecs followed by the checksum of the wire data. The deserialization updates the
+	// fields before the checksum is checked, so the register must not be used if it fails.
+	int serialize_read_crc(uint8_t* buf, size_t size) const;
+	int serialize_write_crc(uint8_t* buf, size_t size) const;
+	int deserialize_read_crc(const uint8_t* buf, size_t size);
+	int deserialize_write_crc(const uint8_t* buf, size_t size);
+{{- end}}
+{{- if .Stream}}
+	// Chunked codecs, see Stream_State: every call handles the next chunk of the wire data and
+	// returns the number of bytes written or read, the register is complete once st.done()
+	int serialize_read_chunk(Stream_State& st, uint8_t* buf, size_t size) const;
+	int serialize_write_chunk(Stream_State& st, uint8_t* buf, size_t size) const;
+	int deserialize_read_chunk(Stream_State& st, const uint8_t* buf, size_t size);
+	int deserialize_write_chunk(Stream_State& st, const uint8_t* buf, size_t size);
+{{- end}}
+{{- if .Delta}}
+	void mark_dirty(uint8_t field) { dirty[field >> 3] |= (uint8_t)(1 << (field & 7)); }
+	bool is_dirty(uint8_t field) const { return dirty[field >> 3] & (1 << (field & 7)); }
+	void clear_dirty() { memset(dirty, 0, sizeof(dirty)); }
+	int serialize_write_delta(uint8_t* buf, size_t size) const;
+	int deserialize_write_delta(const uint8_t* buf, size_t size);
+{{- end}}
+};
+{{- end}}
+{{- if .Dispatch}}
+
+// Handler serves the requests dispatched by the register ID. The device overrides the hooks
+// of the registers it supports, the default hooks reject the request.
+class Handler {
+public:
+{{- range .Registers}}
+{{- if .Readable}}
+	// Fills the register to answer the read request, returns false to reject the request
+	virtual bool on_read_{{.Name}}({{.Name}}& /*reg*/) { return false; }
+{{- end}}
+{{- if .PrepareWrite}}
+	// Points the variable-length arrays of the register to the storage before the write request
+	// is deserialized, returns false to reject the request
+	virtual bool prepare_write_{{.Name}}({{.Name}}& /*reg*/) { return false; }
+{{- end}}
+{{- if .Writable}}
+	// Applies the write request, returns false to reject it
+	virtual bool on_write_{{.Name}}(const {{.Name}}& /*reg*/) { return false; }
+{{- end}}
+{{- end}}
+
+protected:
+	~Handler() {}
+};
+
+// Serializes the register with the given ID to answer the read request. Returns the number of
+// bytes written, or -1 if the register is unknown or not readable, the handler rejects the
+// request, or the buffer is too small.
+int dispatch_read(uint8_t id, Handler& handler, uint8_t* buf, size_t size);
+
+// Deserializes the write request for the register with the given ID and passes it to the
+// handler. Returns the number of bytes read, or -1 if the request is rejected.
+int dispatch_write(uint8_t id, Handler& handler, const uint8_t* buf, size_t size);
+{{- end}}
+{{- if .Batch}}
+
+// ================= Batch frames =================
+// The batch frame carries several registers in one request or response: the entries count
+// followed by the entries [register ID][payload size, 2 bytes big-endian][payload]. The batch
+// read request is the registers count followed by their IDs.
+static constexpr size_t kBatchEntryHeaderSize = 3;
+static constexpr size_t kBatchEntrySizeMax = 0xFFFF;
+
+// Answers the batch read request: reads the registers listed in req from the handler and
+// serializes them as the batch frame into buf, req and buf must not overlap. Returns the frame
+// size, or -1 if a register is unknown or rejected, or the buffer is too small.
+int dispatch_read_batch(Handler& handler, const uint8_t* req, size_t req_size, uint8_t* buf, size_t size);
+
+// Applies the batch write frame: every entry is deserialized and passed to the handler in the
+// frame order. Returns the frame size, or -1 if an entry is malformed or rejected, the entries
+// preceding it are applied already.
+int dispatch_write_batch(Handler& handler, const uint8_t* buf, size_t size);
+
+// Batch_Writer builds the batch frame in the buffer, e.g. the batch write request. An entry
+// which doesn't fit the buffer fails the whole frame.
+class Batch_Writer {
+public:
+	Batch_Writer(uint8_t* buf, size_t size) : buf_(buf), size_(size), offset_(1), ok_(size > 0) {
+		if (ok_) buf_[0] = 0;
+	}
+
+	template <typename T>
+	bool add_read(const T& reg) {
+		return begin_entry() && end_entry(T::kRegId, reg.serialize_read(payload(), room()));
+	}
+
+	template <typename T>
+	bool add_write(const T& reg) {
+		return begin_entry() && end_entry(T::kRegId, reg.serialize_write(payload(), room()));
+	}
+
+	// Returns the frame size, or -1 if an entry didn't fit the buffer
+	int finish() const { return ok_ ? (int)offset_ : -1; }
+
+private:
+	bool begin_entry() {
+		ok_ = ok_ && buf_[0] < 0xFF && size_ - offset_ >= kBatchEntryHeaderSize;
+		return ok_;
+	}
+	uint8_t* payload() const { return buf_ + offset_ + kBatchEntryHeaderSize; }
+	size_t room() const {
+		size_t room = size_ - offset_ - kBatchEntryHeaderSize;
+		return room < kBatchEntrySizeMax ? room : kBatchEntrySizeMax;
+	}
+	bool end_entry(uint8_t id, int res) {
+		ok_ = res >= 0;
+		if (!ok_) return false;
+		buf_[offset_] = id;
+		buf_[offset_ + 1] = (uint8_t)(res >> 8);
+		buf_[offset_ + 2] = (uint8_t)res;
+		offset_ += kBatchEntryHeaderSize + res;
+		buf_[0]++;
+		return true;
+	}
+
+	uint8_t* buf_;
+	size_t size_;
+	size_t offset_;
+	bool ok_;
+};
+
+// Batch_Reader walks the entries of the batch frame, e.g. the batch read response. The
+// registers are read in the frame order, an entry of another register, bigger than the register
+// wire size or not consumed completely fails the read.
+class Batch_Reader {
+public:
+	Batch_Reader(const uint8_t* buf, size_t size) : buf_(buf), size_(size), offset_(1), left_(size > 0 ? buf[0] : 0) {}
+
+	// The number of entries which are not read yet
+	uint8_t left() const { return left_; }
+
+	template <typename T>
+	bool next_read(T& reg) {
+		size_t len = 0;
+		const uint8_t* p = next(T::kRegId, T::kReadWireSizeMax, len);
+		return p != nullptr && end_entry(reg.deserialize_read(p, len), len);
+	}
+
+	template <typename T>
+	bool next_write(T& reg) {
+		size_t len = 0;
+		const uint8_t* p = next(T::kRegId, T::kWriteWireSizeMax, len);
+		return p != nullptr && end_entry(reg.deserialize_write(p, len), len);
+	}
+
+	// Returns the frame size once all the entries are read, or -1
+	int finish() const { return left_ == 0 && size_ > 0 ? (int)offset_ : -1; }
+
+private:
+	const uint8_t* next(uint8_t id, size_t size_max, size_t& len) {
+		if (left_ == 0 || size_ - offset_ < kBatchEntryHeaderSize || buf_[offset_] != id) return nullptr;
+		len = ((size_t)buf_[offset_ + 1] << 8) | buf_[offset_ + 2];
+		if (len > size_max || size_ - offset_ - kBatchEntryHeaderSize < len) return nullptr;
+		return buf_ + offset_ + kBatchEntryHeaderSize;
+	}
+	bool end_entry(int res, size_t len) {
+		if (res < 0 || (size_t)res != len) return false;
+		offset_ += kBatchEntryHeaderSize + len;
+		left_--;
+		return true;
+	}
+
+	const uint8_t* buf_;
+	size_t size_;
+	size_t offset_;
+	uint8_t left_;
+};
+{{- end}}
+{{- if .Capture}}
+
+// ================= Capture decoding =================
+// The capture file of the register traffic is the 8 bytes header followed by the records, every
+// record is the 16 bytes little-endian header [time, ns: 8][payload size: 4][device: 2]
+// [register ID: 1][flags: 1, bit 0 is set for the write fields] and the payload, padded to 8
+// bytes. See the capture package of pargus, which writes them.
+static constexpr size_t kCaptureHeaderSize = 8;
+static constexpr size_t kCaptureRecordHeaderSize = 16;
+
+// Capture_Record is the record of the capture, the payload points into the capture contents
+struct Capture_Record {
+	int64_t time_ns;
+	uint16_t device;
+	uint8_t id;
+	bool write;
+	const uint8_t* payload;
+	size_t size;
+};
+
+// Capture_Reader walks the records of the capture file contents, e.g. of the mapped file,
+// without copying them
+class Capture_Reader {
+public:
+	Capture_Reader(const uint8_t* data, size_t size) : data_(data), size_(size), offset_(kCaptureHeaderSize), truncated_(false) {
+		static const uint8_t magic[kCaptureHeaderSize] = {'P', 'A', 'R', 'G', 'C', 'A', 'P', 1};
+		valid_ = size >= kCaptureHeaderSize && memcmp(data, magic, kCaptureHeaderSize) == 0;
+	}
+
+	// Returns false if the contents is not a capture file of the supported version
+	bool valid() const { return valid_; }
+
+	// Returns true if next stopped at the truncated record, e.g. the one still being appended
+	bool truncated() const { return truncated_; }
+
+	// Reads the next record, returns false at the end of the contents or at the truncated record
+	bool next(Capture_Record& rec) {
+		if (!valid_ || offset_ == size_) return false;
+		const uint8_t* h = data_ + offset_;
+		size_t left = size_ - offset_;
+		if (left < kCaptureRecordHeaderSize) return stop();
+		uint32_t n = (uint32_t)le(h + 8, 4);
+		uint64_t padded = ((uint64_t)n + 7) & ~(uint64_t)7;
+		if (left - kCaptureRecordHeaderSize < padded) return stop();
+		rec.time_ns = (int64_t)le(h, 8);
+		rec.device = (uint16_t)le(h + 12, 2);
+		rec.id = h[14];
+		rec.write = (h[15] & 1) != 0;
+		rec.payload = h + kCaptureRecordHeaderSize;
+		rec.size = n;
+		offset_ += kCaptureRecordHeaderSize + (size_t)padded;
+		return true;
+	}
+
+	// Rewinds the reader to the first record
+	void reset() { offset_ = kCaptureHeaderSize; truncated_ = false; }
+
+private:
+	static uint64_t le(const uint8_t* p, int n) {
+		uint64_t v = 0;
+		while (n-- > 0) v = v << 8 | p[n];
+		return v;
+	}
+	bool stop() {
+		truncated_ = true;
+		return false;
+	}
+
+	const uint8_t* data_;
+	size_t size_;
+	size_t offset_;
+	bool valid_;
+	bool truncated_;
+};
+
+// Capture_Registers holds a register of every kind for decoding the captured traffic
+{{- if not .Host}}, the
+// variable-length arrays must point to the storage before the records are decoded
+{{- end}}
+struct Capture_Registers {
+{{- range .Registers}}
+	{{.Name}} reg_{{.Name}};
+{{- end}}
 };
+
+// Deserializes the payload of the record into the register of its ID: the write fields of the
+// write record, the read fields otherwise. Returns the payload size, or -1 if the register is
+// unknown, or the payload is malformed or not consumed completely.
+int capture_decode(const Capture_Record& rec, Capture_Registers& regs);
 {{- end}}
+{{- if .HeaderOnly}}{{template "impl" .}}{{end}}
 } // namespace {{.Namespace}}
 `
 
@@ -66,311 +459,2202 @@ const cppTemplate = `
 // This is auto-generated file. DO NOT EDIT. Use pargus compiler to regenerate it. 
 
 #include "{{.HppFileName}}"
+{{- if .Host}}{{template "host_intrinsics" .}}{{else}}
 #include "bigendian.h"
+{{- end}}
  
 namespace {{.Namespace}} {
-{{- range .Registers}}
+{{- template "impl" .}}
+} // namespace {{.Namespace}}
+`
 
-// ================= {{.Name}} implementation =================
-// Send read-only fields to wire (register read fields -> wire)
-int {{.Name}}::serialize_read(uint8_t* buf, size_t size) const {
-	int offset = 0;
-{{- range .Fields}}{{- if .SerializeReadData}}
-	{{range .SerializeReadData}}{{.}}
-	{{end -}}
-{{- end}}{{- end}}
-	return offset;
+// cppImplTemplate contains the registers implementation. It goes to the .cpp file, or to the
+// header with the inline functions in the header-only mode.
+const cppImplTemplate = `
+{{- define "impl"}}
+{{- if .Stats}}
+
+#ifdef PARGUS_STATS
+{{$.Inline}}Register_Stats* stats() {
+	static Register_Stats s[Max_Reg_ID + 1];
+	return s;
 }
 
-// Send write-only fields to wire (register write fields -> wire)
-int {{.Name}}::serialize_write(uint8_t* buf, size_t size) const{
-	int offset = 0;
-{{- range .Fields}}{{- if .SerializeWriteData}}
-	{{range .SerializeWriteData}}{{.}}{{end -}}
-{{- end}}{{- end}}
-	return offset;
+namespace detail {
+
+// Counts the codec call with its result, the number of bytes or -1
+inline int count_codec(Codec_Stats& s, int res) {
+	s.calls++;
+	if (res < 0) {
+		s.failures++;
+	} else {
+		s.bytes += (uint32_t)res;
+	}
+	return res;
 }
 
-// Get read-only fields from wire (wire -> the register read fields)
-int {{.Name}}::deserialize_read(const uint8_t* buf, size_t size) {
-	int offset = 0;
-{{- range .Fields}}{{- if .DeserializeReadData}}
-	{{range .DeserializeReadData}}{{.}}
-	{{end -}}
-{{- end}}{{- end}}
-	return offset;
+} // namespace detail
+
+#define PARGUS_COUNT(codec, res) detail::count_codec(stats()[kRegId].codec, (res))
+#else
+#define PARGUS_COUNT(codec, res) (res)
+#endif
+{{- end}}
+{{- if and .ArrayKernels .Host}}{{template "host_array_kernels" .}}
+{{- else if .ArrayKernels}}
+
+namespace detail {
+
+// Bulk codecs for the arrays of multi-byte elements. The big-endian targets copy the array as
+// is, the little-endian ones swap the whole elements, that compiles to the byte swap
+// instructions where the target has them (ESP32, ARM REV, x86 BSWAP). AVR has no such
+// instructions, so it stays with the element-by-element bigendian codec.
+#if !defined(__AVR__) && defined(__BYTE_ORDER__)
+template <size_t W>
+inline void swap_elements(uint8_t* p, size_t n) {
+	for (size_t i = 0; i < n; i++, p += W) {
+		if (W == 2) {
+			uint16_t v; memcpy(&v, p, 2); v = __builtin_bswap16(v); memcpy(p, &v, 2);
+		} else if (W == 4) {
+			uint32_t v; memcpy(&v, p, 4); v = __builtin_bswap32(v); memcpy(p, &v, 4);
+		} else {
+			uint64_t v; memcpy(&v, p, 8); v = __builtin_bswap64(v); memcpy(p, &v, 8);
+		}
+	}
 }
+#endif
 
-// Get write-only fields from wire (wire -> the register writable fields)
-int {{.Name}}::deserialize_write(const uint8_t* buf, size_t size) {
-	int offset = 0;
-{{- range .Fields}}{{- if .DeserializeWriteData}}
-	{{range .DeserializeWriteData}}{{.}}{{end -}}
-{{- end}}{{- end}}
-	return offset;
+template <typename T>
+inline size_t encode_array(uint8_t* buf, const T* arr, size_t n) {
+#if defined(__AVR__) || !defined(__BYTE_ORDER__)
+	return bigendian::encode_varray(buf, arr, n);
+#else
+	memcpy(buf, arr, sizeof(T)*n);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	swap_elements<sizeof(T)>(buf, n);
+#endif
+	return sizeof(T)*n;
+#endif
+}
+
+template <typename T>
+inline size_t decode_array(T* arr, const uint8_t* buf, size_t n) {
+#if defined(__AVR__) || !defined(__BYTE_ORDER__)
+	return bigendian::decode_varray(arr, buf, n);
+#else
+	memcpy(arr, buf, sizeof(T)*n);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	swap_elements<sizeof(T)>(reinterpret_cast<uint8_t*>(arr), n);
+#endif
+	return sizeof(T)*n;
+#endif
 }
 
+} // namespace detail
 {{- end}}
-} // namespace {{.Namespace}}
-`
+{{- if .Varints}}
 
-//
-// Intermediate representation for template
-//
+namespace detail {
 
-type CppDevice struct {
-	Doc           []string
-	Namespace     string
-	HppFileName   string
-	Registers     []CppRegister
-	MaxRegisterId int
+// Varint codecs: LEB128, 7 bits per byte starting from the least significant ones, the high
+// bit of a byte tells that more bytes follow. The signed values are ZigZag encoded first,
+// so the small negative values stay short as well.
+template <typename T>
+inline size_t varint_size(T v) {
+	size_t n = 1;
+	for (; v >= 0x80; v >>= 7) n++;
+	return n;
 }
 
-type CppRegister struct {
-	Name      string
-	Number    int
-	Doc       []string
-	Constants []CppConstant
-	Fields    []CppField
+template <typename T>
+inline uint8_t put_varint(uint8_t* buf, T v) {
+	uint8_t n = 0;
+	for (; v >= 0x80; v >>= 7) buf[n++] = (uint8_t)v | 0x80;
+	buf[n++] = (uint8_t)v;
+	return n;
 }
 
-type CppConstant struct {
-	Doc   []string
-	Name  string
-	Type  string
-	Value string
+// Returns the number of bytes read, or -1 if the buffer ends before the value or the value
+// doesn't fit T
+template <typename T>
+inline int get_varint(const uint8_t* buf, size_t size, T& v) {
+	const uint8_t bits = sizeof(T) * 8;
+	v = 0;
+	for (uint8_t i = 0, shift = 0; i < size && shift < bits; i++, shift += 7) {
+		uint8_t b = buf[i] & 0x7F;
+		if (bits - shift < 7 && (b >> (bits - shift)) != 0) return -1;
+		v |= (T)b << shift;
+		if (!(buf[i] & 0x80)) return i + 1;
+	}
+	return -1;
 }
 
-type CppField struct {
-	Doc                  []string
-	Name                 string
-	BitMasks             []string
-	Decl                 string
-	IsReadable           bool
-	IsWritable           bool
-	SerializeReadData    []string // Code for serialize_read function
-	SerializeWriteData   []string // Code for serialize_write function
-	DeserializeReadData  []string // Code for deserialize_read function
-	DeserializeWriteData []string // Code for deserialize_write function
-	Trailing             string
-}
+inline uint16_t zigzag(int16_t v) { return ((uint16_t)v << 1) ^ (uint16_t)(v >> 15); }
+inline uint32_t zigzag(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+inline uint64_t zigzag(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+inline int16_t unzigzag(uint16_t v) { return (int16_t)(v >> 1) ^ -(int16_t)(v & 1); }
+inline int32_t unzigzag(uint32_t v) { return (int32_t)(v >> 1) ^ -(int32_t)(v & 1); }
+inline int64_t unzigzag(uint64_t v) { return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
 
-//
-// Public entry
-//
+} // namespace detail
+{{- end}}
+{{- if .BitPacking}}
 
-func GenerateHppCpp(dev *parser.Device, namespace, hppFileName string) (string, string, error) {
-	tplHpp, err := template.New("hpp").Parse(hppTemplate)
-	if err != nil {
-		return "", "", err
+namespace detail {
+
+// Bit codecs of the packed registers. The fields are stored most significant bit first, pos
+// counts the bits from the most significant bit of buf[0]. put_bits expects the bits to be
+// zeroed and writes the n lowest bits of v.
+inline void put_bits(uint8_t* buf, size_t pos, uint8_t n, uint32_t v) {
+	buf += pos >> 3;
+	uint8_t room = 8 - (pos & 7);
+	while (n > 0) {
+		uint8_t k = n < room ? n : room;
+		n -= k;
+		*buf++ |= (uint8_t)(((v >> n) & ((1u << k) - 1)) << (room - k));
+		room = 8;
 	}
-	tplCpp, err := template.New("cpp").Parse(cppTemplate)
-	if err != nil {
-		return "", "", err
+}
+
+inline uint32_t get_bits(const uint8_t* buf, size_t pos, uint8_t n) {
+	buf += pos >> 3;
+	uint8_t room = 8 - (pos & 7);
+	uint32_t v = 0;
+	while (n > 0) {
+		uint8_t k = n < room ? n : room;
+		n -= k;
+		v = (v << k) | ((*buf++ >> (room - k)) & ((1u << k) - 1));
+		room = 8;
 	}
+	return v;
+}
 
-	out := CppDevice{Namespace: namespace, HppFileName: hppFileName}
-	out.Doc = flattenComments(dev.Doc)
-	for _, reg := range dev.Registers {
-		num, _ := strconv.ParseInt(reg.NumberStr, 0, 64)
-		out.MaxRegisterId = max(out.MaxRegisterId, int(num))
-		cr := CppRegister{
-			Name:   reg.Name,
-			Number: int(num),
-			Doc:    flattenComments(reg.Doc),
-		}
+// Restores the sign of the n bits two's complement value
+inline int32_t sign_extend(uint32_t v, uint8_t n) {
+	uint32_t m = (uint32_t)1 << (n - 1);
+	return (int32_t)((v ^ m) - m);
+}
 
-		// Process constants
-		for _, c := range reg.Body.Constants() {
-			cc := CppConstant{
-				Doc:   flattenComments(c.Doc),
-				Name:  c.Name,
-				Type:  toCppTypes(c.Type.Name),
-				Value: c.ValueStr,
-			}
-			cr.Constants = append(cr.Constants, cc)
+} // namespace detail
+{{- end}}
+{{- if .Streams}}
+
+namespace detail {
+
+// Chunk codecs of the stream registers. A value which doesn't fit the rest of the chunk is
+// kept in the scratch buffer of the stream state until the next chunk.
+
+// Copies the rest of the value in the scratch buffer to the chunk, returns false if the
+// chunk is full before the value is copied completely
+inline bool stream_flush(Stream_State& st, uint8_t* buf, size_t size, size_t& offset) {
+	while (st.pos < st.len && offset < size) buf[offset++] = st.scratch[st.pos++];
+	return st.pos == st.len;
+}
+
+// Returns the next n bytes value: in place if the chunk holds it, or collected in the scratch
+// buffer over the chunks. Returns nullptr if the chunk ends before the value.
+inline const uint8_t* stream_take(Stream_State& st, const uint8_t* buf, size_t size, size_t& offset, uint8_t n) {
+	if (st.pos == 0 && size - offset >= n) {
+		offset += n;
+		return buf + offset - n;
+	}
+	while (st.pos < n && offset < size) st.scratch[st.pos++] = buf[offset++];
+	if (st.pos < n) return nullptr;
+	st.pos = 0;
+	return st.scratch;
+}
+
+// Collects the next varint in the scratch buffer, st.len is its size then. Returns nullptr if
+// the chunk ends before the varint or the varint is longer than the scratch buffer.
+inline const uint8_t* stream_take_varint(Stream_State& st, const uint8_t* buf, size_t size, size_t& offset) {
+	while (offset < size && st.pos < sizeof(st.scratch)) {
+		uint8_t b = buf[offset++];
+		st.scratch[st.pos++] = b;
+		if (!(b & 0x80)) {
+			st.len = st.pos;
+			st.pos = 0;
+			return st.scratch;
 		}
+	}
+	return nullptr;
+}
 
-		for _, f := range reg.Body.Fields() {
-			cf := CppField{
-				Doc:        flattenComments(f.Doc),
-				Name:       f.Name,
-				Trailing:   safeString(f.TrailingComment),
-				IsReadable: f.Specifier == "r" || f.Specifier == "",
-				IsWritable: f.Specifier == "w" || f.Specifier == "",
-			}
+} // namespace detail
+{{- end}}
+{{- if .Tables}}
 
-			switch {
-			case f.Type.Simple != nil && f.Type.Simple.IsRegisterRef():
-				refRegName := f.Type.Simple.Name
-				cf.Decl = fmt.Sprintf("%s %s;", refRegName, f.Name)
+namespace detail {
 
-				// For RegisterRef, populate the appropriate contexts
-				if cf.IsReadable {
-					cf.SerializeReadData = append(cf.SerializeReadData,
-						fmt.Sprintf("{auto res = this->%s.serialize_read(buf + offset, size - offset); if (res < 0) return res; offset += res;}", f.Name))
-					cf.DeserializeReadData = append(cf.DeserializeReadData,
-						fmt.Sprintf("{auto res = this->%s.deserialize_read(buf + offset, size - offset); if (res < 0) return res; offset += res;}", f.Name))
-				}
-				if cf.IsWritable {
-					cf.SerializeWriteData = append(cf.SerializeWriteData,
-						fmt.Sprintf("{auto res = this->%s.serialize_write(buf + offset, size - offset); if (res < 0) return res; offset += res;}", f.Name))
-					cf.DeserializeWriteData = append(cf.DeserializeWriteData,
-						fmt.Sprintf("{auto res = this->%s.deserialize_write(buf + offset, size - offset); if (res < 0) return res; offset += res;}", f.Name))
-				}
+// Table-driven codecs. The table registers are described by the tables of their fields
+// descriptors, kept in the flash memory on AVR, and coded by the shared interpreter below
+// instead of the generated code of every field.
+enum Field_Kind : uint8_t {
+	kScalar,       // integer, float or bit field
+	kArray,        // fixed-size array
+	kVarArray,     // variable-length array, the register keeps the pointer to the elements
+	kView,         // variable-length byte array, the register keeps the view of the wire buffer
+	kBoundedArray, // variable-length array stored in the register
+	kVarint,       // unsigned varint
+	kZigzag,       // signed varint
+};
 
-			case f.Type.Bitfield != nil:
-				base := toCppTypes(f.Type.Bitfield.Base)
-				cf.Decl = fmt.Sprintf("%s %s;", base, f.Name)
-				for _, bm := range f.Type.Bitfield.Bits {
-					// Add bit member comments
-					bmComments := flattenComments(bm.Doc)
-					for _, comment := range bmComments {
-						cf.BitMasks = append(cf.BitMasks, comment)
-					}
+// The count fields describe the number of elements: the constant of the fixed-size arrays, or
+// the size field of the variable-length ones
+struct Field_Desc {
+	uint16_t offset;     // the field offset in the register
+	uint8_t kind;        // Field_Kind
+	uint8_t width;       // the size of the value or of the array element
+	uint16_t count;      // the number of elements, or the size field offset
+	uint8_t count_width; // the size field size
+	uint8_t count_shift; // the first bit of the size bit member
+	uint8_t count_bits;  // the size bit member width, 0 for the whole size field
+	uint16_t capacity;   // kBoundedArray: the maximal number of elements
+};
 
-					start, _ := strconv.Atoi(bm.Start)
-					end := start
-					if bm.End != nil {
-						end, _ = strconv.Atoi(*bm.End)
-					}
-					mask := bitMask(start, end)
+// Copies the value between the host and the big-endian wire byte order
+inline void table_copy(uint8_t* dst, const uint8_t* src, uint8_t width) {
+	const uint16_t one = 1;
+	if (*reinterpret_cast<const uint8_t*>(&one) == 0) {
+		memcpy(dst, src, width);
+		return;
+	}
+	for (uint8_t i = 0; i < width; i++) dst[i] = src[width - 1 - i];
+}
 
-					// Add bit mask constant with range info in comment
-					bitRange := bm.Start
-					if bm.End != nil && *bm.End != bm.Start {
-						bitRange = fmt.Sprintf("%s-%s", bm.Start, *bm.End)
-					}
-					cf.BitMasks = append(cf.BitMasks,
-						fmt.Sprintf("// %s bit field (bits %s)", bm.Name, bitRange))
-					cf.BitMasks = append(cf.BitMasks,
-						fmt.Sprintf("static constexpr %s %s_%s_bm = 0x%X;",
-							base, f.Name, bm.Name, mask))
-				}
-				serCode := []string{
-					fmt.Sprintf("if (offset + sizeof(this->%s) > size) return -1;", f.Name),
-					fmt.Sprintf("offset += bigendian::encode(buf + offset, this->%s);", f.Name),
-				}
-				deserCode := []string{
-					fmt.Sprintf("if (offset + sizeof(this->%s) > size) return -1;", f.Name),
-					fmt.Sprintf("offset += bigendian::decode(this->%s, buf + offset);", f.Name),
-				}
-				if cf.IsReadable {
-					cf.SerializeReadData = append(cf.SerializeReadData, serCode...)
-					cf.DeserializeReadData = append(cf.DeserializeReadData, deserCode...)
-				}
-				if cf.IsWritable {
-					cf.SerializeWriteData = append(cf.SerializeWriteData, serCode...)
-					cf.DeserializeWriteData = append(cf.DeserializeWriteData, deserCode...)
-				}
-			case f.Type.Array != nil:
-				elem := toCppTypes(f.Type.Array.Type.Name)
-				if f.Type.Array.Size.Constant != nil {
-					sz := *f.Type.Array.Size.Constant
-					cf.Decl = fmt.Sprintf("%s %s[%s];", elem, f.Name, sz)
-					serCode := []string{
-						fmt.Sprintf("if (offset + sizeof(this->%s) > size) return -1;", f.Name),
-						fmt.Sprintf("offset += bigendian::encode(buf + offset, this->%s);", f.Name),
+// Returns the number of elements of the variable-length array
+inline size_t table_count(const uint8_t* reg, const Field_Desc& d) {
+	uint32_t v;
+	switch (d.count_width) {
+	case 1: v = reg[d.count]; break;
+	case 2: { uint16_t x; memcpy(&x, reg + d.count, 2); v = x; break; }
+	case 4: memcpy(&v, reg + d.count, 4); break;
+	default: { uint64_t x; memcpy(&x, reg + d.count, 8); v = (uint32_t)x; break; }
+	}
+	if (d.count_bits) v = (v >> d.count_shift) & ((1ul << d.count_bits) - 1);
+	return v;
+}
+{{- if .Varints}}
+
+// Returns the number of bytes written, or -1 if the buffer is too small
+inline int table_put_varint(uint8_t* buf, size_t size, const uint8_t* p, const Field_Desc& d) {
+	uint8_t tmp[10];
+	uint8_t n;
+	if (d.width == 2) {
+		uint16_t v; memcpy(&v, p, 2);
+		n = put_varint(tmp, d.kind == kZigzag ? zigzag((int16_t)v) : v);
+	} else if (d.width == 4) {
+		uint32_t v; memcpy(&v, p, 4);
+		n = put_varint(tmp, d.kind == kZigzag ? zigzag((int32_t)v) : v);
+	} else {
+		uint64_t v; memcpy(&v, p, 8);
+		n = put_varint(tmp, d.kind == kZigzag ? zigzag((int64_t)v) : v);
+	}
+	if (size < n) return -1;
+	memcpy(buf, tmp, n);
+	return n;
+}
+
+// Returns the number of bytes read, or -1 as get_varint does
+inline int table_get_varint(const uint8_t* buf, size_t size, uint8_t* p, const Field_Desc& d) {
+	int res;
+	if (d.width == 2) {
+		uint16_t v; res = get_varint(buf, size, v);
+		if (d.kind == kZigzag) v = (uint16_t)unzigzag(v);
+		memcpy(p, &v, 2);
+	} else if (d.width == 4) {
+		uint32_t v; res = get_varint(buf, size, v);
+		if (d.kind == kZigzag) v = (uint32_t)unzigzag(v);
+		memcpy(p, &v, 4);
+	} else {
+		uint64_t v; res = get_varint(buf, size, v);
+		if (d.kind == kZigzag) v = (uint64_t)unzigzag(v);
+		memcpy(p, &v, 8);
+	}
+	return res;
+}
+{{- end}}
+
+// Serializes the n fields of the table, returns the number of bytes written or -1 if the
+// buffer is too small
+{{$.Inline}}int table_serialize(const Field_Desc* table, uint8_t n, const void* reg, uint8_t* buf, size_t size) {
+	const uint8_t* base = static_cast<const uint8_t*>(reg);
+	size_t offset = 0;
+	for (uint8_t i = 0; i < n; i++) {
+		Field_Desc d;
+		memcpy_P(&d, &table[i], sizeof(d));
+		const uint8_t* p = base + d.offset;
+		size_t elems = 1;
+		switch (d.kind) {
+		case kArray:
+			elems = d.count;
+			break;
+		case kVarArray:
+		case kView:
+			elems = table_count(base, d);
+			memcpy(&p, p, sizeof(p));
+			break;
+		case kBoundedArray:
+			elems = table_count(base, d);
+			if (elems > d.capacity) return -1;
+			break;
+{{- if .Varints}}
+		case kVarint:
+		case kZigzag: {
+			int res = table_put_varint(buf + offset, size - offset, p, d);
+			if (res < 0) return -1;
+			offset += res;
+			continue;
+		}
+{{- end}}
+		}
+		if (size - offset < elems * d.width) return -1;
+		if (d.width == 1) {
+			memcpy(buf + offset, p, elems);
+			offset += elems;
+			continue;
+		}
+		for (; elems > 0; elems--, p += d.width, offset += d.width) table_copy(buf + offset, p, d.width);
+	}
+	return (int)offset;
+}
+
+// Deserializes the n fields of the table, returns the number of bytes read or -1 if the
+// buffer is too small or a value is invalid
+{{$.Inline}}int table_deserialize(const Field_Desc* table, uint8_t n, void* reg, const uint8_t* buf, size_t size) {
+	uint8_t* base = static_cast<uint8_t*>(reg);
+	size_t offset = 0;
+	for (uint8_t i = 0; i < n; i++) {
+		Field_Desc d;
+		memcpy_P(&d, &table[i], sizeof(d));
+		uint8_t* p = base + d.offset;
+		size_t elems = 1;
+		switch (d.kind) {
+		case kArray:
+			elems = d.count;
+			break;
+		case kVarArray:
+			elems = table_count(base, d);
+			memcpy(&p, p, sizeof(p));
+			break;
+		case kBoundedArray:
+			elems = table_count(base, d);
+			if (elems > d.capacity) return -1;
+			break;
+		case kView: {
+			elems = table_count(base, d);
+			if (size - offset < elems) return -1;
+			const uint8_t* view = buf + offset;
+			memcpy(p, &view, sizeof(view));
+			offset += elems;
+			continue;
+		}
+{{- if .Varints}}
+		case kVarint:
+		case kZigzag: {
+			int res = table_get_varint(buf + offset, size - offset, p, d);
+			if (res < 0) return -1;
+			offset += res;
+			continue;
+		}
+{{- end}}
+		}
+		if (size - offset < elems * d.width) return -1;
+		if (d.width == 1) {
+			memcpy(p, buf + offset, elems);
+			offset += elems;
+			continue;
+		}
+		for (; elems > 0; elems--, p += d.width, offset += d.width) table_copy(p, buf + offset, d.width);
+	}
+	return (int)offset;
+}
+
+} // namespace detail
+{{- end}}
+{{- if .Crc}}
+
+namespace detail {
+
+// {{.Crc.Title}}: the bitwise loop on AVR, where a {{.Crc.TableSize}} bytes table doesn't pay off, and
+// the slicing-by-4 tables on the other targets
+typedef {{.Crc.Type}} crc_t;
+static constexpr crc_t kCrcInit = {{.Crc.Init}};
+static constexpr crc_t kCrcXorOut = {{.Crc.XorOut}};
+
+// Continues the checksum crc with n bytes, without the final xor
+{{$.Inline}}crc_t crc_update(crc_t crc, const uint8_t* p, size_t n) {
+#if defined(__AVR__)
+	while (n--) {
+{{- range .Crc.BitStep}}
+		{{.}}
+{{- end}}
+	}
+#else
+	static const crc_t table[4][256] = {
+{{- range .Crc.Table}}
+		{{.}}
+{{- end}}
+	};
+	for (; n >= 4; n -= 4, p += 4) {
+{{- range .Crc.SliceStep}}
+		{{.}}
+{{- end}}
+	}
+	while (n--) {{.Crc.ByteStep}}
+#endif
+	return crc;
+}
+
+} // namespace detail
+{{- end}}
+{{- range .Registers}}
+
+// ================= {{.Name}} implementation =================
+{{- if .Table}}
+
+namespace detail {
+{{- if .Table.Read}}
+
+{{$.Inline}}const Field_Desc* {{.Name}}_read_fields() {
+	static_assert(sizeof({{.Name}}) <= 0xFFFF, "the table register is too big");
+	static const Field_Desc fields[] PROGMEM = {
+{{- range .Table.Read}}
+		{{.}}
+{{- end}}
+	};
+	return fields;
+}
+{{- end}}
+{{- if .Table.Write}}
+
+{{$.Inline}}const Field_Desc* {{.Name}}_write_fields() {
+	static_assert(sizeof({{.Name}}) <= 0xFFFF, "the table register is too big");
+	static const Field_Desc fields[] PROGMEM = {
+{{- range .Table.Write}}
+		{{.}}
+{{- end}}
+	};
+	return fields;
+}
+{{- end}}
+
+} // namespace detail
+{{end}}
+{{- if .ReadSize}}
+// Returns the wire size of the read fields
+{{$.Inline}}size_t {{.Name}}::read_size() const {
+{{- range .ReadSize}}
+	{{.}}
+{{- end}}
+}
+{{end}}
+{{- if .WriteSize}}
+// Returns the wire size of the write fields
+{{$.Inline}}size_t {{.Name}}::write_size() const {
+{{- range .WriteSize}}
+	{{.}}
+{{- end}}
+}
+{{end}}
+// Send read-only fields to wire (register read fields -> wire)
+{{$.Inline}}int {{.Name}}::serialize_read(uint8_t* buf, size_t size) const {
+{{- range .SerializeRead}}
+	{{.}}
+{{- end}}
+}
+
+// Send write-only fields to wire (register write fields -> wire)
+{{$.Inline}}int {{.Name}}::serialize_write(uint8_t* buf, size_t size) const {
+{{- range .SerializeWrite}}
+	{{.}}
+{{- end}}
+}
+
+// Get read-only fields from wire (wire -> the register read fields)
+{{$.Inline}}int {{.Name}}::deserialize_read(const uint8_t* buf, size_t size) {
+{{- range .DeserializeRead}}
+	{{.}}
+{{- end}}
+}
+
+// Get write-only fields from wire (wire -> the register writable fields)
+{{$.Inline}}int {{.Name}}::deserialize_write(const uint8_t* buf, size_t size) {
+{{- range .DeserializeWrite}}
+	{{.}}
+{{- end}}
+}
+{{- if .Crc}}
+
+// serialize_read followed by the checksum
+{{$.Inline}}int {{.Name}}::serialize_read_crc(uint8_t* buf, size_t size) const {
+{{- range .Crc.SerializeRead}}
+	{{.}}
+{{- end}}
+}
+
+// serialize_write followed by the checksum
+{{$.Inline}}int {{.Name}}::serialize_write_crc(uint8_t* buf, size_t size) const {
+{{- range .Crc.SerializeWrite}}
+	{{.}}
+{{- end}}
+}
+
+// deserialize_read checking the checksum
+{{$.Inline}}int {{.Name}}::deserialize_read_crc(const uint8_t* buf, size_t size) {
+{{- range .Crc.DeserializeRead}}
+	{{.}}
+{{- end}}
+}
+
+// deserialize_write checking the checksum
+{{$.Inline}}int {{.Name}}::deserialize_write_crc(const uint8_t* buf, size_t size) {
+{{- range .Crc.DeserializeWrite}}
+	{{.}}
+{{- end}}
+}
+{{- end}}
+{{- $reg := .Name}}
+{{- range .Accessors}}
+
+{{$.Inline}}{{.Type}} {{$reg}}::peek_{{.Name}}(const uint8_t* buf) {
+	{{.Type}} v;
+	bigendian::decode(v, buf + {{.Offset}});
+	return v;
+}
+
+{{$.Inline}}void {{$reg}}::poke_{{.Name}}(uint8_t* buf, {{.Type}} v) {
+	bigendian::encode(buf + {{.Offset}}, v);
+}
+{{- end}}
+{{- if .Delta}}
+
+// Send the dirty write fields to wire (the presence mask followed by the dirty fields)
+{{$.Inline}}int {{.Name}}::serialize_write_delta(uint8_t* buf, size_t size) const {
+	int offset = 0;
+{{- range .Delta.Serialize}}
+	{{.}}
+{{- end}}
+	return offset;
+}
+
+// Get the sent write fields from wire, the received presence mask becomes the dirty mask
+{{$.Inline}}int {{.Name}}::deserialize_write_delta(const uint8_t* buf, size_t size) {
+	int offset = 0;
+{{- range .Delta.Deserialize}}
+	{{.}}
+{{- end}}
+	return offset;
+}
+{{- end}}
+{{- if .Stream}}
+
+{{$.Inline}}int {{.Name}}::serialize_read_chunk(Stream_State& st, uint8_t* buf, size_t size) const {
+{{- range .Stream.SerializeRead}}
+	{{.}}
+{{- end}}
+}
+
+{{$.Inline}}int {{.Name}}::serialize_write_chunk(Stream_State& st, uint8_t* buf, size_t size) const {
+{{- range .Stream.SerializeWrite}}
+	{{.}}
+{{- end}}
+}
+
+{{$.Inline}}int {{.Name}}::deserialize_read_chunk(Stream_State& st, const uint8_t* buf, size_t size) {
+{{- range .Stream.DeserializeRead}}
+	{{.}}
+{{- end}}
+}
+
+{{$.Inline}}int {{.Name}}::deserialize_write_chunk(Stream_State& st, const uint8_t* buf, size_t size) {
+{{- range .Stream.DeserializeWrite}}
+	{{.}}
+{{- end}}
+}
+{{- end}}
+
+{{- end}}
+{{- if .Dispatch}}
+
+// ================= Request dispatching =================
+namespace detail {
+
+typedef int (*Read_Thunk)(Handler& handler, uint8_t* buf, size_t size);
+typedef int (*Write_Thunk)(Handler& handler, const uint8_t* buf, size_t size);
+{{- range .Registers}}
+{{- if .Readable}}
+
+{{$.Inline}}int read_{{.Name}}(Handler& handler, uint8_t* buf, size_t size) {
+	{{.Name}} reg = {};
+	if (!handler.on_read_{{.Name}}(reg)) return -1;
+	return reg.serialize_read(buf, size);
+}
+{{- end}}
+{{- if .Writable}}
+
+{{$.Inline}}int write_{{.Name}}(Handler& handler, const uint8_t* buf, size_t size) {
+	{{.Name}} reg = {};
+{{- if .PrepareWrite}}
+	if (!handler.prepare_write_{{.Name}}(reg)) return -1;
+{{- end}}
+	int res = reg.deserialize_write(buf, size);
+	if (res < 0 || !handler.on_write_{{.Name}}(reg)) return -1;
+	return res;
+}
+{{- end}}
+{{- end}}
+
+} // namespace detail
+
+{{$.Inline}}int dispatch_read(uint8_t id, Handler& handler, uint8_t* buf, size_t size) {
+	// indexed by the register ID, kept in the flash memory on AVR
+	static const detail::Read_Thunk table[Max_Reg_ID + 1] PROGMEM = {
+{{- range .ReadTable}}
+		{{.}},
+{{- end}}
+	};
+	if (id > Max_Reg_ID) return -1;
+	detail::Read_Thunk thunk = reinterpret_cast<detail::Read_Thunk>(pgm_read_ptr(&table[id]));
+	if (thunk == nullptr) return -1;
+	return thunk(handler, buf, size);
+}
+
+{{$.Inline}}int dispatch_write(uint8_t id, Handler& handler, const uint8_t* buf, size_t size) {
+	// indexed by the register ID, kept in the flash memory on AVR
+	static const detail::Write_Thunk table[Max_Reg_ID + 1] PROGMEM = {
+{{- range .WriteTable}}
+		{{.}},
+{{- end}}
+	};
+	if (id > Max_Reg_ID) return -1;
+	detail::Write_Thunk thunk = reinterpret_cast<detail::Write_Thunk>(pgm_read_ptr(&table[id]));
+	if (thunk == nullptr) return -1;
+	return thunk(handler, buf, size);
+}
+{{- end}}
+{{- if .Batch}}
+
+// ================= Batch frames =================
+{{$.Inline}}int dispatch_read_batch(Handler& handler, const uint8_t* req, size_t req_size, uint8_t* buf, size_t size) {
+	if (req_size < 1 || req_size - 1 < req[0] || size < 1) return -1;
+	size_t offset = 1;
+	for (uint8_t i = 0; i < req[0]; i++) {
+		if (size - offset < kBatchEntryHeaderSize) return -1;
+		size_t room = size - offset - kBatchEntryHeaderSize;
+		if (room > kBatchEntrySizeMax) room = kBatchEntrySizeMax;
+		int res = dispatch_read(req[1 + i], handler, buf + offset + kBatchEntryHeaderSize, room);
+		if (res < 0) return -1;
+		buf[offset] = req[1 + i];
+		buf[offset + 1] = (uint8_t)(res >> 8);
+		buf[offset + 2] = (uint8_t)res;
+		offset += kBatchEntryHeaderSize + res;
+	}
+	buf[0] = req[0];
+	return (int)offset;
+}
+
+{{$.Inline}}int dispatch_write_batch(Handler& handler, const uint8_t* buf, size_t size) {
+	if (size < 1) return -1;
+	size_t offset = 1;
+	for (uint8_t i = 0; i < buf[0]; i++) {
+		if (size - offset < kBatchEntryHeaderSize) return -1;
+		size_t len = ((size_t)buf[offset + 1] << 8) | buf[offset + 2];
+		if (size - offset - kBatchEntryHeaderSize < len) return -1;
+		int res = dispatch_write(buf[offset], handler, buf + offset + kBatchEntryHeaderSize, len);
+		if (res < 0 || (size_t)res != len) return -1;
+		offset += kBatchEntryHeaderSize + len;
+	}
+	return (int)offset;
+}
+{{- end}}
+{{- if .Capture}}
+
+// ================= Capture decoding =================
+{{$.Inline}}int capture_decode(const Capture_Record& rec, Capture_Registers& regs) {
+	int res = -1;
+	switch (rec.id) {
+{{- range .Registers}}
+	case Reg_{{.Name}}_ID:
+		res = rec.write ? regs.reg_{{.Name}}.deserialize_write(rec.payload, rec.size) : regs.reg_{{.Name}}.deserialize_read(rec.payload, rec.size);
+		break;
+{{- end}}
+	}
+	return res >= 0 && (size_t)res == rec.size ? res : -1;
+}
+{{- end}}
+
+// ================= Handshake =================
+{{$.Inline}}int serialize_handshake(uint8_t* buf, size_t size) {
+	// kept in the flash memory on AVR
+	static const uint8_t handshake[Handshake_Size] PROGMEM = {
+{{- range .Handshake}}
+		{{.}}
+{{- end}}
+	};
+	if (size < Handshake_Size) return -1;
+	memcpy_P(buf, handshake, Handshake_Size);
+	return (int)Handshake_Size;
+}
+{{- end}}`
+
+//
+// Intermediate representation for template
+//
+
+type CppDevice struct {
+	Doc           []string
+	Namespace     string
+	HppFileName   string
+	Registers     []CppRegister
+	MaxRegisterId int
+	MaxWireSize   string
+	LayoutHash    string // the hash of the wire layout of all registers
+	HandshakeSize int
+	Handshake     []string // the rows of the handshake bytes
+	HeaderOnly    bool
+	Host          bool    // the host target: no Arduino headers, the vector kernels of the arrays
+	Inline        string  // "inline " prefix of the functions definitions in the header-only mode
+	ArrayKernels  bool    // the bulk codecs for the arrays of multi-byte elements are used
+	BitPacking    bool    // the bit codecs of the packed registers are used
+	Varints       bool    // the varint codecs are used
+	Streams       bool    // the chunked codecs of the stream registers are used
+	Tables        bool    // the interpreter of the table-driven registers is used
+	Crc           *CppCrc // the checksum of the _crc codecs, nil without the crc option
+	Stats         bool    // the regular codecs are instrumented with PARGUS_COUNT
+	Dispatch      bool
+	Batch         bool
+	Capture       bool     // the capture records reader and decoder are generated
+	ReadTable     []string // read thunks indexed by the register ID
+	WriteTable    []string // write thunks indexed by the register ID
+}
+
+type CppRegister struct {
+	Name             string
+	Number           int
+	Readable         bool // the register may be read (not write-only)
+	Writable         bool // the register may be written (not read-only)
+	PrepareWrite     bool // the write fields need the storage for the variable-length arrays
+	Doc              []string
+	Constants        []CppConstant
+	Fields           []CppField
+	SerializeRead    []string   // Body of serialize_read function
+	SerializeWrite   []string   // Body of serialize_write function
+	DeserializeRead  []string   // Body of deserialize_read function
+	DeserializeWrite []string   // Body of deserialize_write function
+	ReadWireSize     int        // Static wire size of the read fields, -1 if it is known at run-time only
+	WriteWireSize    int        // Static wire size of the write fields, -1 if it is known at run-time only
+	ReadWireSizeMax  string     // The maximal wire size of the read fields
+	WriteWireSizeMax string     // The maximal wire size of the write fields
+	ReadSize         []string   // Body of read_size function, empty for the static wire size
+	WriteSize        []string   // Body of write_size function, empty for the static wire size
+	Delta            *CppDelta  // Delta writes, nil if the register is not delta encoded
+	Stream           *CppStream // Chunked codecs, nil if the register is not a stream register
+	Table            *CppTable  // Fields descriptors, nil if the register codecs are generated code
+	SizeReport       string     // The struct size with the sorted members, empty in the declaration order
+	LayoutHash       string     // The hash of the register wire layout
+	WireOffsets      []CppConstant
+	Accessors        []CppAccessor
+	Crc              *CppCrcCodecs // Bodies of the _crc codecs, nil without the crc option
+	Validators       []string      // constexpr validation functions of the constrained fields
+	Allocator        []string      // the host members initialized with the memory resource
+}
+
+// CppCrcCodecs is the bodies of the codecs followed by the checksum
+type CppCrcCodecs struct {
+	SerializeRead    []string
+	SerializeWrite   []string
+	DeserializeRead  []string
+	DeserializeWrite []string
+}
+
+// CppCrc is the checksum kernel of the _crc codecs
+type CppCrc struct {
+	Title     string
+	Type      string
+	Size      int
+	Init      string
+	XorOut    string
+	Poly      string
+	Table     []string // the slicing-by-4 tables rows
+	TableSize int      // the tables size in bytes
+	BitStep   []string // the table-free update by one byte, *p is the byte
+	ByteStep  string   // the table update by one byte
+	SliceStep []string // the table update by four bytes p[0..3]
+}
+
+// CppAccessor reads and patches the scalar field in place in the wire buffer
+type CppAccessor struct {
+	Name   string // the accessor suffix: the field name, prefixed by the direction if needed
+	Type   string
+	Offset string // the wire offset constant
+}
+
+// CppTable is the initializers of the fields descriptors of the table-driven register
+type CppTable struct {
+	Read        []string
+	Write       []string
+	ReadChecks  []string // validation of the constrained fields after the interpreter decoded them
+	WriteChecks []string
+}
+
+// CppStream is the bodies of the chunked codecs of the stream register
+type CppStream struct {
+	SerializeRead    []string
+	SerializeWrite   []string
+	DeserializeRead  []string
+	DeserializeWrite []string
+}
+
+// CppDelta describes the delta writes of the register
+type CppDelta struct {
+	MaskSize    int
+	WireSizeMax string
+	Fields      []CppDirtyField
+	Serialize   []string // Body of serialize_write_delta function
+	Deserialize []string // Body of deserialize_write_delta function
+}
+
+// CppDirtyField is the index of the write field in the dirty mask
+type CppDirtyField struct {
+	Name  string
+	Index int
+}
+
+type CppConstant struct {
+	Doc   []string
+	Name  string
+	Type  string
+	Value string
+}
+
+type CppField struct {
+	Doc                  []string
+	Name                 string
+	BitMasks             []string
+	Decl                 string
+	IsReadable           bool
+	IsWritable           bool
+	SerializeReadData    *CppCodec // Code for serialize_read function
+	SerializeWriteData   *CppCodec // Code for serialize_write function
+	DeserializeReadData  *CppCodec // Code for deserialize_read function
+	DeserializeWriteData *CppCodec // Code for deserialize_write function
+	Trailing             string
+	align                int // the member alignment on the 32-bit targets
+}
+
+// CppCodec is the code which encodes or decodes one field. The bounds checks are not
+// part of the code, they are emitted by coalesceBoundsChecks for whole runs of fields.
+type CppCodec struct {
+	Prologue   []string // code preceding the bounds check, e.g. calculation of the array size
+	SizeExpr   string   // run-time wire size expression, empty if the field doesn't need the check
+	StaticSize int      // compile-time wire size, or -1 if the size is known at run-time only
+	WireSize   string   // self-contained run-time wire size expression, for the dynamic size only
+	Code       []string
+	Epilogue   []string
+}
+
+// CppOptions controls the C++ code generation
+type CppOptions struct {
+	// HeaderOnly puts all the definitions into the header as inline functions, so the compiler
+	// may flatten the nested registers without LTO. No .cpp file is generated then.
+	HeaderOnly bool
+	// Views turns the variable-length byte arrays into views of the wire buffer: deserialization
+	// points the field to the data in the buffer instead of copying it. The field stays valid
+	// while the buffer is alive.
+	Views bool
+	// Dispatch generates the Handler interface and the dispatch_read/dispatch_write functions
+	// which serve the requests by the register ID using the tables of the register codecs.
+	Dispatch bool
+	// Batch generates the batch frames codec, which carries several registers in one request or
+	// response, and the dispatch_read_batch/dispatch_write_batch functions. Batch implies Dispatch.
+	Batch bool
+	// SortFields declares the struct members sorted by the alignment, the biggest first, which
+	// removes the padding between them on the 32-bit targets. The wire order doesn't change,
+	// but the aggregate initialization of the structs follows the member order.
+	SortFields bool
+	// Stats instruments the regular codecs of the registers: built with PARGUS_STATS defined,
+	// they count their calls, failures and bytes in stats(), indexed by the register ID.
+	// Without the macro the generated code is the same as without the option.
+	Stats bool
+	// Host generates the code for the host C++ target (cpp-host) instead of Arduino: the header
+	// doesn't include Arduino.h and carries the big-endian codecs itself, and the arrays of the
+	// multi-byte elements are coded by the SSSE3/AVX2/NEON byte swap kernels.
+	Host bool
+	// Crc adds the _crc codecs, which append the checksum to the wire data and check it on
+	// deserialization: "crc8", "crc16" or "crc32", empty for none. The checksum is updated
+	// while the fields are encoded or decoded, instead of the second pass over the frame.
+	Crc string
+	// Capture generates Capture_Reader, which walks the records of the capture files of the
+	// register traffic (see the capture package) in place, e.g. in the mapped file, and
+	// capture_decode, which deserializes the record payload into the register of its ID.
+	Capture bool
+}
+
+// CppStructSize is the size of the register struct on the 32-bit targets with the members in
+// the declaration order and sorted by the alignment (see CppOptions.SortFields)
+type CppStructSize struct {
+	Register string
+	Declared int
+	Sorted   int
+}
+
+// CppStructSizes returns the sizes of the register structs on the 32-bit targets
+func CppStructSizes(dev *parser.Device) []CppStructSize {
+	var sizes []CppStructSize
+	for _, reg := range dev.Registers {
+		sizes = append(sizes, CppStructSize{
+			Register: reg.Name,
+			Declared: cppRegisterLayout(dev, reg, false).size,
+			Sorted:   cppRegisterLayout(dev, reg, true).size,
+		})
+	}
+	return sizes
+}
+
+//
+// Public entry
+//
+
+// The templates are parsed once, they may be executed concurrently
+var (
+	tplHpp = template.Must(template.Must(template.Must(template.New("hpp").Parse(hppTemplate)).Parse(cppImplTemplate)).Parse(cppHostTemplate))
+	tplCpp = template.Must(template.Must(template.Must(template.New("cpp").Parse(cppTemplate)).Parse(cppImplTemplate)).Parse(cppHostTemplate))
+)
+
+func GenerateHppCpp(dev *parser.Device, namespace, hppFileName string) (string, string, error) {
+	return GenerateHppCppWithOptions(dev, namespace, hppFileName, CppOptions{})
+}
+
+// GenerateHppCppWithOptions generates the header and the .cpp file contents. The .cpp is empty
+// in the header-only mode.
+func GenerateHppCppWithOptions(dev *parser.Device, namespace, hppFileName string, opts CppOptions) (string, string, error) {
+	out, err := cppDevice(dev, namespace, hppFileName, opts)
+	if err != nil {
+		return "", "", err
+	}
+
+	var hpp, cpp bytes.Buffer
+	if err := tplHpp.Execute(&hpp, *out); err != nil {
+		return "", "", err
+	}
+	if opts.HeaderOnly {
+		return strings.TrimSpace(hpp.String()) + "\n", "", nil
+	}
+	if err := tplCpp.Execute(&cpp, *out); err != nil {
+		return "", "", err
+	}
+	return strings.TrimSpace(hpp.String()) + "\n", strings.TrimSpace(cpp.String()), nil
+}
+
+// cppDevice builds the intermediate representation of the device for the templates
+func cppDevice(dev *parser.Device, namespace, hppFileName string, opts CppOptions) (*CppDevice, error) {
+	out := CppDevice{Namespace: namespace, HppFileName: hppFileName, HeaderOnly: opts.HeaderOnly, Stats: opts.Stats, Host: opts.Host, Capture: opts.Capture}
+	crc, err := findCrcAlgo(opts.Crc)
+	if err != nil {
+		return nil, err
+	}
+	out.Crc = cppCrc(crc)
+	if opts.HeaderOnly {
+		out.Inline = "inline "
+	}
+	out.Doc = flattenComments(dev.Doc)
+	var maxWireSize uint64
+	for _, reg := range dev.Registers {
+		num, _ := strconv.ParseInt(reg.NumberStr, 0, 64)
+		out.MaxRegisterId = max(out.MaxRegisterId, int(num))
+		cr := CppRegister{
+			Name:       reg.Name,
+			Number:     int(num),
+			LayoutHash: cppHash(layoutHash(dev, reg)),
+			Doc:        flattenComments(reg.Doc),
+			Readable:   reg.Specifier != "w",
+			Writable:   reg.Specifier != "r",
+		}
+
+		// Process constants
+		for _, c := range reg.Body.Constants() {
+			cc := CppConstant{
+				Doc:   flattenComments(c.Doc),
+				Name:  c.Name,
+				Type:  toCppTypes(c.Type.Name),
+				Value: c.ValueStr,
+			}
+			cr.Constants = append(cr.Constants, cc)
+		}
+
+		readBits, readPacked := packedLayout(reg, true)
+		writeBits, writePacked := packedLayout(reg, false)
+		out.BitPacking = out.BitPacking || reg.IsPacked()
+		for _, f := range reg.Body.Fields() {
+			cf := CppField{
+				Doc:        flattenComments(f.Doc),
+				Name:       f.Name,
+				Trailing:   safeString(f.TrailingComment),
+				IsReadable: f.Specifier == "r" || f.Specifier == "",
+				IsWritable: f.Specifier == "w" || f.Specifier == "",
+				align:      cppFieldLayout(dev, f, opts.SortFields).align,
+			}
+
+			var serCode, deserCode *CppCodec
+			switch {
+			case f.Type.Simple != nil && f.Type.Simple.IsRegisterRef():
+				refRegName := f.Type.Simple.Name
+				refReg := dev.FindRegisterByName(refRegName)
+				cf.Decl = fmt.Sprintf("%s %s;", refRegName, f.Name)
+				if opts.Host && cppHostVectors(dev, refReg, opts.Views) {
+					cr.Allocator = append(cr.Allocator, f.Name+"(mr)")
+				}
+
+				// For RegisterRef, populate the appropriate contexts. The nested register checks
+				// its buffer itself, but if its size is static it joins the run of the static fields.
+				nestedCall := func(method string) []string {
+					return []string{fmt.Sprintf("{auto res = this->%s.%s(buf + offset, size - offset); if (res < 0) return res; offset += res;}", f.Name, method)}
+				}
+				if cf.IsReadable {
+					size := registerWireSize(dev, refReg, true)
+					wireSize := fmt.Sprintf("this->%s.read_size()", f.Name)
+					cf.SerializeReadData = &CppCodec{StaticSize: size, WireSize: wireSize, Code: nestedCall("serialize_read")}
+					cf.DeserializeReadData = &CppCodec{StaticSize: size, WireSize: wireSize, Code: nestedCall("deserialize_read")}
+				}
+				if cf.IsWritable {
+					size := registerWireSize(dev, refReg, false)
+					wireSize := fmt.Sprintf("this->%s.write_size()", f.Name)
+					cf.SerializeWriteData = &CppCodec{StaticSize: size, WireSize: wireSize, Code: nestedCall("serialize_write")}
+					cf.DeserializeWriteData = &CppCodec{StaticSize: size, WireSize: wireSize, Code: nestedCall("deserialize_write")}
+				}
+
+			case f.Type.Bitfield != nil:
+				base := toCppTypes(f.Type.Bitfield.Base)
+				cf.Decl = fmt.Sprintf("%s %s;", base, f.Name)
+				for _, bm := range f.Type.Bitfield.Bits {
+					// Add bit member comments
+					bmComments := flattenComments(bm.Doc)
+					for _, comment := range bmComments {
+						cf.BitMasks = append(cf.BitMasks, comment)
 					}
-					deserCode := []string{
-						fmt.Sprintf("if (offset + sizeof(this->%s) > size) return -1;", f.Name),
-						fmt.Sprintf("offset += bigendian::decode(this->%s, buf + offset);", f.Name),
+
+					start, _ := strconv.Atoi(bm.Start)
+					end := start
+					if bm.End != nil {
+						end, _ = strconv.Atoi(*bm.End)
 					}
-					if cf.IsReadable {
-						cf.SerializeReadData = append(cf.SerializeReadData, serCode...)
-						cf.DeserializeReadData = append(cf.DeserializeReadData, deserCode...)
+					mask := bitMask(start, end)
+
+					// Add bit mask constant with range info in comment
+					bitRange := bm.Start
+					if bm.End != nil && *bm.End != bm.Start {
+						bitRange = fmt.Sprintf("%s-%s", bm.Start, *bm.End)
 					}
-					if cf.IsWritable {
-						cf.SerializeWriteData = append(cf.SerializeWriteData, serCode...)
-						cf.DeserializeWriteData = append(cf.DeserializeWriteData, deserCode...)
+					cf.BitMasks = append(cf.BitMasks,
+						fmt.Sprintf("// %s bit field (bits %s)", bm.Name, bitRange))
+					cf.BitMasks = append(cf.BitMasks,
+						fmt.Sprintf("static constexpr %s %s_%s_bm = 0x%X;",
+							base, f.Name, bm.Name, mask))
+				}
+				size := typeSize(f.Type.Bitfield.Base)
+				serCode = &CppCodec{StaticSize: size, Code: []string{
+					fmt.Sprintf("offset += bigendian::encode(buf + offset, this->%s);", f.Name),
+				}}
+				deserCode = &CppCodec{StaticSize: size, Code: []string{
+					fmt.Sprintf("offset += bigendian::decode(this->%s, buf + offset);", f.Name),
+				}}
+			case f.Type.Array != nil:
+				elem := toCppTypes(f.Type.Array.Type.Name)
+				out.ArrayKernels = out.ArrayKernels || typeSize(f.Type.Array.Type.Name) > 1
+				// the host arrays are the containers, the codecs work with their data
+				arr := "this->" + f.Name
+				if opts.Host {
+					arr += ".data()"
+				}
+				if f.Type.Array.Size.Constant != nil {
+					sz := *f.Type.Array.Size.Constant
+					cf.Decl = fmt.Sprintf("%s %s[%s];", elem, f.Name, sz)
+					if opts.Host {
+						cf.Decl = fmt.Sprintf("std::array<%s, %s> %s;", elem, sz, f.Name)
 					}
+					size := fieldWireSize(dev, f, true)
+					serCode = &CppCodec{StaticSize: size, Code: []string{
+						cppArrayEncode(f.Type.Array.Type.Name, arr, sz, opts.Host),
+					}}
+					deserCode = &CppCodec{StaticSize: size, Code: []string{
+						cppArrayDecode(f.Type.Array.Type.Name, arr, sz, opts.Host),
+					}}
 				} else {
 					cf.Decl = fmt.Sprintf("%s* %s;", elem, f.Name)
+					view := isCppView(reg, f, opts.Views)
+					switch {
+					case view && opts.Host:
+						cf.Decl = fmt.Sprintf("std::span<const %s> %s;", elem, f.Name)
+					case view:
+						cf.Decl = fmt.Sprintf("const %s* %s;", elem, f.Name)
+					case opts.Host:
+						cf.Decl = fmt.Sprintf("std::pmr::vector<%s> %s;", elem, f.Name)
+					}
 					szFieldName := *f.Type.Array.Size.Variable
 					field, bm := reg.FindFieldByName(szFieldName, len(cr.Fields))
 					if bm != nil {
 						// this is the bit mask field
-						serCode := []string{
+						elems := []string{
 							"{",
 							fmt.Sprintf("    %s elems = (this->%s&%s)>>%d;", toCppTypes(field.Type.Bitfield.Base),
 								field.Name, fmt.Sprintf("%s_%s_bm", field.Name, bm.Name), bm.StartBit()),
-							fmt.Sprintf("    if (offset + sizeof(%s)*elems > size) return -1;", elem),
-							fmt.Sprintf("    offset += bigendian::encode_varray(buf + offset, this->%s, elems);", f.Name),
-							"}",
 						}
-						deserCode := []string{
-							"{",
-							fmt.Sprintf("    %s elems = (this->%s&%s)>>%d;", toCppTypes(field.Type.Bitfield.Base),
-								field.Name, fmt.Sprintf("%s_%s_bm", field.Name, bm.Name), bm.StartBit()),
-							fmt.Sprintf("    if (offset + sizeof(%s)*elems > size) return -1;", elem),
-							fmt.Sprintf("    offset += bigendian::decode_varray(this->%s, buf + offset, elems);", f.Name),
-							"}",
+						wireSize := fmt.Sprintf("sizeof(%s)*((this->%s&%s_%s_bm)>>%d)", elem, field.Name, field.Name, bm.Name, bm.StartBit())
+						serCode = &CppCodec{
+							Prologue:   elems,
+							SizeExpr:   fmt.Sprintf("sizeof(%s)*elems", elem),
+							StaticSize: -1,
+							WireSize:   wireSize,
+							Code:       []string{"    " + cppArrayEncode(f.Type.Array.Type.Name, arr, "elems", opts.Host)},
+							Epilogue:   []string{"}"},
 						}
-						if cf.IsReadable {
-							cf.SerializeReadData = append(cf.SerializeReadData, serCode...)
-							cf.DeserializeReadData = append(cf.DeserializeReadData, deserCode...)
+						deserCode = &CppCodec{
+							Prologue:   elems,
+							SizeExpr:   fmt.Sprintf("sizeof(%s)*elems", elem),
+							StaticSize: -1,
+							WireSize:   wireSize,
+							Code:       []string{"    " + cppArrayDecode(f.Type.Array.Type.Name, arr, "elems", opts.Host)},
+							Epilogue:   []string{"}"},
 						}
-						if cf.IsWritable {
-							cf.SerializeWriteData = append(cf.SerializeWriteData, serCode...)
-							cf.DeserializeWriteData = append(cf.DeserializeWriteData, deserCode...)
+						if view {
+							deserCode.Code = []string{"    " + cppArrayView(elem, "this->"+f.Name, "elems", opts.Host)}
 						}
 					} else {
 						// this is the regular field
-						serCode := []string{
-							fmt.Sprintf("if (offset + sizeof(%s)*this->%s > size) return -1;", elem, field.Name),
-							fmt.Sprintf("offset += bigendian::encode_varray(buf + offset, this->%s, this->%s);", f.Name, field.Name),
+						serCode = &CppCodec{
+							SizeExpr:   fmt.Sprintf("sizeof(%s)*this->%s", elem, field.Name),
+							StaticSize: -1,
+							WireSize:   fmt.Sprintf("sizeof(%s)*this->%s", elem, field.Name),
+							Code:       []string{cppArrayEncode(f.Type.Array.Type.Name, arr, "this->"+field.Name, opts.Host)},
+						}
+						deserCode = &CppCodec{
+							SizeExpr:   fmt.Sprintf("sizeof(%s)*this->%s", elem, field.Name),
+							StaticSize: -1,
+							WireSize:   fmt.Sprintf("sizeof(%s)*this->%s", elem, field.Name),
+							Code:       []string{cppArrayDecode(f.Type.Array.Type.Name, arr, "this->"+field.Name, opts.Host)},
+						}
+						if view {
+							deserCode.Code = []string{cppArrayView(elem, "this->"+f.Name, "this->"+field.Name, opts.Host)}
+						}
+					}
+					elems, indent := "this->"+field.Name, ""
+					if bm != nil {
+						elems, indent = "elems", "    "
+					}
+					if c := f.Type.Array.Capacity(); c > 0 {
+						// the bounded array is stored in the register, the bigger counts are rejected
+						cf.Decl = fmt.Sprintf("%s %s[%d];", elem, f.Name, c)
+						if opts.Host {
+							cf.Decl = fmt.Sprintf("std::array<%s, %d> %s;", elem, c, f.Name)
 						}
-						deserCode := []string{
-							fmt.Sprintf("if (offset + sizeof(%s)*this->%s > size) return -1;", elem, field.Name),
-							fmt.Sprintf("offset += bigendian::decode_varray(this->%s, buf + offset, this->%s);", f.Name, field.Name),
+						check := fmt.Sprintf("if ((size_t)this->%s > %d) return -1;", field.Name, c)
+						if bm != nil {
+							check = fmt.Sprintf("    if (elems > %d) return -1;", c)
 						}
-						if cf.IsReadable {
-							cf.SerializeReadData = append(cf.SerializeReadData, serCode...)
-							cf.DeserializeReadData = append(cf.DeserializeReadData, deserCode...)
+						for _, code := range []*CppCodec{serCode, deserCode} {
+							code.Prologue = append(append([]string{}, code.Prologue...), check)
 						}
-						if cf.IsWritable {
-							cf.SerializeWriteData = append(cf.SerializeWriteData, serCode...)
-							cf.DeserializeWriteData = append(cf.DeserializeWriteData, deserCode...)
+					} else if opts.Host {
+						// the host containers know their size: the shorter ones are not serialized,
+						// and the vectors are resized to the decoded count
+						serCode.Prologue = append(append([]string{}, serCode.Prologue...),
+							fmt.Sprintf("%sif (this->%s.size() < (size_t)%s) return -1;", indent, f.Name, elems))
+						if !view {
+							deserCode.Code = append([]string{fmt.Sprintf("%sthis->%s.resize(%s);", indent, f.Name, elems)}, deserCode.Code...)
+							cr.Allocator = append(cr.Allocator, f.Name+"(mr)")
 						}
 					}
 				}
 
+			case f.Type.Simple != nil && f.IsVarint():
+				elem := toCppTypes(f.Type.Simple.Name)
+				cf.Decl = fmt.Sprintf("%s %s;", elem, f.Name)
+				out.Varints = true
+				value := "this->" + f.Name
+				if strings.HasPrefix(f.Type.Simple.Name, "int") {
+					value = fmt.Sprintf("detail::zigzag(this->%s)", f.Name)
+				}
+				size := fmt.Sprintf("detail::varint_size(%s)", value)
+				serCode = &CppCodec{SizeExpr: size, StaticSize: -1, WireSize: size, Code: []string{
+					fmt.Sprintf("offset += detail::put_varint(buf + offset, %s);", value),
+				}}
+				// the decoder checks the buffer itself, the varint size is unknown before
+				deserCode = &CppCodec{StaticSize: -1, WireSize: size, Code: []string{
+					fmt.Sprintf("{int res = detail::get_varint(buf + offset, size - offset, this->%s); if (res < 0) return -1; offset += res;}", f.Name),
+				}}
+				if strings.HasPrefix(f.Type.Simple.Name, "int") {
+					deserCode.Code = []string{
+						fmt.Sprintf("{%s v; int res = detail::get_varint(buf + offset, size - offset, v); if (res < 0) return -1; this->%s = detail::unzigzag(v); offset += res;}",
+							toCppTypes("u"+f.Type.Simple.Name), f.Name),
+					}
+				}
 			case f.Type.Simple != nil:
 				elem := toCppTypes(f.Type.Simple.Name)
 				cf.Decl = fmt.Sprintf("%s %s;", elem, f.Name)
-				serCode := []string{
-					fmt.Sprintf("if (offset + sizeof(this->%s) > size) return -1;", f.Name),
+				size := typeSize(f.Type.Simple.Name)
+				serCode = &CppCodec{StaticSize: size, Code: []string{
 					fmt.Sprintf("offset += bigendian::encode(buf + offset, this->%s);", f.Name),
-				}
-				deserCode := []string{
-					fmt.Sprintf("if (offset + sizeof(this->%s) > size) return -1;", f.Name),
+				}}
+				deserCode = &CppCodec{StaticSize: size, Code: []string{
 					fmt.Sprintf("offset += bigendian::decode(this->%s, buf + offset);", f.Name),
+				}}
+			default:
+				cf.Decl = fmt.Sprintf("/* unsupported field %s */", f.Name)
+			}
+
+			if serCode != nil {
+				if cf.IsReadable {
+					cf.SerializeReadData = serCode
+					cf.DeserializeReadData = deserCode
+				}
+				if cf.IsWritable {
+					cf.SerializeWriteData = serCode
+					cf.DeserializeWriteData = deserCode
 				}
+			}
+			if reg.IsPacked() {
+				i := len(cr.Fields)
 				if cf.IsReadable {
-					cf.SerializeReadData = append(cf.SerializeReadData, serCode...)
-					cf.DeserializeReadData = append(cf.DeserializeReadData, deserCode...)
+					cf.SerializeReadData, cf.DeserializeReadData = cppPackedCodecs(f, readBits, readPacked, i)
 				}
 				if cf.IsWritable {
-					cf.SerializeWriteData = append(cf.SerializeWriteData, serCode...)
-					cf.DeserializeWriteData = append(cf.DeserializeWriteData, deserCode...)
+					cf.SerializeWriteData, cf.DeserializeWriteData = cppPackedCodecs(f, writeBits, writePacked, i)
 				}
-			default:
-				cf.Decl = fmt.Sprintf("/* unsupported field %s */", f.Name)
+			}
+			if opts.Host && !strings.HasPrefix(cf.Decl, "std::pmr::vector") && !strings.HasPrefix(cf.Decl, "std::span") {
+				// the host registers are the value types which are always initialized
+				cf.Decl = strings.TrimSuffix(cf.Decl, ";") + "{};"
+			}
+			if v := cppValidator(f); v != "" {
+				// the value is checked right after it is decoded, so the delta and the crc
+				// codecs reuse the check
+				cr.Validators = append(cr.Validators, v)
+				cf.DeserializeReadData = cppWithCheck(cf.DeserializeReadData, cppValidCheck(f))
+				cf.DeserializeWriteData = cppWithCheck(cf.DeserializeWriteData, cppValidCheck(f))
 			}
 
 			cr.Fields = append(cr.Fields, cf)
 		}
+
+		var serRead, serWrite, deserRead, deserWrite []*CppCodec
+		for _, cf := range cr.Fields {
+			serRead = appendCodec(serRead, cf.SerializeReadData)
+			serWrite = appendCodec(serWrite, cf.SerializeWriteData)
+			deserRead = appendCodec(deserRead, cf.DeserializeReadData)
+			deserWrite = appendCodec(deserWrite, cf.DeserializeWriteData)
+		}
+
+		cr.ReadWireSize = registerWireSize(dev, reg, true)
+		cr.WriteWireSize = registerWireSize(dev, reg, false)
+		readMax, writeMax := registerMaxWireSize(dev, reg, true), registerMaxWireSize(dev, reg, false)
+		cr.ReadWireSizeMax = cppSizeConstant(readMax)
+		cr.WriteWireSizeMax = cppSizeConstant(writeMax)
+		maxWireSize = max(maxWireSize, readMax, writeMax)
+		if cr.ReadWireSize < 0 {
+			cr.ReadSize = wireSizeBody(serRead)
+		}
+		if cr.WriteWireSize < 0 {
+			cr.WriteSize = wireSizeBody(serWrite)
+		}
+		cr.PrepareWrite = cr.Writable && !opts.Host && needsArrayStorage(dev, reg, opts.Views)
+		if reg.FindOption("delta") != nil {
+			cr.Delta = cppDelta(reg, cr.Fields)
+			deltaMax := satAdd(writeMax, uint64(cr.Delta.MaskSize))
+			cr.Delta.WireSizeMax = cppSizeConstant(deltaMax)
+			maxWireSize = max(maxWireSize, deltaMax)
+		}
+		if reg.IsStream() {
+			if cr.Stream, err = cppStream(reg, opts.Host); err != nil {
+				return nil, err
+			}
+			out.Streams = true
+		}
+		if reg.IsTable() && !opts.Host {
+			// the tables save the flash, the host registers are always the generated code
+			if cr.Table, err = cppTable(reg, opts.Views); err != nil {
+				return nil, err
+			}
+			out.Tables = true
+		}
+		if !reg.IsPacked() {
+			cr.WireOffsets, cr.Accessors = cppWireOffsets(dev, reg)
+		}
+		cr.SerializeRead = cppCodecBody(serRead, cr.Table, reg.Name, "serialize", true)
+		cr.SerializeWrite = cppCodecBody(serWrite, cr.Table, reg.Name, "serialize", false)
+		cr.DeserializeRead = cppCodecBody(deserRead, cr.Table, reg.Name, "deserialize", true)
+		cr.DeserializeWrite = cppCodecBody(deserWrite, cr.Table, reg.Name, "deserialize", false)
+		if opts.Stats {
+			cr.SerializeRead = cppCountReturns(cr.SerializeRead, "serialize_read")
+			cr.SerializeWrite = cppCountReturns(cr.SerializeWrite, "serialize_write")
+			cr.DeserializeRead = cppCountReturns(cr.DeserializeRead, "deserialize_read")
+			cr.DeserializeWrite = cppCountReturns(cr.DeserializeWrite, "deserialize_write")
+		}
+		if crc != nil {
+			// the packed fields share the bytes and the interpreter writes the fields itself, so
+			// these registers get the checksum of the whole wire data
+			whole := reg.IsPacked() || cr.Table != nil
+			cr.Crc = &CppCrcCodecs{
+				SerializeRead:    cppCrcBody(serRead, "serialize_read", whole),
+				SerializeWrite:   cppCrcBody(serWrite, "serialize_write", whole),
+				DeserializeRead:  cppCrcBody(deserRead, "deserialize_read", whole),
+				DeserializeWrite: cppCrcBody(deserWrite, "deserialize_write", whole),
+			}
+		}
+		if opts.SortFields {
+			// the codecs are generated already, only the declaration order changes
+			sort.SliceStable(cr.Fields, func(i, j int) bool { return cr.Fields[i].align > cr.Fields[j].align })
+			cr.SizeReport = fmt.Sprintf("sizeof is %d bytes on the 32-bit targets, %d bytes in the declaration order",
+				cppRegisterLayout(dev, reg, true).size, cppRegisterLayout(dev, reg, false).size)
+		}
 		out.Registers = append(out.Registers, cr)
 	}
+	out.MaxWireSize = cppSizeConstant(maxWireSize)
+	out.LayoutHash = cppHash(deviceLayoutHash(dev))
+	out.HandshakeSize = handshakeSize(dev)
+	out.Handshake = handshakeRows(dev, "Layout_Hash", func(reg string) string { return reg + "::kLayoutHash" })
+	if opts.Dispatch || opts.Batch {
+		out.Dispatch = true
+		out.Batch = opts.Batch
+		out.ReadTable = make([]string, out.MaxRegisterId+1)
+		out.WriteTable = make([]string, out.MaxRegisterId+1)
+		for i := range out.ReadTable {
+			out.ReadTable[i], out.WriteTable[i] = "nullptr", "nullptr"
+		}
+		for _, cr := range out.Registers {
+			if cr.Readable {
+				out.ReadTable[cr.Number] = "detail::read_" + cr.Name
+			}
+			if cr.Writable {
+				out.WriteTable[cr.Number] = "detail::write_" + cr.Name
+			}
+		}
+	}
 
-	var hpp, cpp bytes.Buffer
-	if err := tplHpp.Execute(&hpp, out); err != nil {
-		return "", "", err
+	return &out, nil
+}
+
+// cppHash returns the C++ literal of the layout hash
+func cppHash(h uint64) string {
+	return fmt.Sprintf("0x%016XULL", h)
+}
+
+func appendCodec(codecs []*CppCodec, c *CppCodec) []*CppCodec {
+	if c == nil {
+		return codecs
 	}
-	if err := tplCpp.Execute(&cpp, out); err != nil {
-		return "", "", err
+	return append(codecs, c)
+}
+
+// cppCodecBody returns the body of the register codec: the interpreter call of the table
+// register, or the fields codecs
+func cppCodecBody(codecs []*CppCodec, table *CppTable, name, codec string, read bool) []string {
+	if table != nil {
+		fields, dir := table.Write, "write"
+		if read {
+			fields, dir = table.Read, "read"
+		}
+		checks := table.WriteChecks
+		if read {
+			checks = table.ReadChecks
+		}
+		call := fmt.Sprintf("detail::table_%s(detail::%s_%s_fields(), %d, this, buf, size)", codec, name, dir, len(fields))
+		if len(fields) > 0 && (codec == "serialize" || len(checks) == 0) {
+			return []string{"return " + call + ";"}
+		}
+		if len(fields) > 0 {
+			res := []string{"int offset = " + call + ";", "if (offset < 0) return -1;"}
+			res = append(res, checks...)
+			return append(res, "return offset;")
+		}
 	}
-	return strings.TrimSpace(hpp.String()) + "\n", strings.TrimSpace(cpp.String()), nil
+	res := []string{"int offset = 0;"}
+	res = append(res, coalesceBoundsChecks(codecs)...)
+	return append(res, "return offset;")
+}
+
+// cppReturn matches the return statement of the codec body
+var cppReturn = regexp.MustCompile(`\breturn ([^;]+);`)
+
+// cppCountReturns passes the results of the codec body to PARGUS_COUNT
+func cppCountReturns(body []string, codec string) []string {
+	res := make([]string, len(body))
+	for i, l := range body {
+		res[i] = cppReturn.ReplaceAllString(l, "return PARGUS_COUNT("+codec+", $1);")
+	}
+	return res
+}
+
+// coalesceBoundsChecks builds the function body from the fields codecs. Instead of checking
+// the buffer before every field, the static fields are grouped into runs and each run is
+// checked once: the leading run at the function entry, and any other run together with
+// the variable-length field preceding it.
+func coalesceBoundsChecks(codecs []*CppCodec) []string {
+	var res []string
+	i := 0
+	for i <= len(codecs) {
+		// the segment head is either the function entry or a field with the run-time size
+		var head *CppCodec
+		if i > 0 {
+			head = codecs[i-1]
+		}
+		runSize := 0
+		j := i
+		for ; j < len(codecs) && codecs[j].StaticSize >= 0; j++ {
+			runSize += codecs[j].StaticSize
+		}
+
+		switch {
+		case head == nil:
+			if runSize > 0 {
+				res = append(res, fmt.Sprintf("if (size < %d) return -1;", runSize))
+			}
+		case head.SizeExpr != "":
+			check := head.SizeExpr
+			if runSize > 0 {
+				check = fmt.Sprintf("%s + %d", check, runSize)
+			}
+			res = append(res, head.Prologue...)
+			res = append(res, fmt.Sprintf("%sif (offset + %s > size) return -1;", blockIndent(head), check))
+			res = append(res, head.Code...)
+			res = append(res, head.Epilogue...)
+		default:
+			res = append(res, head.Prologue...)
+			res = append(res, head.Code...)
+			res = append(res, head.Epilogue...)
+			if runSize > 0 {
+				res = append(res, fmt.Sprintf("if (size - offset < %d) return -1;", runSize))
+			}
+		}
+
+		for _, c := range codecs[i:j] {
+			res = append(res, c.Prologue...)
+			res = append(res, c.Code...)
+			res = append(res, c.Epilogue...)
+		}
+		i = j + 1
+	}
+	return res
+}
+
+// cppArrayEncode returns the statement encoding n elements of the array. The kernel depends on
+// the element type: the byte-sized elements are just copied, the wider ones use the bulk codec.
+// The host copies by std::copy_n, as the data() of the empty container may be null, which memcpy
+// doesn't accept even for 0 bytes.
+func cppArrayEncode(elemType, arr, n string, host bool) string {
+	if typeSize(elemType) == 1 && host {
+		return fmt.Sprintf("std::copy_n(%s, %s, buf + offset); offset += %s;", arr, n, n)
+	}
+	if typeSize(elemType) == 1 {
+		return fmt.Sprintf("memcpy(buf + offset, %s, %s); offset += %s;", arr, n, n)
+	}
+	return fmt.Sprintf("offset += detail::encode_array(buf + offset, %s, %s);", arr, n)
+}
+
+// cppArrayDecode returns the statement decoding n elements of the array, see cppArrayEncode
+func cppArrayDecode(elemType, arr, n string, host bool) string {
+	if typeSize(elemType) == 1 && host {
+		return fmt.Sprintf("std::copy_n(buf + offset, %s, %s); offset += %s;", n, arr, n)
+	}
+	if typeSize(elemType) == 1 {
+		return fmt.Sprintf("memcpy(%s, buf + offset, %s); offset += %s;", arr, n, n)
+	}
+	return fmt.Sprintf("offset += detail::decode_array(%s, buf + offset, %s);", arr, n)
+}
+
+// cppPackedCodecs returns the codecs of the field i of the packed register. The bit positions
+// of the fields and the wire size come from packedLayout. The first field of the direction
+// carries the wire size for the bounds check and zeroes the bits, the last one moves the offset.
+func cppPackedCodecs(f *parser.Field, bitPos []int, size, i int) (*CppCodec, *CppCodec) {
+	first, last := true, true
+	for j, pos := range bitPos {
+		first = first && (j >= i || pos < 0)
+		last = last && (j <= i || pos < 0)
+	}
+	typ := packedType(f)
+	n := f.Bits()
+	ser := &CppCodec{Code: []string{
+		fmt.Sprintf("detail::put_bits(buf + offset, %d, %d, static_cast<uint32_t>(this->%s));", bitPos[i], n, f.Name),
+	}}
+	value := fmt.Sprintf("detail::get_bits(buf + offset, %d, %d)", bitPos[i], n)
+	if strings.HasPrefix(typ, "int") {
+		value = fmt.Sprintf("detail::sign_extend(%s, %d)", value, n)
+	}
+	deser := &CppCodec{Code: []string{
+		fmt.Sprintf("this->%s = static_cast<%s>(%s);", f.Name, toCppTypes(typ), value),
+	}}
+	if first {
+		ser.StaticSize, deser.StaticSize = size, size
+		ser.Code = append([]string{fmt.Sprintf("memset(buf + offset, 0, %d);", size)}, ser.Code...)
+	}
+	if last {
+		advance := fmt.Sprintf("offset += %d;", size)
+		ser.Code = append(ser.Code, advance)
+		deser.Code = append(deser.Code, advance)
+	}
+	return ser, deser
+}
+
+// cppDelta builds the delta writes of the register. Every write field takes a bit of the
+// presence mask, and only the fields with the bit set are sent. A variable-length array and
+// its size field are always sent together, so the mask is fixed up before sending and checked
+// on receiving.
+func cppDelta(reg *parser.Register, fields []CppField) *CppDelta {
+	d := &CppDelta{}
+	dirty, pairs := deltaLayout(reg)
+	for i, f := range reg.Body.Fields() {
+		if dirty[i] >= 0 {
+			d.Fields = append(d.Fields, CppDirtyField{Name: f.Name, Index: dirty[i]})
+		}
+	}
+	d.MaskSize = max((len(d.Fields)+7)/8, 1)
+
+	d.Serialize = []string{
+		fmt.Sprintf("if (size < %d) return -1;", d.MaskSize),
+		fmt.Sprintf("uint8_t mask[%d];", d.MaskSize),
+		fmt.Sprintf("memcpy(mask, this->dirty, %d);", d.MaskSize),
+	}
+	d.Deserialize = []string{
+		fmt.Sprintf("if (size < %d) return -1;", d.MaskSize),
+		"const uint8_t* mask = buf;",
+	}
+	if len(pairs) > 0 {
+		d.Serialize = append(d.Serialize, "// the variable-length arrays are sent together with their size fields")
+		d.Deserialize = append(d.Deserialize, "// the variable-length arrays are sent together with their size fields")
+	}
+	for _, p := range pairs {
+		arr, sz := cppDirtyBit(p[0]), cppDirtyBit(p[1])
+		d.Serialize = append(d.Serialize, fmt.Sprintf("if ((%s) || (%s)) { %s; %s; }", arr, sz,
+			strings.Replace(arr, " & ", " |= ", 1), strings.Replace(sz, " & ", " |= ", 1)))
+		d.Deserialize = append(d.Deserialize, fmt.Sprintf("if (!(%s) != !(%s)) return -1;", arr, sz))
+	}
+	d.Serialize = append(d.Serialize,
+		fmt.Sprintf("memcpy(buf, mask, %d);", d.MaskSize),
+		fmt.Sprintf("offset += %d;", d.MaskSize))
+	d.Deserialize = append(d.Deserialize, fmt.Sprintf("offset += %d;", d.MaskSize))
+
+	for i := range fields {
+		if dirty[i] < 0 {
+			continue
+		}
+		d.Serialize = append(d.Serialize, cppDirtyBlock(dirty[i], fields[i].SerializeWriteData)...)
+		d.Deserialize = append(d.Deserialize, cppDirtyBlock(dirty[i], fields[i].DeserializeWriteData)...)
+	}
+	d.Deserialize = append(d.Deserialize, fmt.Sprintf("memcpy(this->dirty, mask, %d);", d.MaskSize))
+	return d
+}
+
+// cppDirtyBit returns the test of the bit of the mask
+func cppDirtyBit(index int) string {
+	return fmt.Sprintf("mask[%d] & 0x%02X", index/8, 1<<(index%8))
+}
+
+// cppDirtyBlock returns the field code which runs only if the field bit of the mask is set.
+// The field checks the buffer itself.
+func cppDirtyBlock(index int, c *CppCodec) []string {
+	code := append([]string{}, c.Prologue...)
+	switch {
+	case c.SizeExpr != "":
+		code = append(code, fmt.Sprintf("%sif (offset + %s > size) return -1;", blockIndent(c), c.SizeExpr))
+	case c.StaticSize > 0:
+		code = append(code, fmt.Sprintf("if (size - offset < %d) return -1;", c.StaticSize))
+	}
+	code = append(code, c.Code...)
+	code = append(code, c.Epilogue...)
+
+	res := []string{fmt.Sprintf("if (%s) {", cppDirtyBit(index))}
+	for _, line := range code {
+		res = append(res, "\t"+line)
+	}
+	return append(res, "}")
+}
+
+// cppWireOffsets returns the wire offsets of the fields in the static prefix of the register
+// read and write data, and the in-place accessors of the scalar ones. A field gets the common
+// wire_offset_<field> if its offset is the same in all its directions, otherwise read_ and
+// write_ prefix the constant and the accessors.
+func cppWireOffsets(dev *parser.Device, reg *parser.Register) ([]CppConstant, []CppAccessor) {
+	fields := reg.Body.Fields()
+	offsets := [2][]int{}
+	for d, read := range []bool{true, false} {
+		offset := 0
+		for _, f := range fields {
+			if !fieldInDirection(f, read) || offset < 0 {
+				offsets[d] = append(offsets[d], -1)
+				continue
+			}
+			offsets[d] = append(offsets[d], offset)
+			if size := fieldWireSize(dev, f, read); size >= 0 && !f.IsVarint() {
+				offset += size
+			} else {
+				offset = -1
+			}
+		}
+	}
+	var consts []CppConstant
+	var accessors []CppAccessor
+	for i, f := range fields {
+		typ := ""
+		switch {
+		case f.Type.Bitfield != nil:
+			typ = toCppTypes(f.Type.Bitfield.Base)
+		case f.Type.Simple != nil && !f.Type.Simple.IsRegisterRef() && !f.IsVarint():
+			typ = toCppTypes(f.Type.Simple.Name)
+		}
+		r, w := offsets[0][i], offsets[1][i]
+		single := r == w || !fieldInDirection(f, true) || !fieldInDirection(f, false)
+		for d, prefix := range []string{"read_", "write_"} {
+			offset := offsets[d][i]
+			if offset < 0 || (single && d == 1 && r >= 0) {
+				continue
+			}
+			if single {
+				prefix = ""
+			}
+			name := fmt.Sprintf("%swire_offset_%s", prefix, f.Name)
+			consts = append(consts, CppConstant{Name: name, Type: "size_t", Value: strconv.Itoa(offset)})
+			if typ != "" {
+				accessors = append(accessors, CppAccessor{Name: prefix + f.Name, Type: typ, Offset: name})
+			}
+		}
+	}
+	return consts, accessors
+}
+
+// cppCrc returns the checksum kernel of the CRC
+func cppCrc(a *crcAlgo) *CppCrc {
+	if a == nil {
+		return nil
+	}
+	hex := func(v uint32) string { return fmt.Sprintf("0x%0*X", a.Width/4, v) }
+	c := &CppCrc{
+		Title:  a.Title,
+		Type:   fmt.Sprintf("uint%d_t", a.Width),
+		Size:   a.Width / 8,
+		Init:   hex(a.Init),
+		XorOut: hex(a.XorOut),
+		Poly:   hex(a.Poly),
+	}
+	tables := a.slicingTables()
+	c.TableSize = 4 * 256 * c.Size
+	for _, t := range tables {
+		c.Table = append(c.Table, "{")
+		for i := 0; i < 256; i += 8 {
+			var row []string
+			for _, v := range t[i : i+8] {
+				row = append(row, hex(v))
+			}
+			c.Table = append(c.Table, "\t"+strings.Join(row, ", ")+",")
+		}
+		c.Table = append(c.Table, "},")
+	}
+	switch {
+	case a.Reflected:
+		c.BitStep = []string{
+			"crc ^= *p++;",
+			fmt.Sprintf("for (uint8_t i = 0; i < 8; i++) crc = crc & 1 ? (crc >> 1) ^ %s : crc >> 1;", c.Poly),
+		}
+		c.ByteStep = "crc = (crc >> 8) ^ table[0][(uint8_t)crc ^ *p++];"
+		c.SliceStep = []string{
+			"crc ^= (crc_t)p[0] | (crc_t)p[1] << 8 | (crc_t)p[2] << 16 | (crc_t)p[3] << 24;",
+			"crc = table[3][crc & 0xFF] ^ table[2][(crc >> 8) & 0xFF] ^ table[1][(crc >> 16) & 0xFF] ^ table[0][crc >> 24];",
+		}
+	case a.Width == 8:
+		c.BitStep = []string{
+			"crc ^= *p++;",
+			fmt.Sprintf("for (uint8_t i = 0; i < 8; i++) crc = crc & 0x80 ? (crc_t)((crc << 1) ^ %s) : (crc_t)(crc << 1);", c.Poly),
+		}
+		c.ByteStep = "crc = table[0][crc ^ *p++];"
+		c.SliceStep = []string{"crc = table[3][crc ^ p[0]] ^ table[2][p[1]] ^ table[1][p[2]] ^ table[0][p[3]];"}
+	default:
+		c.BitStep = []string{
+			"crc ^= (crc_t)(*p++ << 8);",
+			fmt.Sprintf("for (uint8_t i = 0; i < 8; i++) crc = crc & 0x8000 ? (crc_t)((crc << 1) ^ %s) : (crc_t)(crc << 1);", c.Poly),
+		}
+		c.ByteStep = "crc = (crc_t)((crc << 8) ^ table[0][(uint8_t)(crc >> 8) ^ *p++]);"
+		c.SliceStep = []string{"crc = table[3][(uint8_t)(crc >> 8) ^ p[0]] ^ table[2][(uint8_t)crc ^ p[1]] ^ table[1][p[2]] ^ table[0][p[3]];"}
+	}
+	return c
+}
+
+// cppCrcBody builds the body of the codec followed by the checksum. The checksum is updated
+// after every run of the fields, while the bytes are still hot. If whole is true, it is
+// calculated over the wire data of the regular codec instead.
+func cppCrcBody(codecs []*CppCodec, codec string, whole bool) []string {
+	var res []string
+	if whole {
+		res = []string{
+			fmt.Sprintf("int offset = %s(buf, size);", codec),
+			"if (offset < 0) return -1;",
+			"detail::crc_t crc = detail::crc_update(detail::kCrcInit, buf, offset);",
+		}
+	} else {
+		res = []string{"int offset = 0;"}
+		if len(codecs) > 0 {
+			res = append(res, "int mark = 0;")
+		}
+		res = append(res, "detail::crc_t crc = detail::kCrcInit;")
+		updated := make([]*CppCodec, 0, len(codecs))
+		for i, c := range codecs {
+			if i == len(codecs)-1 || codecs[i+1].StaticSize < 0 {
+				cc := *c
+				cc.Code = append(append([]string{}, c.Code...),
+					blockIndent(c)+"crc = detail::crc_update(crc, buf + mark, offset - mark); mark = offset;")
+				c = &cc
+			}
+			updated = append(updated, c)
+		}
+		res = append(res, coalesceBoundsChecks(updated)...)
+	}
+	res = append(res, "if (size - offset < Crc_Size) return -1;")
+	if strings.HasPrefix(codec, "serialize") {
+		return append(res,
+			"offset += bigendian::encode(buf + offset, (detail::crc_t)(crc ^ detail::kCrcXorOut));",
+			"return offset;")
+	}
+	return append(res,
+		"detail::crc_t sum;",
+		"bigendian::decode(sum, buf + offset);",
+		"if (sum != (detail::crc_t)(crc ^ detail::kCrcXorOut)) return -1;",
+		"return offset + Crc_Size;")
+}
+
+// cppValidator returns the constexpr validation function of the constrained field, empty if the
+// field has no constraint. The enum values are between min and max, so only the enum is checked
+// if the field has it.
+func cppValidator(f *parser.Field) string {
+	c := f.Constraint()
+	if c == nil {
+		return ""
+	}
+	typ := f.Type.Simple.Name
+	var conds []string
+	op := " && "
+	if len(c.Enum) > 0 {
+		for _, v := range c.Enum {
+			conds = append(conds, "v == "+cppIntLiteral(typ, v))
+		}
+		op = " || "
+	} else {
+		if c.Min != "" {
+			conds = append(conds, "v >= "+cppIntLiteral(typ, c.Min))
+		}
+		if c.Max != "" {
+			conds = append(conds, "v <= "+cppIntLiteral(typ, c.Max))
+		}
+	}
+	return fmt.Sprintf("static constexpr bool valid_%s(%s v) { return %s; }", f.Name, toCppTypes(typ), strings.Join(conds, op))
+}
+
+// cppValidCheck returns the statement rejecting the invalid value of the constrained field
+func cppValidCheck(f *parser.Field) string {
+	return fmt.Sprintf("if (!valid_%s(this->%s)) return -1;", f.Name, f.Name)
+}
+
+// cppWithCheck returns the copy of the deserialization codec followed by the check statement
+func cppWithCheck(c *CppCodec, check string) *CppCodec {
+	if c == nil {
+		return nil
+	}
+	cc := *c
+	if len(cc.Epilogue) > 0 {
+		cc.Epilogue = append(append([]string{}, cc.Epilogue...), check)
+	} else {
+		cc.Code = append(append([]string{}, cc.Code...), check)
+	}
+	return &cc
+}
+
+// cppIntLiteral returns the C++ literal of the decimal value of the integer type: the unsigned
+// values get the suffix, and the minimal int64 value, which has no literal, is an expression
+func cppIntLiteral(typ, v string) string {
+	switch {
+	case strings.HasPrefix(typ, "uint"):
+		return v + "u"
+	case v == "-9223372036854775808":
+		return "(-9223372036854775807 - 1)"
+	}
+	return v
+}
+
+// cppHostVectors returns whether the host register, including the nested registers, has the
+// variable-length arrays stored in the vectors, which take the memory resource
+func cppHostVectors(dev *parser.Device, reg *parser.Register, views bool) bool {
+	for _, f := range reg.Body.Fields() {
+		switch {
+		case f.Type.Array != nil && f.Type.Array.Size.Variable != nil:
+			if !isCppView(reg, f, views) && f.Type.Array.Capacity() == 0 {
+				return true
+			}
+		case f.Type.Simple != nil && f.Type.Simple.IsRegisterRef():
+			if cppHostVectors(dev, dev.FindRegisterByName(f.Type.Simple.Name), views) {
+				return true
+			}
+		}
+	}
+	return false
+}
+
+// isCppView returns whether the variable-length array f is deserialized as the view of the wire
+// buffer: the byte arrays with the views option. The chunks are transient, so the stream
+// registers always copy the arrays, and the bounded arrays are copied to the register storage.
+func isCppView(reg *parser.Register, f *parser.Field, views bool) bool {
+	return views && typeSize(f.Type.Array.Type.Name) == 1 && !reg.IsStream() && f.Type.Array.Capacity() == 0
+}
+
+// needsArrayStorage returns whether the register write fields, including the nested registers,
+// have the variable-length arrays which must point to a storage before deserialization
+func needsArrayStorage(dev *parser.Device, reg *parser.Register, views bool) bool {
+	for _, f := range reg.Body.Fields() {
+		if !fieldInDirection(f, false) {
+			continue
+		}
+		switch {
+		case f.Type.Array != nil && f.Type.Array.Size.Variable != nil:
+			if !isCppView(reg, f, views) && f.Type.Array.Capacity() == 0 {
+				return true
+			}
+		case f.Type.Simple != nil && f.Type.Simple.IsRegisterRef():
+			if needsArrayStorage(dev, dev.FindRegisterByName(f.Type.Simple.Name), views) {
+				return true
+			}
+		}
+	}
+	return false
+}
+
+// cppStream builds the chunked codecs of the stream register. The fields of a direction are
+// the states of the codec in the declaration order, the arrays go by the elements: as many
+// elements as fit the chunk are coded in bulk, the one split between the chunks goes through
+// the scratch buffer of the stream state.
+func cppStream(reg *parser.Register, host bool) (*CppStream, error) {
+	s := &CppStream{}
+	for _, read := range []bool{true, false} {
+		ser := []string{
+			"size_t offset = 0;",
+			"while (detail::stream_flush(st, buf, size, offset)) {",
+			"\tst.pos = 0;",
+			"\tst.len = 0;",
+			"\tswitch (st.field) {",
+		}
+		deser := []string{
+			"size_t offset = 0;",
+		}
+		var deserCases, checks []string
+		state := 0
+		for i, f := range reg.Body.Fields() {
+			if !fieldInDirection(f, read) {
+				continue
+			}
+			if state == streamDone {
+				return nil, fmt.Errorf("stream register '%s' has too many fields", reg.Name)
+			}
+			if f.Constraint() != nil {
+				checks = append(checks, "\t\t"+cppValidCheck(f))
+			}
+			sc, dc := cppStreamCases(reg, i, f, host)
+			ser = append(ser, cppStreamCase(state, sc)...)
+			deserCases = append(deserCases, cppStreamCase(state, dc)...)
+			state++
+		}
+		ser = append(ser,
+			"\tdefault:",
+			"\t\tst.field = Stream_State::kDone;",
+			"\t\treturn (int)offset;",
+			"\t}",
+			"}",
+			"return (int)offset;")
+		if strings.Contains(strings.Join(deserCases, "\n"), "p = ") {
+			deser = append(deser, "const uint8_t* p;")
+		}
+		deser = append(deser, "for (;;) {", "\tswitch (st.field) {")
+		deser = append(deser, deserCases...)
+		// the constrained fields are validated once the whole register is received
+		deser = append(deser, "\tdefault:")
+		deser = append(deser, checks...)
+		deser = append(deser,
+			"\t\tst.field = Stream_State::kDone;",
+			"\t\treturn (int)offset;",
+			"\t}",
+			"}")
+		if read {
+			s.SerializeRead, s.DeserializeRead = ser, deser
+		} else {
+			s.SerializeWrite, s.DeserializeWrite = ser, deser
+		}
+	}
+	return s, nil
+}
+
+// cppTable returns the fields descriptors of the table-driven register, the initializers of
+// detail::Field_Desc in the declaration order of the read and of the write fields
+func cppTable(reg *parser.Register, views bool) (*CppTable, error) {
+	t := &CppTable{}
+	for _, read := range []bool{true, false} {
+		var descs, checks []string
+		for i, f := range reg.Body.Fields() {
+			if !fieldInDirection(f, read) {
+				continue
+			}
+			kind, typ, count, sizeField, shift, bits, capacity := "kScalar", "", "0", "0", 0, 0, 0
+			switch {
+			case f.Type.Bitfield != nil:
+				typ = f.Type.Bitfield.Base
+			case f.Type.Array != nil:
+				typ = f.Type.Array.Type.Name
+				if f.Type.Array.Size.Constant != nil {
+					n, _ := strconv.ParseInt(*f.Type.Array.Size.Constant, 0, 64)
+					if n > 0xFFFF {
+						return nil, fmt.Errorf("array '%s' of table register '%s' is too long", f.Name, reg.Name)
+					}
+					kind, count = "kArray", *f.Type.Array.Size.Constant
+					break
+				}
+				kind = "kVarArray"
+				if isCppView(reg, f, views) {
+					kind = "kView"
+				}
+				if c := f.Type.Array.Capacity(); c > 0 {
+					kind, capacity = "kBoundedArray", c
+				}
+				field, bm := reg.FindFieldByName(*f.Type.Array.Size.Variable, i)
+				if bm != nil {
+					sizeField = toCppTypes(field.Type.Bitfield.Base)
+					shift, bits = bm.StartBit(), bm.EndBit()-bm.StartBit()+1
+				} else {
+					sizeField = toCppTypes(field.Type.Simple.Name)
+				}
+				count = fmt.Sprintf("offsetof(%s, %s)", reg.Name, field.Name)
+				sizeField = fmt.Sprintf("sizeof(%s)", sizeField)
+			default:
+				typ = f.Type.Simple.Name
+				if f.IsVarint() {
+					kind = "kVarint"
+					if strings.HasPrefix(typ, "int") {
+						kind = "kZigzag"
+					}
+				}
+			}
+			descs = append(descs, fmt.Sprintf("{offsetof(%s, %s), %s, sizeof(%s), %s, %s, %d, %d, %d},",
+				reg.Name, f.Name, kind, toCppTypes(typ), count, sizeField, shift, bits, capacity))
+			if f.Constraint() != nil {
+				checks = append(checks, cppValidCheck(f))
+			}
+		}
+		if len(descs) > 0xFF {
+			return nil, fmt.Errorf("table register '%s' has too many fields", reg.Name)
+		}
+		if read {
+			t.Read, t.ReadChecks = descs, checks
+		} else {
+			t.Write, t.WriteChecks = descs, checks
+		}
+	}
+	return t, nil
+}
+
+// streamDone is the value of Stream_State::kDone, the states of the stream register fields are
+// counted below it
+const streamDone = 0xFF
+
+// cppStreamCases returns the serialization and deserialization states of the stream register
+// field i
+func cppStreamCases(reg *parser.Register, i int, f *parser.Field, host bool) ([]string, []string) {
+	name := "this->" + f.Name
+	switch {
+	case f.Type.Array != nil:
+		if host {
+			name += ".data()"
+		}
+		elemType := f.Type.Array.Type.Name
+		size := typeSize(elemType)
+		arr := name + " + st.index"
+		ser := append([]string{
+			"{",
+			fmt.Sprintf("\tsize_t n = %s;", cppStreamElems(reg, i, f)),
+		}, cppStreamCapacity(f, host, false)...)
+		ser = append(ser,
+			"\tif (st.index < n) {",
+			"\t\tsize_t k = "+cppStreamRoom(size)+";",
+			"\t\tif (k > n - st.index) k = n - st.index;",
+			"\t\t"+cppArrayEncode(elemType, arr, "k", host),
+			"\t\tst.index += k;",
+		)
+		if size > 1 {
+			// the element split between the chunks
+			ser = append(ser, fmt.Sprintf("\t\tif (st.index < n) st.len = bigendian::encode(st.scratch, %s[st.index++]);", name))
+		} else {
+			ser = append(ser, "\t\tif (st.index < n) return (int)offset;")
+		}
+		ser = append(ser, "\t\tbreak;", "\t}", "\tst.index = 0;", "\tst.field++;", "\tbreak;", "}")
+
+		deser := append([]string{
+			"{",
+			fmt.Sprintf("\tsize_t n = %s;", cppStreamElems(reg, i, f)),
+		}, cppStreamCapacity(f, host, true)...)
+		deser = append(deser, "\tif (st.index < n) {")
+		bulk := []string{
+			"size_t k = " + cppStreamRoom(size) + ";",
+			"if (k > n - st.index) k = n - st.index;",
+			cppArrayDecode(elemType, arr, "k", host),
+			"st.index += k;",
+		}
+		if size == 1 {
+			deser = append(deser, indentCpp(bulk, "\t\t")...)
+			deser = append(deser, "\t\tif (st.index < n) return (int)offset;", "\t\tbreak;")
+		} else {
+			deser = append(deser, "\t\tif (st.pos == 0) {")
+			deser = append(deser, indentCpp(bulk, "\t\t\t")...)
+			deser = append(deser,
+				"\t\t\tif (st.index == n) break;",
+				"\t\t}",
+				fmt.Sprintf("\t\tif (!(p = detail::stream_take(st, buf, size, offset, %d))) return (int)offset;", size),
+				fmt.Sprintf("\t\tbigendian::decode(%s[st.index++], p);", name),
+				"\t\tbreak;")
+		}
+		deser = append(deser, "\t}", "\tst.index = 0;", "\tst.field++;", "\tbreak;", "}")
+		return ser, deser
+	case f.Type.Simple != nil && f.IsVarint():
+		value, decoded := name, "v"
+		if strings.HasPrefix(f.Type.Simple.Name, "int") {
+			value, decoded = fmt.Sprintf("detail::zigzag(%s)", name), "detail::unzigzag(v)"
+		}
+		ser := []string{
+			fmt.Sprintf("st.len = detail::put_varint(st.scratch, %s);", value),
+			"st.field++;",
+			"break;",
+		}
+		deser := []string{
+			"if (!(p = detail::stream_take_varint(st, buf, size, offset))) return st.pos < sizeof(st.scratch) ? (int)offset : -1;",
+			"{",
+			fmt.Sprintf("\t%s v;", toCppTypes("u"+strings.TrimPrefix(f.Type.Simple.Name, "u"))),
+			"\tif (detail::get_varint(p, st.len, v) < 0) return -1;",
+			fmt.Sprintf("\t%s = %s;", name, decoded),
+			"}",
+			"st.field++;",
+			"break;",
+		}
+		return ser, deser
+	default:
+		typ := ""
+		if f.Type.Bitfield != nil {
+			typ = f.Type.Bitfield.Base
+		} else {
+			typ = f.Type.Simple.Name
+		}
+		ser := []string{
+			fmt.Sprintf("st.len = bigendian::encode(st.scratch, %s);", name),
+			"st.field++;",
+			"break;",
+		}
+		deser := []string{
+			fmt.Sprintf("if (!(p = detail::stream_take(st, buf, size, offset, %d))) return (int)offset;", typeSize(typ)),
+			fmt.Sprintf("bigendian::decode(%s, p);", name),
+			"st.field++;",
+			"break;",
+		}
+		return ser, deser
+	}
+}
+
+// cppStreamCase returns the switch case of the field state, the code of the array fields is a
+// block for the local variables
+func cppStreamCase(state int, code []string) []string {
+	if code[0] != "{" {
+		return append([]string{fmt.Sprintf("\tcase %d:", state)}, indentCpp(code, "\t\t")...)
+	}
+	res := []string{fmt.Sprintf("\tcase %d: {", state)}
+	res = append(res, indentCpp(code[1:len(code)-1], "\t")...)
+	return append(res, "\t}")
+}
+
+// cppStreamElems returns the number of elements expression of the array field i
+func cppStreamElems(reg *parser.Register, i int, f *parser.Field) string {
+	if f.Type.Array.Size.Constant != nil {
+		return *f.Type.Array.Size.Constant
+	}
+	field, bm := reg.FindFieldByName(*f.Type.Array.Size.Variable, i)
+	if bm != nil {
+		return fmt.Sprintf("(size_t)((this->%s&%s_%s_bm)>>%d)", field.Name, field.Name, bm.Name, bm.StartBit())
+	}
+	return fmt.Sprintf("(size_t)this->%s", field.Name)
+}
+
+// cppStreamCapacity returns the check of the number of elements of the bounded array, or of
+// the host vector, which the deserialization resizes instead
+func cppStreamCapacity(f *parser.Field, host, deser bool) []string {
+	switch {
+	case f.Type.Array.Capacity() > 0:
+		return []string{fmt.Sprintf("\tif (n > %d) return -1;", f.Type.Array.Capacity())}
+	case !host || f.Type.Array.Size.Constant != nil:
+		return nil
+	case deser:
+		return []string{fmt.Sprintf("\tif (st.index == 0) this->%s.resize(n);", f.Name)}
+	}
+	return []string{fmt.Sprintf("\tif (this->%s.size() < n) return -1;", f.Name)}
+}
+
+// cppStreamRoom returns the number of the array elements which fit the rest of the chunk
+func cppStreamRoom(size int) string {
+	if size == 1 {
+		return "size - offset"
+	}
+	return fmt.Sprintf("(size - offset) / %d", size)
+}
+
+func indentCpp(lines []string, indent string) []string {
+	res := make([]string, 0, len(lines))
+	for _, line := range lines {
+		res = append(res, indent+line)
+	}
+	return res
+}
+
+// cppArrayView returns the statement pointing the byte array to its data in the wire buffer
+func cppArrayView(elem, arr, n string, host bool) string {
+	if host {
+		return fmt.Sprintf("%s = std::span<const %s>(reinterpret_cast<const %s*>(buf + offset), %s); offset += %s;", arr, elem, elem, n, n)
+	}
+	if elem == "uint8_t" {
+		return fmt.Sprintf("%s = buf + offset; offset += %s;", arr, n)
+	}
+	return fmt.Sprintf("%s = reinterpret_cast<const %s*>(buf + offset); offset += %s;", arr, elem, n)
+}
+
+// wireSizeBody builds the body of the read_size/write_size function from the fields codecs
+func wireSizeBody(codecs []*CppCodec) []string {
+	static := 0
+	var dynamic []string
+	for _, c := range codecs {
+		if c.StaticSize >= 0 {
+			static += c.StaticSize
+			continue
+		}
+		dynamic = append(dynamic, fmt.Sprintf("size += %s;", c.WireSize))
+	}
+	res := []string{fmt.Sprintf("size_t size = %d;", static)}
+	res = append(res, dynamic...)
+	return append(res, "return size;")
+}
+
+// cppSizeConstant formats the wire size as a size_t constant expression. The sizes which
+// don't fit into 16 bits saturate to SIZE_MAX on the targets where size_t can't hold them.
+func cppSizeConstant(size uint64) string {
+	switch {
+	case size <= 0xFFFF:
+		return strconv.FormatUint(size, 10)
+	case size <= 0xFFFFFFFF:
+		return fmt.Sprintf("(%dUL > SIZE_MAX ? SIZE_MAX : %dUL)", size, size)
+	default:
+		return "SIZE_MAX"
+	}
+}
+
+// blockIndent returns the indentation of the bounds check for the codecs enclosed into a block
+func blockIndent(c *CppCodec) string {
+	if len(c.Epilogue) > 0 {
+		return "    "
+	}
+	return ""
 }
 
 //
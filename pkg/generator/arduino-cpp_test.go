@@ -2,6 +2,10 @@ package generator
 
 import (
 	"fmt"
+	"os"
+	"os/exec"
+	"path/filepath"
+	"strings"
 	"testing"
 
 	"github.com/dspasibenko/pargus/pkg/parser"
@@ -176,8 +180,13 @@ func TestGenerateGoWithRegisterRef(t *testing.T) {
 	require.Contains(t, res, "offset += n")
 	// In DeserializeRead we deserialize nested struct by calling DeserializeRead with error handling
 	require.Contains(t, res, "if n, err := r.config.DeserializeRead(buf[offset:]); err != nil {")
-	// Check that getNumber uses pointer API
-	require.Contains(t, res, "if err := getNumber(buf[offset:], &r.id); err != nil {")
+	// Check that the numbers are decoded in place and the static run is checked once
+	require.Contains(t, res, "r.id = binary.BigEndian.Uint16(buf[offset:])")
+	require.Contains(t, res, "if len(buf) < 8 {")
+	// Append API grows the caller buffer
+	require.Contains(t, res, "func (r *Main) AppendRead(dst []byte) ([]byte, error) {")
+	require.Contains(t, res, "dst = growBuf(dst, r.BufSize4Write())")
+	require.Contains(t, res, "func growBuf(b []byte, n int) []byte {")
 }
 
 func TestGenerateCppWithRegisterRefReadWrite(t *testing.T) {
@@ -211,3 +220,1165 @@ func TestGenerateCppWithRegisterRefReadWrite(t *testing.T) {
 	require.Contains(t, hpp, "Config write_config;")
 	require.Contains(t, cpp, "this->write_config.serialize_write")
 }
+
+func TestGenerateCppCoalescedBoundsChecks(t *testing.T) {
+	input := `
+    device test
+
+    register Config(1) {
+        mode uint8;
+        enabled uint8;
+    };
+
+    register Main(2) {
+        id uint16;
+        flags uint8{len: 0-3};
+        data [4]uint8;
+        size uint8;
+        buf [size]uint16;
+        crc uint32;
+        tail [flags_len]uint8;
+        config Config;
+        last int8;
+    };`
+
+	device, err := parser.Parse(input)
+	require.NoError(t, err)
+
+	_, cpp, err := GenerateHppCpp(device, "test", "test_h")
+	require.NoError(t, err)
+	fmt.Println(cpp)
+
+	// the fully static register is checked once at the function entry
+	require.Contains(t, cpp, "if (size < 2) return -1;\n\toffset += bigendian::encode(buf + offset, this->mode);\n\toffset += bigendian::encode(buf + offset, this->enabled);")
+	require.NotContains(t, cpp, "sizeof(this->")
+
+	// the static prefix is checked at the entry, the variable arrays are checked together with the static suffix
+	require.Contains(t, cpp, "if (size < 8) return -1;")
+	require.Contains(t, cpp, "if (offset + sizeof(uint16_t)*this->size + 4 > size) return -1;")
+	require.Contains(t, cpp, "    if (offset + sizeof(uint8_t)*elems + 3 > size) return -1;")
+}
+
+func TestGenerateCppWireSizes(t *testing.T) {
+	input := `
+    device test
+
+    register Config(1) {
+        mode uint8;
+        enabled:r uint16;
+    };
+
+    register Main(2) {
+        id uint16;
+        flags uint8{len: 0-3};
+        size uint8;
+        buf [size]uint16;
+        tail [flags_len]uint8;
+        config Config;
+    };`
+
+	device, err := parser.Parse(input)
+	require.NoError(t, err)
+
+	hpp, cpp, err := GenerateHppCpp(device, "test", "test_h")
+	require.NoError(t, err)
+	fmt.Println(hpp)
+
+	require.Contains(t, hpp, "static constexpr size_t kReadWireSize = 3;")
+	require.Contains(t, hpp, "static constexpr size_t kWriteWireSize = 1;")
+	require.Contains(t, hpp, "size_t read_size() const { return kReadWireSize; }")
+
+	// 2 + 1 + 1 + 255*2 + 15 + 3
+	require.Contains(t, hpp, "static constexpr size_t kReadWireSizeMax = 532;")
+	require.Contains(t, hpp, "static constexpr size_t kWriteWireSizeMax = 530;")
+	require.NotContains(t, hpp, "static constexpr size_t kReadWireSize = -1;")
+	require.Contains(t, hpp, "static constexpr size_t Max_Wire_Size = 532;")
+	require.Contains(t, cpp, "size_t Main::read_size() const {\n\tsize_t size = 7;\n\tsize += sizeof(uint16_t)*this->size;\n\tsize += sizeof(uint8_t)*((this->flags&flags_len_bm)>>0);\n\treturn size;\n}")
+	require.NotContains(t, cpp, "Config::read_size")
+
+	require.Equal(t, "(131070UL > SIZE_MAX ? SIZE_MAX : 131070UL)", cppSizeConstant(131070))
+	require.Equal(t, "SIZE_MAX", cppSizeConstant(1<<40))
+}
+
+func TestGenerateCppHeaderOnly(t *testing.T) {
+	input := `
+    device test
+
+    register Config(1) {
+        mode uint8;
+    };
+
+    register Main(2) {
+        size uint8;
+        buf [size]uint16;
+        config Config;
+    };`
+
+	device, err := parser.Parse(input)
+	require.NoError(t, err)
+
+	hpp, cpp, err := GenerateHppCppWithOptions(device, "test", "test.h", CppOptions{HeaderOnly: true})
+	require.NoError(t, err)
+	fmt.Println(hpp)
+
+	require.Empty(t, cpp)
+	require.Contains(t, hpp, "#include \"bigendian.h\"")
+	require.NotContains(t, hpp, "#include \"test.h\"")
+	require.Contains(t, hpp, "inline size_t Main::read_size() const {")
+	require.Contains(t, hpp, "inline int Main::serialize_read(uint8_t* buf, size_t size) const {")
+	require.Contains(t, hpp, "inline int Config::deserialize_write(const uint8_t* buf, size_t size) {")
+	require.Contains(t, hpp, "this->config.serialize_read(buf + offset, size - offset)")
+	require.True(t, strings.HasSuffix(hpp, "} // namespace test\n"))
+
+	// the default mode keeps the definitions in the .cpp file
+	hpp, cpp, err = GenerateHppCpp(device, "test", "test.h")
+	require.NoError(t, err)
+	require.NotContains(t, hpp, "bigendian.h")
+	require.NotContains(t, hpp, "inline")
+	require.Contains(t, cpp, "int Main::serialize_read(uint8_t* buf, size_t size) const {")
+}
+
+func TestGenerateCppArrayKernels(t *testing.T) {
+	input := `
+    device test
+
+    register Bytes(1) {
+        data [64]uint8;
+        size uint8;
+        payload [size]int8;
+    };
+
+    register Samples(2) {
+        flags uint8{len: 0-3};
+        samples [8]int16;
+        values [flags_len]float32;
+    };`
+
+	device, err := parser.Parse(input)
+	require.NoError(t, err)
+
+	_, cpp, err := GenerateHppCpp(device, "test", "test_h")
+	require.NoError(t, err)
+	fmt.Println(cpp)
+
+	// byte-sized elements are copied as is
+	require.Contains(t, cpp, "memcpy(buf + offset, this->data, 64); offset += 64;")
+	require.Contains(t, cpp, "memcpy(this->data, buf + offset, 64); offset += 64;")
+	require.Contains(t, cpp, "memcpy(buf + offset, this->payload, this->size); offset += this->size;")
+
+	// wider elements go through the bulk codec
+	require.Contains(t, cpp, "offset += detail::encode_array(buf + offset, this->samples, 8);")
+	require.Contains(t, cpp, "offset += detail::decode_array(this->samples, buf + offset, 8);")
+	require.Contains(t, cpp, "    offset += detail::encode_array(buf + offset, this->values, elems);")
+	require.Contains(t, cpp, "inline size_t encode_array(uint8_t* buf, const T* arr, size_t n) {")
+	require.NotContains(t, cpp, "bigendian::encode(buf + offset, this->samples)")
+
+	// the kernels are emitted only when they are used
+	device, err = parser.Parse(`
+    device test
+
+    register Bytes(1) {
+        data [4]uint8;
+    };`)
+	require.NoError(t, err)
+	_, cpp, err = GenerateHppCpp(device, "test", "test_h")
+	require.NoError(t, err)
+	require.NotContains(t, cpp, "namespace detail")
+}
+
+func TestGenerateCppViews(t *testing.T) {
+	input := `
+    device test
+
+    register Log(1) {
+        size uint16;
+        data [size]uint8;
+        flags uint8{len: 0-3};
+        text [flags_len]int8;
+        values [size]uint16;
+    };`
+
+	device, err := parser.Parse(input)
+	require.NoError(t, err)
+
+	hpp, cpp, err := GenerateHppCppWithOptions(device, "test", "test_h", CppOptions{Views: true})
+	require.NoError(t, err)
+	fmt.Println(hpp)
+	fmt.Println(cpp)
+
+	require.Contains(t, hpp, "const uint8_t* data;")
+	require.Contains(t, hpp, "const int8_t* text;")
+	require.Contains(t, cpp, "this->data = buf + offset; offset += this->size;")
+	require.Contains(t, cpp, "    this->text = reinterpret_cast<const int8_t*>(buf + offset); offset += elems;")
+	require.Contains(t, cpp, "memcpy(buf + offset, this->data, this->size); offset += this->size;")
+
+	// wider elements are still copied
+	require.Contains(t, hpp, "uint16_t* values;")
+	require.Contains(t, cpp, "offset += detail::decode_array(this->values, buf + offset, this->size);")
+}
+
+func TestGenerateCppDispatch(t *testing.T) {
+	input := `
+    device test
+
+    register Status(1):r {
+        value uint8;
+    };
+
+    register Log(3) {
+        size uint16;
+        data [size]uint8;
+    };`
+
+	device, err := parser.Parse(input)
+	require.NoError(t, err)
+
+	hpp, cpp, err := GenerateHppCppWithOptions(device, "test", "test_h", CppOptions{Dispatch: true})
+	require.NoError(t, err)
+	fmt.Println(hpp)
+	fmt.Println(cpp)
+
+	require.Contains(t, hpp, "class Handler {")
+	require.Contains(t, hpp, "virtual bool on_read_Status(Status& /*reg*/) { return false; }")
+	require.NotContains(t, hpp, "on_write_Status")
+	require.Contains(t, hpp, "virtual bool prepare_write_Log(Log& /*reg*/) { return false; }")
+	require.Contains(t, hpp, "int dispatch_read(uint8_t id, Handler& handler, uint8_t* buf, size_t size);")
+	require.Contains(t, hpp, "int dispatch_write(uint8_t id, Handler& handler, const uint8_t* buf, size_t size);")
+
+	require.Contains(t, cpp, "\tif (!handler.prepare_write_Log(reg)) return -1;")
+	require.Contains(t, cpp, "static const detail::Read_Thunk table[Max_Reg_ID + 1] PROGMEM = {\n"+
+		"\t\tnullptr,\n\t\tdetail::read_Status,\n\t\tnullptr,\n\t\tdetail::read_Log,\n\t};")
+	require.Contains(t, cpp, "static const detail::Write_Thunk table[Max_Reg_ID + 1] PROGMEM = {\n"+
+		"\t\tnullptr,\n\t\tnullptr,\n\t\tnullptr,\n\t\tdetail::write_Log,\n\t};")
+
+	// no storage is needed for the byte arrays in the views mode
+	hpp, _, err = GenerateHppCppWithOptions(device, "test", "test_h", CppOptions{Dispatch: true, Views: true})
+	require.NoError(t, err)
+	require.NotContains(t, hpp, "prepare_write_Log")
+}
+
+func TestGenerateBatch(t *testing.T) {
+	input := `
+    device test
+
+    register Status(1):r {
+        value uint8;
+    };
+
+    register Log(3) {
+        size uint16;
+        data [size]uint8;
+    };`
+
+	device, err := parser.Parse(input)
+	require.NoError(t, err)
+
+	// batch implies dispatch
+	hpp, cpp, err := GenerateHppCppWithOptions(device, "test", "test_h", CppOptions{Batch: true})
+	require.NoError(t, err)
+	fmt.Println(hpp)
+	fmt.Println(cpp)
+
+	require.Contains(t, hpp, "static constexpr uint8_t kRegId = Reg_Log_ID;")
+	require.Contains(t, hpp, "class Handler {")
+	require.Contains(t, hpp, "int dispatch_read_batch(Handler& handler, const uint8_t* req, size_t req_size, uint8_t* buf, size_t size);")
+	require.Contains(t, hpp, "class Batch_Writer {")
+	require.Contains(t, hpp, "const uint8_t* p = next(T::kRegId, T::kReadWireSizeMax, len);")
+	require.Contains(t, cpp, "int res = dispatch_read(req[1 + i], handler, buf + offset + kBatchEntryHeaderSize, room);")
+	require.Contains(t, cpp, "int res = dispatch_write(buf[offset], handler, buf + offset + kBatchEntryHeaderSize, len);")
+
+	hpp, _, err = GenerateHppCppWithOptions(device, "test", "test_h", CppOptions{Dispatch: true})
+	require.NoError(t, err)
+	require.NotContains(t, hpp, "Batch_Writer")
+
+	goCode, err := GenerateGoWithOptions(device, "test", GoOptions{Batch: true})
+	require.NoError(t, err)
+	fmt.Println(goCode)
+	require.Contains(t, goCode, "const Reg_Log_ID uint8 = 3")
+	require.Contains(t, goCode, "type Register interface {")
+	require.Contains(t, goCode, "    case Reg_Status_ID:\n        return &Status{}")
+	require.Contains(t, goCode, "    case Reg_Log_ID:\n        if read {\n            return 65537\n        }\n        return 65537")
+	require.Contains(t, goCode, "func DecodeReadBatch(buf []byte, regs ...Register) (int, error) {")
+
+	goCode, err = GenerateGo(device, "test")
+	require.NoError(t, err)
+	require.NotContains(t, goCode, "Register interface")
+}
+
+func TestGenerateStream(t *testing.T) {
+	input := `
+    device test
+
+    register Samples(1):r stream {
+        count uint16 varint;
+        values [count]int16;
+        raw [count]uint8;
+    };
+
+    register Plain(2) {
+        size uint8;
+        data [size]uint8;
+    };`
+
+	device, err := parser.Parse(input)
+	require.NoError(t, err)
+
+	hpp, cpp, err := GenerateHppCppWithOptions(device, "test", "test_h", CppOptions{Views: true})
+	require.NoError(t, err)
+	fmt.Println(hpp)
+	fmt.Println(cpp)
+
+	require.Contains(t, hpp, "struct Stream_State {")
+	require.Contains(t, hpp, "int serialize_read_chunk(Stream_State& st, uint8_t* buf, size_t size) const;")
+	require.Contains(t, hpp, "int deserialize_read_chunk(Stream_State& st, const uint8_t* buf, size_t size);")
+	// the stream registers copy the byte arrays, the views are transient
+	require.Contains(t, hpp, "    uint8_t* raw;")
+	require.Contains(t, hpp, "    const uint8_t* data;")
+	require.Contains(t, cpp, "inline const uint8_t* stream_take(Stream_State& st, const uint8_t* buf, size_t size, size_t& offset, uint8_t n) {")
+	require.Contains(t, cpp, "\t\tcase 1: {\n\t\t\tsize_t n = (size_t)this->count;")
+	require.Contains(t, cpp, "\t\t\t\toffset += detail::encode_array(buf + offset, this->values + st.index, k);")
+	require.Contains(t, cpp, "\t\t\t\tif (st.index < n) st.len = bigendian::encode(st.scratch, this->values[st.index++]);")
+	require.Contains(t, cpp, "\t\t\tst.len = detail::put_varint(st.scratch, this->count);")
+	require.Contains(t, cpp, "\t\t\tif (!(p = detail::stream_take_varint(st, buf, size, offset))) return st.pos < sizeof(st.scratch) ? (int)offset : -1;")
+	require.NotContains(t, cpp, "Plain::serialize_read_chunk")
+}
+
+func TestGenerateTable(t *testing.T) {
+	input := `
+    device test
+
+    register Config(1) table {
+        flags uint8{on: 0, len: 1-4};
+        gain int16;
+        counter uint32 varint;
+        coeffs [3]float32;
+        name [flags_len]uint8;
+        status:r uint8;
+    };
+
+    register Plain(2) {
+        mode uint8;
+    };`
+
+	device, err := parser.Parse(input)
+	require.NoError(t, err)
+
+	_, cpp, err := GenerateHppCppWithOptions(device, "test", "test_h", CppOptions{Views: true})
+	require.NoError(t, err)
+	fmt.Println(cpp)
+
+	require.Contains(t, cpp, "int table_serialize(const Field_Desc* table, uint8_t n, const void* reg, uint8_t* buf, size_t size) {")
+	require.Contains(t, cpp, "inline int table_put_varint(uint8_t* buf, size_t size, const uint8_t* p, const Field_Desc& d) {")
+	require.Contains(t, cpp, "const Field_Desc* Config_read_fields() {\n\tstatic_assert(sizeof(Config) <= 0xFFFF, \"the table register is too big\");\n\tstatic const Field_Desc fields[] PROGMEM = {")
+	require.Contains(t, cpp, "\t\t{offsetof(Config, flags), kScalar, sizeof(uint8_t), 0, 0, 0, 0, 0},")
+	require.Contains(t, cpp, "\t\t{offsetof(Config, counter), kVarint, sizeof(uint32_t), 0, 0, 0, 0, 0},")
+	require.Contains(t, cpp, "\t\t{offsetof(Config, coeffs), kArray, sizeof(float), 3, 0, 0, 0, 0},")
+	require.Contains(t, cpp, "\t\t{offsetof(Config, name), kView, sizeof(uint8_t), offsetof(Config, flags), sizeof(uint8_t), 1, 4, 0},")
+	require.Contains(t, cpp, "\t\t{offsetof(Config, status), kScalar, sizeof(uint8_t), 0, 0, 0, 0, 0},")
+	require.Contains(t, cpp, "int Config::serialize_read(uint8_t* buf, size_t size) const {\n\treturn detail::table_serialize(detail::Config_read_fields(), 6, this, buf, size);\n}")
+	require.Contains(t, cpp, "int Config::deserialize_write(const uint8_t* buf, size_t size) {\n\treturn detail::table_deserialize(detail::Config_write_fields(), 5, this, buf, size);\n}")
+	require.Contains(t, cpp, "int Plain::serialize_read(uint8_t* buf, size_t size) const {\n\tint offset = 0;")
+	require.NotContains(t, cpp, "Plain_read_fields")
+}
+
+func TestGenerateSortFields(t *testing.T) {
+	input := `
+    device test
+
+    register Inner(1) {
+        x uint8;
+        y uint16;
+    };
+
+    register R(2) {
+        a uint8;
+        b uint32;
+        c uint8;
+        d uint16;
+        inner Inner;
+        size uint8;
+        data [size]int16;
+    };
+
+    register Hex(3) {
+        a uint8;
+        buf [0x4]uint32;
+    };`
+
+	device, err := parser.Parse(input)
+	require.NoError(t, err)
+
+	hpp, _, err := GenerateHppCppWithOptions(device, "test", "test_h", CppOptions{SortFields: true})
+	require.NoError(t, err)
+	fmt.Println(hpp)
+
+	require.Contains(t, hpp, "    // sizeof is 20 bytes on the 32-bit targets, 24 bytes in the declaration order\n"+
+		"    uint32_t b;\n    int16_t* data;\n    uint16_t d;\n    Inner inner;\n    uint8_t a;\n    uint8_t c;\n    uint8_t size;\n")
+	// the wire order doesn't change
+	require.Contains(t, hpp, "static constexpr size_t kReadWireSizeMax = 522;")
+
+	// the hex array size
+	require.Contains(t, hpp, "    // sizeof is 20 bytes on the 32-bit targets, 20 bytes in the declaration order\n    uint32_t buf[0x4];\n    uint8_t a;\n")
+
+	require.Equal(t, []CppStructSize{{"Inner", 4, 4}, {"R", 24, 20}, {"Hex", 20, 20}}, CppStructSizes(device))
+}
+
+func TestGenerateBoundedArray(t *testing.T) {
+	input := `
+    device test
+
+    register Frame(1) {
+        flags uint8{on: 0, len: 1-4};
+        name [flags_len<=8]uint8;
+        count uint16;
+        samples [count<=32]int16;
+    };`
+
+	device, err := parser.Parse(input)
+	require.NoError(t, err)
+
+	hpp, cpp, err := GenerateHppCppWithOptions(device, "test", "test_h", CppOptions{Views: true})
+	require.NoError(t, err)
+	fmt.Println(hpp)
+	fmt.Println(cpp)
+
+	// the bounded arrays are stored in the register, even with the views
+	require.Contains(t, hpp, "    uint8_t name[8];")
+	require.Contains(t, hpp, "    int16_t samples[32];")
+	require.Contains(t, hpp, "static constexpr size_t kReadWireSizeMax = 75;")
+	require.NotContains(t, hpp, "prepare_write")
+	require.Contains(t, cpp, "\t    uint8_t elems = (this->flags&flags_len_bm)>>1;\n\t    if (elems > 8) return -1;")
+	require.Contains(t, cpp, "\tif ((size_t)this->count > 32) return -1;\n\tif (offset + sizeof(int16_t)*this->count > size) return -1;")
+
+	code, err := GenerateGo(device, "test")
+	require.NoError(t, err)
+	fmt.Println(code)
+	require.Contains(t, code, "if int(r.count) > 32 {\n        return offset, fmt.Errorf(\"array samples has %d elements, the capacity is 32\", int(r.count))")
+	require.Contains(t, code, "if len(r.samples) > 32 {")
+}
+
+func TestGenerateWireOffsets(t *testing.T) {
+	input := `
+    device test
+
+    register Ctl(1) {
+        status:r uint8;
+        flags uint8{on: 0};
+        id:w uint16;
+        data [3]uint8;
+        size uint8;
+        buf [size]uint8;
+        tail uint8;
+    };
+
+    register Bits(2) packed {
+        mode uint8 bits(2);
+    };`
+
+	device, err := parser.Parse(input)
+	require.NoError(t, err)
+
+	hpp, cpp, err := GenerateHppCpp(device, "test", "test_h")
+	require.NoError(t, err)
+	fmt.Println(hpp)
+
+	require.Contains(t, hpp, "    static constexpr size_t wire_offset_status = 0;\n"+
+		"    static constexpr size_t read_wire_offset_flags = 1;\n"+
+		"    static constexpr size_t write_wire_offset_flags = 0;\n"+
+		"    static constexpr size_t wire_offset_id = 1;\n"+
+		"    static constexpr size_t read_wire_offset_data = 2;\n"+
+		"    static constexpr size_t write_wire_offset_data = 3;\n"+
+		"    static constexpr size_t read_wire_offset_size = 5;\n"+
+		"    static constexpr size_t write_wire_offset_size = 6;\n"+
+		"    static constexpr size_t read_wire_offset_buf = 6;\n"+
+		"    static constexpr size_t write_wire_offset_buf = 7;\n")
+	require.NotContains(t, hpp, "wire_offset_tail")
+	require.Contains(t, hpp, "\tstatic uint16_t peek_id(const uint8_t* buf);\n\tstatic void poke_id(uint8_t* buf, uint16_t v);")
+	require.NotContains(t, hpp, "peek_read_data")
+	require.NotContains(t, hpp, "wire_offset_mode")
+	require.Contains(t, cpp, "uint8_t Ctl::peek_read_flags(const uint8_t* buf) {\n\tuint8_t v;\n\tbigendian::decode(v, buf + read_wire_offset_flags);\n\treturn v;\n}")
+	require.Contains(t, cpp, "void Ctl::poke_write_size(uint8_t* buf, uint8_t v) {\n\tbigendian::encode(buf + write_wire_offset_size, v);\n}")
+}
+
+func TestGeneratePacked(t *testing.T) {
+	input := `
+    device test
+
+    register Status(1) packed {
+        mode uint8 bits(2);
+        temp int16 bits(10);
+        level:w uint8 bits(3);
+        flags uint8{on: 0, err: 1} bits(2);
+    };`
+
+	device, err := parser.Parse(input)
+	require.NoError(t, err)
+
+	hpp, cpp, err := GenerateHppCpp(device, "test", "test_h")
+	require.NoError(t, err)
+	fmt.Println(hpp)
+	fmt.Println(cpp)
+
+	// 14 read bits and 17 write bits
+	require.Contains(t, hpp, "static constexpr size_t kReadWireSize = 2;")
+	require.Contains(t, hpp, "static constexpr size_t kWriteWireSize = 3;")
+	require.Contains(t, cpp, "inline void put_bits(uint8_t* buf, size_t pos, uint8_t n, uint32_t v) {")
+	require.Contains(t, cpp, "\tif (size < 2) return -1;\n"+
+		"\tmemset(buf + offset, 0, 2);\n"+
+		"\tdetail::put_bits(buf + offset, 0, 2, static_cast<uint32_t>(this->mode));\n"+
+		"\tdetail::put_bits(buf + offset, 2, 10, static_cast<uint32_t>(this->temp));\n"+
+		"\tdetail::put_bits(buf + offset, 12, 2, static_cast<uint32_t>(this->flags));\n"+
+		"\toffset += 2;\n")
+	require.Contains(t, cpp, "this->temp = static_cast<int16_t>(detail::sign_extend(detail::get_bits(buf + offset, 2, 10), 10));")
+	require.Contains(t, cpp, "this->flags = static_cast<uint8_t>(detail::get_bits(buf + offset, 15, 2));\n\toffset += 3;")
+
+	goCode, err := GenerateGo(device, "test")
+	require.NoError(t, err)
+	fmt.Println(goCode)
+
+	require.Contains(t, goCode, "func putBits(b []byte, pos, n int, v uint64) {")
+	require.Contains(t, goCode, "clear(buf[offset : offset+2])")
+	require.Contains(t, goCode, "putBits(buf[offset:], 12, 3, uint64(r.level))")
+	require.Contains(t, goCode, "r.temp = int16(signExtend(getBits(buf[offset:], 2, 10), 10))")
+	require.Contains(t, goCode, "size := 3\n")
+}
+
+func TestGenerateVarint(t *testing.T) {
+	input := `
+    device test
+
+    register Telemetry(1):r {
+        counter uint32 varint;
+        delta int16 varint;
+        status uint8;
+    };`
+
+	device, err := parser.Parse(input)
+	require.NoError(t, err)
+
+	hpp, cpp, err := GenerateHppCpp(device, "test", "test_h")
+	require.NoError(t, err)
+	fmt.Println(hpp)
+	fmt.Println(cpp)
+
+	// 5 and 3 bytes the biggest varints and a byte
+	require.Contains(t, hpp, "static constexpr size_t kReadWireSizeMax = 9;")
+	require.Contains(t, hpp, "size_t read_size() const;")
+	require.Contains(t, cpp, "inline int get_varint(const uint8_t* buf, size_t size, T& v) {")
+	require.Contains(t, cpp, "\tif (offset + detail::varint_size(this->counter) > size) return -1;\n"+
+		"\toffset += detail::put_varint(buf + offset, this->counter);\n"+
+		"\tif (offset + detail::varint_size(detail::zigzag(this->delta)) + 1 > size) return -1;\n")
+	require.Contains(t, cpp, "\t{uint16_t v; int res = detail::get_varint(buf + offset, size - offset, v); if (res < 0) return -1; this->delta = detail::unzigzag(v); offset += res;}\n"+
+		"\tif (size - offset < 1) return -1;\n")
+
+	goCode, err := GenerateGo(device, "test")
+	require.NoError(t, err)
+	fmt.Println(goCode)
+
+	require.Contains(t, goCode, "offset += binary.PutUvarint(buf[offset:], zigzag(int64(r.delta)))")
+	require.Contains(t, goCode, "if v, n, err := getVarint(buf[offset:], 32); err != nil {")
+	require.Contains(t, goCode, "r.delta = int16(unzigzag(v))")
+	require.Contains(t, goCode, "size += varintSize(uint64(r.counter))")
+}
+
+func TestGenerateDelta(t *testing.T) {
+	input := `
+    device test
+
+    register Calibration(1) delta {
+        mode uint8;
+        status:r uint8;
+        size uint16;
+        table [size]int16;
+    };`
+
+	device, err := parser.Parse(input)
+	require.NoError(t, err)
+
+	hpp, cpp, err := GenerateHppCpp(device, "test", "test_h")
+	require.NoError(t, err)
+	fmt.Println(hpp)
+	fmt.Println(cpp)
+
+	require.Contains(t, hpp, "static constexpr size_t kDirtyMaskSize = 1;")
+	require.Contains(t, hpp, "static constexpr uint8_t table_dirty = 2;")
+	require.NotContains(t, hpp, "status_dirty")
+	require.Contains(t, hpp, "int serialize_write_delta(uint8_t* buf, size_t size) const;")
+	require.Contains(t, cpp, "\tif ((mask[0] & 0x04) || (mask[0] & 0x02)) { mask[0] |= 0x04; mask[0] |= 0x02; }\n")
+	require.Contains(t, cpp, "\tif (!(mask[0] & 0x04) != !(mask[0] & 0x02)) return -1;\n")
+	require.Contains(t, cpp, "\tif (mask[0] & 0x01) {\n"+
+		"\t\tif (size - offset < 1) return -1;\n"+
+		"\t\toffset += bigendian::encode(buf + offset, this->mode);\n"+
+		"\t}\n")
+	require.Contains(t, cpp, "\tmemcpy(this->dirty, mask, 1);\n")
+
+	goCode, err := GenerateGo(device, "test")
+	require.NoError(t, err)
+	fmt.Println(goCode)
+
+	require.Contains(t, goCode, "dirty [1]byte")
+	require.Contains(t, goCode, "const Calibration_table_dirty = 2")
+	require.Contains(t, goCode, "    r.size = v\n    r.dirty[0] |= 0x02\n")
+	require.Contains(t, goCode, "func (r *Calibration) SerializeWriteDelta(buf []byte) (int, error) {")
+	require.Contains(t, goCode, "    if mask[0]&0x04 != 0 {\n        size += (int(r.size) * 2)\n    }")
+}
+
+func TestGenerateCrc(t *testing.T) {
+	input := `
+    device test
+
+    register Frame(1) {
+        a uint16;
+        size uint8;
+        data [size]uint8;
+    };
+
+    register Bits(2) packed {
+        mode uint8 bits(2);
+    };`
+
+	device, err := parser.Parse(input)
+	require.NoError(t, err)
+
+	_, _, err = GenerateHppCppWithOptions(device, "test", "test_h", CppOptions{Crc: "crc64"})
+	require.Error(t, err)
+
+	hpp, cpp, err := GenerateHppCppWithOptions(device, "test", "test_h", CppOptions{Crc: "crc16"})
+	require.NoError(t, err)
+	fmt.Println(cpp)
+
+	require.Contains(t, hpp, "static constexpr size_t Crc_Size = 2;")
+	require.Contains(t, hpp, "\tint deserialize_write_crc(const uint8_t* buf, size_t size);")
+	require.Contains(t, cpp, "typedef uint16_t crc_t;\nstatic constexpr crc_t kCrcInit = 0xFFFF;")
+	// the checksum is updated after every run of the fields
+	require.Contains(t, cpp, "int Frame::serialize_read_crc(uint8_t* buf, size_t size) const {\n"+
+		"\tint offset = 0;\n\tint mark = 0;\n\tdetail::crc_t crc = detail::kCrcInit;\n"+
+		"\tif (size < 3) return -1;\n"+
+		"\toffset += bigendian::encode(buf + offset, this->a);\n"+
+		"\toffset += bigendian::encode(buf + offset, this->size);\n"+
+		"\tcrc = detail::crc_update(crc, buf + mark, offset - mark); mark = offset;\n")
+	require.Contains(t, cpp, "\tif (size - offset < Crc_Size) return -1;\n"+
+		"\toffset += bigendian::encode(buf + offset, (detail::crc_t)(crc ^ detail::kCrcXorOut));\n\treturn offset;\n}")
+	require.Contains(t, cpp, "int Bits::deserialize_write_crc(const uint8_t* buf, size_t size) {\n"+
+		"\tint offset = deserialize_write(buf, size);\n\tif (offset < 0) return -1;\n"+
+		"\tdetail::crc_t crc = detail::crc_update(detail::kCrcInit, buf, offset);\n")
+
+	hpp, _, err = GenerateHppCpp(device, "test", "test_h")
+	require.NoError(t, err)
+	require.NotContains(t, hpp, "_crc")
+
+	code, err := GenerateGoWithOptions(device, "test", GoOptions{Crc: "crc32"})
+	require.NoError(t, err)
+	require.Contains(t, code, "\"hash/crc32\"")
+	require.Contains(t, code, "const CrcSize = 4")
+	require.Contains(t, code, "func (r *Frame) DeserializeReadCrc(buf []byte) (int, error) {")
+	require.Contains(t, code, "\treturn crc32.ChecksumIEEE(p)")
+
+	code, err = GenerateGoWithOptions(device, "test", GoOptions{Crc: "crc8"})
+	require.NoError(t, err)
+	require.NotContains(t, code, "hash/crc32")
+	require.Contains(t, code, "crc = crcTable[byte(crc)^b]")
+}
+
+func TestGenerateStats(t *testing.T) {
+	input := `
+    device test
+
+    register Frame(1) {
+        a uint16;
+        size uint8;
+        data [size]uint8;
+    };
+
+    register Cfg(2) table {
+        mode uint8;
+    };`
+
+	device, err := parser.Parse(input)
+	require.NoError(t, err)
+
+	hpp, cpp, err := GenerateHppCppWithOptions(device, "test", "test_h", CppOptions{Stats: true})
+	require.NoError(t, err)
+	fmt.Println(cpp)
+
+	require.Contains(t, hpp, "#ifdef PARGUS_STATS\n")
+	require.Contains(t, hpp, "\nRegister_Stats* stats();\n#endif")
+	require.NotContains(t, hpp, "inline")
+	require.Contains(t, cpp, "#define PARGUS_COUNT(codec, res) detail::count_codec(stats()[kRegId].codec, (res))\n"+
+		"#else\n#define PARGUS_COUNT(codec, res) (res)\n#endif")
+	require.Contains(t, cpp, "\tif (size < 3) return PARGUS_COUNT(serialize_read, -1);\n")
+	require.Contains(t, cpp, "\treturn PARGUS_COUNT(deserialize_write, offset);\n}")
+	require.Contains(t, cpp, "\treturn PARGUS_COUNT(serialize_read, detail::table_serialize(detail::Cfg_read_fields(), 1, this, buf, size));")
+
+	hpp, cpp, err = GenerateHppCpp(device, "test", "test_h")
+	require.NoError(t, err)
+	require.NotContains(t, hpp, "PARGUS_STATS")
+	require.NotContains(t, cpp, "PARGUS_COUNT")
+
+	code, err := GenerateGoWithOptions(device, "test", GoOptions{Stats: true})
+	require.NoError(t, err)
+	require.Contains(t, code, "func SetHook(h Hook) {")
+	require.Contains(t, code, "func (r *Frame) SerializeRead(buf []byte) (int, error) {\n"+
+		"    n, err := r.serializeRead(buf)\n"+
+		"    if hook != nil {\n"+
+		"        hook.OnCodec(1, CodecSerializeRead, n, err)\n")
+}
+
+func TestGenerateConstraints(t *testing.T) {
+	input := `
+    device test
+
+    register Cfg(1) {
+        mode uint8 min(1) max(5);
+        state int8 enum(-1, 0, 2);
+        size uint8 max(4);
+        data [size]int16;
+    };
+
+    register Tab(2) table {
+        gain uint16 min(10);
+    };`
+
+	device, err := parser.Parse(input)
+	require.NoError(t, err)
+
+	hpp, cpp, err := GenerateHppCpp(device, "test", "test_h")
+	require.NoError(t, err)
+	fmt.Println(cpp)
+
+	require.Contains(t, hpp, "    static constexpr bool valid_mode(uint8_t v) { return v >= 1u && v <= 5u; }\n")
+	require.Contains(t, hpp, "    static constexpr bool valid_state(int8_t v) { return v == -1 || v == 0 || v == 2; }\n")
+	require.Contains(t, cpp, "\toffset += bigendian::decode(this->size, buf + offset);\n"+
+		"\tif (!valid_size(this->size)) return -1;\n"+
+		"\tif (offset + sizeof(int16_t)*this->size > size) return -1;\n")
+	require.Contains(t, cpp, "\tint offset = detail::table_deserialize(detail::Tab_write_fields(), 1, this, buf, size);\n"+
+		"\tif (offset < 0) return -1;\n"+
+		"\tif (!valid_gain(this->gain)) return -1;\n"+
+		"\treturn offset;\n")
+	require.NotContains(t, cpp, "serialize_read(uint8_t* buf, size_t size) const {\n\tint offset = detail::table")
+
+	code, err := GenerateGo(device, "test")
+	require.NoError(t, err)
+	require.Contains(t, code, "    if r.mode < 1 || r.mode > 5 {\n"+
+		"        return fmt.Errorf(\"field mode value %d violates min 1, max 5\", r.mode)\n")
+	require.Contains(t, code, "    if r.state != -1 && r.state != 0 && r.state != 2 {\n"+
+		"        return offset, fmt.Errorf(\"field state value %d is not one of -1, 0, 2\", r.state)\n")
+}
+
+func TestGenerateHost(t *testing.T) {
+	input := `
+    device test
+
+    register Samples(1) {
+        n uint16;
+        values [n]int16;
+        gains [4]float32;
+    };`
+
+	device, err := parser.Parse(input)
+	require.NoError(t, err)
+
+	hpp, cpp, err := GenerateHppCppWithOptions(device, "test", "test_h", CppOptions{Host: true})
+	require.NoError(t, err)
+	fmt.Println(cpp)
+
+	require.NotContains(t, hpp, "Arduino.h")
+	require.NotContains(t, cpp, "bigendian.h")
+	require.Contains(t, hpp, "#ifndef PARGUS_HOST_PRELUDE\n")
+	require.Contains(t, cpp, "#include \"test_h\"\n#if defined(__AVX2__) || defined(__SSSE3__)\n#include <immintrin.h>\n")
+	require.Contains(t, cpp, "_mm256_shuffle_epi8(v, mask32)")
+	require.Contains(t, cpp, "vrev16q_u8(v)")
+	require.Contains(t, cpp, "\tthis->values.resize(this->n);\n\toffset += detail::decode_array(this->values.data(), buf + offset, this->n);\n")
+	require.Contains(t, cpp, "\tif (this->values.size() < (size_t)this->n) return -1;\n")
+	require.Contains(t, hpp, "    std::pmr::vector<int16_t> values;\n    std::array<float, 4> gains{};\n")
+	require.Contains(t, hpp, "    explicit Samples(std::pmr::memory_resource* mr) : values(mr) {}\n")
+
+	hpp, cpp, err = GenerateHppCppWithOptions(device, "test", "test_h", CppOptions{Host: true, HeaderOnly: true})
+	require.NoError(t, err)
+	require.Empty(t, cpp)
+	require.Contains(t, hpp, "#include <immintrin.h>")
+	require.Contains(t, hpp, "inline void swap_copy(uint8_t* dst, const uint8_t* src, size_t n) {")
+
+	code, err := GenerateGoWithOptions(device, "test", GoOptions{Unsafe: true})
+	require.NoError(t, err)
+	require.Contains(t, code, "    \"math/bits\"\n    \"unsafe\"\n)")
+	require.Contains(t, code, "    getSlice(r.values, buf[offset:])\n")
+	require.Contains(t, code, "    putSlice(buf[offset:], r.gains[:])\n")
+	require.Contains(t, code, "func swapBytes(b []byte, w int) {")
+
+	code, err = GenerateGo(device, "test")
+	require.NoError(t, err)
+	require.NotContains(t, code, "unsafe")
+}
+
+func TestGenerateHostDelta(t *testing.T) {
+	input := `
+    device test
+
+    register Del(1) delta {
+        mode uint8;
+        n uint8;
+        data [n]uint8;
+    };`
+
+	device, err := parser.Parse(input)
+	require.NoError(t, err)
+
+	hpp, cpp, err := GenerateHppCppWithOptions(device, "test", "test_h", CppOptions{Host: true})
+	require.NoError(t, err)
+	fmt.Println(cpp)
+
+	// the host registers are initialized, the dirty mask too
+	require.Contains(t, hpp, "    uint8_t dirty[kDirtyMaskSize]{};\n")
+	require.Contains(t, hpp, "#include <algorithm>\n")
+	// data() of the empty vector may be null, which memcpy doesn't accept
+	require.Contains(t, cpp, "\tstd::copy_n(this->data.data(), this->n, buf + offset); offset += this->n;\n")
+	require.Contains(t, cpp, "\tstd::copy_n(buf + offset, this->n, this->data.data()); offset += this->n;\n")
+	require.NotContains(t, cpp, "memcpy(this->data")
+
+	hpp, cpp, err = GenerateHppCpp(device, "test", "test_h")
+	require.NoError(t, err)
+	require.Contains(t, hpp, "    uint8_t dirty[kDirtyMaskSize];\n")
+	require.Contains(t, cpp, "\tmemcpy(this->data, buf + offset, this->n); offset += this->n;\n")
+}
+
+// TestCppHostRun builds testdata/host/host_test.cpp with the host code generated from
+// testdata/host/host.pa and runs it, with the undefined behavior sanitizer if the compiler has it
+func TestCppHostRun(t *testing.T) {
+	cxx, err := exec.LookPath("c++")
+	if err != nil {
+		t.Skip("the C++ compiler is not found")
+	}
+	input, err := os.ReadFile(filepath.Join("testdata", "host", "host.pa"))
+	require.NoError(t, err)
+	device, err := parser.Parse(string(input))
+	require.NoError(t, err)
+	hpp, cpp, err := GenerateHppCppWithOptions(device, "host", "host.h", CppOptions{Host: true})
+	require.NoError(t, err)
+	test, err := os.ReadFile(filepath.Join("testdata", "host", "host_test.cpp"))
+	require.NoError(t, err)
+
+	dir := t.TempDir()
+	require.NoError(t, os.WriteFile(filepath.Join(dir, "host.h"), []byte(hpp), 0644))
+	require.NoError(t, os.WriteFile(filepath.Join(dir, "host.cpp"), []byte(cpp), 0644))
+	require.NoError(t, os.WriteFile(filepath.Join(dir, "host_test.cpp"), test, 0644))
+	build := func(flags ...string) ([]byte, error) {
+		cmd := exec.Command(cxx, append(flags, "-std=c++20", "-Wall", "-o", "host_test", "host_test.cpp", "host.cpp")...)
+		cmd.Dir = dir
+		return cmd.CombinedOutput()
+	}
+	if _, err := build("-fsanitize=undefined", "-fno-sanitize-recover=all"); err != nil {
+		out, err := build()
+		require.NoError(t, err, string(out))
+	}
+	cmd := exec.Command(filepath.Join(dir, "host_test"))
+	out, err := cmd.CombinedOutput()
+	require.NoError(t, err, string(out))
+}
+
+func TestGenerateGoClient(t *testing.T) {
+	input := `
+    device test
+
+    register Status(1):r {
+        value uint8;
+    };
+
+    register Cmd(2):w {
+        op uint8;
+    };
+
+    register Log(3) {
+        size uint16;
+        data [size]uint8;
+    };`
+
+	device, err := parser.Parse(input)
+	require.NoError(t, err)
+
+	code, err := GenerateGoWithOptions(device, "test", GoOptions{Client: true})
+	require.NoError(t, err)
+	fmt.Println(code)
+
+	require.Contains(t, code, "import (\n    \"context\"\n    \"encoding/binary\"\n    \"fmt\"\n    \"sync\"\n    \"time\"\n)")
+	require.Contains(t, code, "type Register interface {")
+	require.Contains(t, code, "func NewClient(t Transport, window int, timeout time.Duration) *Client {")
+	require.Contains(t, code, "func (c *Client) ReadStatus(ctx context.Context) (*Status, error) {")
+	require.NotContains(t, code, "func (c *Client) WriteStatus(")
+	require.Contains(t, code, "func (c *Client) WriteCmd(ctx context.Context, r *Cmd) error {")
+	require.NotContains(t, code, "func (c *Client) ReadCmd(")
+	require.Contains(t, code, "func (c *Client) ReadLog(ctx context.Context) (*Log, error) {")
+	require.Contains(t, code, "func (c *Client) WriteLog(ctx context.Context, r *Log) error {")
+
+	// the batch frames declare the Register interface once
+	code, err = GenerateGoWithOptions(device, "test", GoOptions{Client: true, Batch: true})
+	require.NoError(t, err)
+	require.Equal(t, 1, strings.Count(code, "type Register interface {"))
+
+	code, err = GenerateGo(device, "test")
+	require.NoError(t, err)
+	require.NotContains(t, code, "Client")
+}
+
+func TestGenerateGoClientCache(t *testing.T) {
+	input := `
+    device test
+
+    register Status(1):r cache(90s) {
+        value uint8;
+    };
+
+    register Log(3) {
+        size uint16;
+        data [size]uint8;
+    };`
+
+	device, err := parser.Parse(input)
+	require.NoError(t, err)
+
+	code, err := GenerateGoWithOptions(device, "test", GoOptions{Client: true})
+	require.NoError(t, err)
+	require.Contains(t, code, "import (\n    \"context\"\n    \"encoding/binary\"\n    \"fmt\"\n    \"sync\"\n    \"time\"\n)")
+	require.Contains(t, code, "    switch id {\n    case 1:\n        return 90 * time.Second\n    }\n")
+	require.Contains(t, code, "    cache  map[uint8]*clientCall")
+
+	// the cache option changes nothing but the client
+	code, err = GenerateGo(device, "test")
+	require.NoError(t, err)
+	require.NotContains(t, code, "time")
+}
+
+// TestGoClientRun runs the tests of testdata/client against the Client generated from
+// testdata/client/client.pa in a scratch module
+func TestGoClientRun(t *testing.T) {
+	goTool, err := exec.LookPath("go")
+	if err != nil {
+		t.Skip("the go tool is not found")
+	}
+	input, err := os.ReadFile(filepath.Join("testdata", "client", "client.pa"))
+	require.NoError(t, err)
+	device, err := parser.Parse(string(input))
+	require.NoError(t, err)
+	code, err := GenerateGoWithOptions(device, "client", GoOptions{Client: true})
+	require.NoError(t, err)
+	test, err := os.ReadFile(filepath.Join("testdata", "client", "client_test.go"))
+	require.NoError(t, err)
+
+	dir := t.TempDir()
+	require.NoError(t, os.WriteFile(filepath.Join(dir, "go.mod"), []byte("module client\n\ngo 1.21\n"), 0644))
+	require.NoError(t, os.WriteFile(filepath.Join(dir, "client.go"), []byte(code), 0644))
+	require.NoError(t, os.WriteFile(filepath.Join(dir, "client_test.go"), test, 0644))
+	cmd := exec.Command(goTool, "test", "-count=1", ".")
+	cmd.Dir = dir
+	out, err := cmd.CombinedOutput()
+	require.NoError(t, err, string(out))
+}
+
+func TestGenerateCapture(t *testing.T) {
+	input := `
+    device test
+
+    register Status(1):r {
+        value uint8;
+    };
+
+    register Log(3) {
+        size uint16;
+        data [size]uint8;
+    };`
+
+	device, err := parser.Parse(input)
+	require.NoError(t, err)
+
+	hpp, cpp, err := GenerateHppCppWithOptions(device, "test", "test_h", CppOptions{Capture: true})
+	require.NoError(t, err)
+	fmt.Println(hpp)
+	fmt.Println(cpp)
+
+	require.Contains(t, hpp, "class Capture_Reader {")
+	require.Contains(t, hpp, "struct Capture_Registers {\n\tStatus reg_Status;\n\tLog reg_Log;\n};")
+	require.Contains(t, hpp, "int capture_decode(const Capture_Record& rec, Capture_Registers& regs);")
+	require.Contains(t, cpp, "\tcase Reg_Log_ID:\n\t\tres = rec.write ? regs.reg_Log.deserialize_write(rec.payload, rec.size) : regs.reg_Log.deserialize_read(rec.payload, rec.size);\n")
+
+	hpp, _, err = GenerateHppCppWithOptions(device, "test", "test_h", CppOptions{})
+	require.NoError(t, err)
+	require.NotContains(t, hpp, "Capture")
+
+	code, err := GenerateGoWithOptions(device, "test", GoOptions{Capture: true})
+	require.NoError(t, err)
+	require.Contains(t, code, "type Registers struct {\n    Status Status\n    Log Log\n}")
+	require.Equal(t, 1, strings.Count(code, "type Register interface {"))
+	require.Contains(t, code, "    case 3:\n        return &rs.Log\n")
+	require.Contains(t, code, "func (rs *Registers) Decode(id uint8, write bool, payload []byte) error {")
+
+	code, err = GenerateGoWithOptions(device, "test", GoOptions{Capture: true, Client: true, Batch: true})
+	require.NoError(t, err)
+	require.Equal(t, 1, strings.Count(code, "type Register interface {"))
+}
+
+func TestLayoutHash(t *testing.T) {
+	parse := func(input string) *parser.Device {
+		device, err := parser.Parse(input)
+		require.NoError(t, err)
+		return device
+	}
+	base := parse(`
+    device test
+
+    register Status(1):r {
+        flags uint8 { ready: 0, mode: 1-3 };
+        count uint8;
+        data [count]uint16;
+    };
+
+    register Config(2) {
+        rate uint16 max(1000);
+        status Status;
+    };`)
+
+	// the names, the comments, the constants and the declarations order don't matter
+	renamed := parse(`
+    device other
+
+    // the configuration
+    register Settings(2) {
+        const Limit = uint16(1000);
+        speed uint16 max(0x3E8);
+        st State;
+    };
+
+    register State(1):r {
+        f uint8 { r: 0, m: 1-3 };
+        n uint8;
+        d [n]uint16;
+    };`)
+	require.Equal(t, layoutHash(base, base.Registers[0]), layoutHash(renamed, renamed.Registers[1]))
+	require.Equal(t, layoutHash(base, base.Registers[1]), layoutHash(renamed, renamed.Registers[0]))
+	require.Equal(t, deviceLayoutHash(base), deviceLayoutHash(renamed))
+
+	// the nested register changes the one referencing it
+	changed := parse(`
+    device test
+
+    register Status(1):r {
+        flags uint8 { ready: 0, mode: 1-2 };
+        count uint8;
+        data [count]uint16;
+    };
+
+    register Config(2) {
+        rate uint16 max(1000);
+        status Status;
+    };`)
+	require.NotEqual(t, layoutHash(base, base.Registers[0]), layoutHash(changed, changed.Registers[0]))
+	require.NotEqual(t, layoutHash(base, base.Registers[1]), layoutHash(changed, changed.Registers[1]))
+	require.NotEqual(t, deviceLayoutHash(base), deviceLayoutHash(changed))
+
+	for _, input := range []string{
+		`device test register Config(3) { rate uint16 max(1000); status Status; }; register Status(1):r { flags uint8 { ready: 0, mode: 1-3 }; count uint8; data [count]uint16; };`,
+		`device test register Config(2) { rate uint16 max(999); status Status; }; register Status(1):r { flags uint8 { ready: 0, mode: 1-3 }; count uint8; data [count]uint16; };`,
+		`device test register Config(2) { rate:w uint16 max(1000); status Status; }; register Status(1):r { flags uint8 { ready: 0, mode: 1-3 }; count uint8; data [count]uint16; };`,
+		`device test register Config(2) delta { rate uint16 max(1000); status Status; }; register Status(1):r { flags uint8 { ready: 0, mode: 1-3 }; count uint8; data [count]uint16; };`,
+	} {
+		other := parse(input)
+		require.NotEqual(t, layoutHash(base, base.Registers[1]), layoutHash(other, other.Registers[0]), input)
+	}
+
+	hpp, cpp, err := GenerateHppCpp(base, "test", "test_h")
+	require.NoError(t, err)
+	require.Contains(t, hpp, fmt.Sprintf("static constexpr uint64_t Layout_Hash = 0x%016XULL;", deviceLayoutHash(base)))
+	require.Contains(t, hpp, fmt.Sprintf("    static constexpr uint64_t kLayoutHash = 0x%016XULL; // see Layout_Hash", layoutHash(base, base.Registers[0])))
+	require.Contains(t, hpp, "static constexpr size_t Handshake_Size = 26;")
+	require.Contains(t, cpp, "int serialize_handshake(uint8_t* buf, size_t size) {")
+	require.Contains(t, cpp, ", // Status::kLayoutHash\n\t\t0x02, ")
+
+	code, err := GenerateGo(base, "test")
+	require.NoError(t, err)
+	require.Contains(t, code, fmt.Sprintf("const LayoutHash uint64 = 0x%016X\n", deviceLayoutHash(base)))
+	require.Contains(t, code, fmt.Sprintf("func (r *Config) LayoutHash() uint64 {\n\treturn 0x%016X\n}", layoutHash(base, base.Registers[1])))
+	require.Contains(t, code, "const HandshakeSize = 26")
+	require.Contains(t, code, "func DeserializeHandshake(buf []byte) (Handshake, error) {")
+}
+
+func TestGenerateReport(t *testing.T) {
+	input := `
+    device test
+
+    register Status(1):r packed {
+        mode uint8 bits(2);
+        level uint8 bits(6);
+    };
+
+    register Log(3):w {
+        kind uint8 enum(1, 2);
+        size uint8;
+        data [size<=16]uint16;
+    };`
+
+	device, err := parser.Parse(input)
+	require.NoError(t, err)
+
+	rep, err := GenerateCppReport(device, "test", CppOptions{})
+	require.NoError(t, err)
+	require.Equal(t, "test", rep.Device)
+	require.Len(t, rep.Registers, 2)
+
+	status := rep.Registers[0]
+	require.Equal(t, 1, status.ID)
+	require.Len(t, status.Codecs, 2)
+	ser := status.Codecs[0]
+	require.Equal(t, "serialize_read", ser.Codec)
+	require.Equal(t, 1, ser.WireSize)
+	require.Equal(t, uint64(1), ser.WireSizeMax)
+	require.Equal(t, 1, ser.BoundsChecks)
+	require.Equal(t, 2, ser.Calls)
+	require.Equal(t, ser.AvrCycles, ser.AvrCyclesMax)
+
+	log := rep.Registers[1]
+	require.Len(t, log.Codecs, 2)
+	deser := log.Codecs[1]
+	require.Equal(t, "deserialize_write", deser.Codec)
+	require.Equal(t, -1, deser.WireSize)
+	require.Equal(t, uint64(34), deser.WireSizeMax)
+	// the static prefix, the array with the capacity check
+	require.Equal(t, 3, deser.BoundsChecks)
+	require.Less(t, deser.AvrCycles, deser.AvrCyclesMax)
+	require.Equal(t, uint64(avrCopyCycles*32), deser.AvrCyclesMax-deser.AvrCycles)
+	require.Equal(t, status.Codecs[0].AvrFlash+status.Codecs[1].AvrFlash+log.Codecs[0].AvrFlash+log.Codecs[1].AvrFlash, rep.AvrFlash)
+
+	var text strings.Builder
+	require.NoError(t, rep.WriteText(&text))
+	fmt.Println(text.String())
+	require.Contains(t, text.String(), "test (test): estimated AVR flash of the register codecs")
+	lines := strings.Split(text.String(), "\n")
+	require.Len(t, lines, 8)
+	require.Equal(t, "not counted: bit codecs, array kernels, handshake", lines[1])
+	require.Equal(t, []string{"Log", "deserialize_write", "-", "34"}, strings.Fields(lines[6])[:4])
+
+	// the stats counters don't change the codecs numbers
+	stats, err := GenerateCppReport(device, "test", CppOptions{Stats: true})
+	require.NoError(t, err)
+	require.Equal(t, rep.Registers, stats.Registers)
+	require.Equal(t, rep.AvrFlash, stats.AvrFlash)
+	require.Contains(t, stats.NotCounted, "PARGUS_STATS counters")
+
+	// the other codecs of the options are named
+	withOpts, err := GenerateCppReport(device, "test", CppOptions{Crc: "crc16", Batch: true, Capture: true})
+	require.NoError(t, err)
+	require.Equal(t, rep.AvrFlash, withOpts.AvrFlash)
+	require.Equal(t, []string{"bit codecs", "array kernels", "_crc codecs", "dispatch", "batch frames", "capture reader", "handshake"}, withOpts.NotCounted)
+
+	// the table register codes the fields by the interpreter
+	device, err = parser.Parse(`
+    device test
+
+    register Log(3):w table {
+        size uint8;
+        data [size]uint8;
+    };`)
+	require.NoError(t, err)
+	rep, err = GenerateCppReport(device, "test", CppOptions{})
+	require.NoError(t, err)
+	require.Equal(t, 2*avrDescFlash, rep.Registers[0].TableFlash)
+	require.Equal(t, 0, rep.Registers[0].Codecs[0].BoundsChecks)
+}
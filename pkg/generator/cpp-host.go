@@ -0,0 +1,175 @@
+package generator
+
+// The host C++ target (cpp-host) generates the same registers as the Arduino C++ target for
+// the Linux gateways and the services which talk to the devices, it needs C++20. The code
+// doesn't need the Arduino headers and the bigendian library, and the arrays of the multi-byte
+// elements are coded by the vector kernels of the host. The registers are the value types:
+// the fixed and the bounded arrays are std::array, the variable-length arrays are
+// std::pmr::vector, which take their memory from the resource given to the register
+// constructor, and the views of the wire buffer are std::span. The table option doesn't apply.
+
+// cppHostTemplate contains the parts of the host target which replace the Arduino ones
+const cppHostTemplate = `
+{{- define "host_prelude"}}
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <array>
+#include <memory_resource>
+#include <span>
+#include <vector>
+
+#ifndef PARGUS_HOST_PRELUDE
+#define PARGUS_HOST_PRELUDE
+// The flash memory accessors of AVR, the host keeps the tables in the regular memory
+#ifndef PROGMEM
+#define PROGMEM
+#define pgm_read_ptr(p) (*(void* const*)(p))
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define pgm_read_word(p) (*(const uint16_t*)(p))
+#define pgm_read_dword(p) (*(const uint32_t*)(p))
+#define memcpy_P memcpy
+#endif
+
+// The big-endian codecs with the interface of the bigendian Arduino library
+namespace bigendian {
+namespace host {
+
+template <size_t N> struct Uint;
+template <> struct Uint<1> { typedef uint8_t type; static uint8_t swap(uint8_t v) { return v; } };
+template <> struct Uint<2> { typedef uint16_t type; static uint16_t swap(uint16_t v) { return __builtin_bswap16(v); } };
+template <> struct Uint<4> { typedef uint32_t type; static uint32_t swap(uint32_t v) { return __builtin_bswap32(v); } };
+template <> struct Uint<8> { typedef uint64_t type; static uint64_t swap(uint64_t v) { return __builtin_bswap64(v); } };
+
+} // namespace host
+
+template <typename T>
+inline size_t encode(uint8_t* buf, T v) {
+	typename host::Uint<sizeof(T)>::type u;
+	memcpy(&u, &v, sizeof(T));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	u = host::Uint<sizeof(T)>::swap(u);
+#endif
+	memcpy(buf, &u, sizeof(T));
+	return sizeof(T);
+}
+
+template <typename T>
+inline size_t decode(T& v, const uint8_t* buf) {
+	typename host::Uint<sizeof(T)>::type u;
+	memcpy(&u, buf, sizeof(T));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	u = host::Uint<sizeof(T)>::swap(u);
+#endif
+	memcpy(&v, &u, sizeof(T));
+	return sizeof(T);
+}
+
+template <typename T>
+inline size_t encode_varray(uint8_t* buf, const T* arr, size_t n) {
+	size_t offset = 0;
+	for (size_t i = 0; i < n; i++) offset += encode(buf + offset, arr[i]);
+	return offset;
+}
+
+template <typename T>
+inline size_t decode_varray(T* arr, const uint8_t* buf, size_t n) {
+	size_t offset = 0;
+	for (size_t i = 0; i < n; i++) offset += decode(arr[i], buf + offset);
+	return offset;
+}
+
+} // namespace bigendian
+
+namespace pargus {
+
+// Arena is the memory of the variable-length arrays decoded from a burst of frames: the vectors
+// of the registers constructed with it take their elements from its buffer, which is released
+// at once when the burst is handled. It falls back to the heap if the buffer is exhausted.
+using Arena = std::pmr::monotonic_buffer_resource;
+
+} // namespace pargus
+#endif
+{{- end}}
+
+{{- define "host_intrinsics"}}
+{{- if .ArrayKernels}}
+#if defined(__AVX2__) || defined(__SSSE3__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+{{- end}}
+{{- end}}
+
+{{- define "host_array_kernels"}}
+
+namespace detail {
+
+// Bulk codecs for the arrays of multi-byte elements. The little-endian hosts copy the elements
+// with their bytes swapped by the vector shuffles: 32 bytes at a time with AVX2, 16 bytes with
+// SSSE3 (pshufb) or NEON (vrev), the rest of the array element by element. The big-endian
+// hosts copy the array as is. Build with -mavx2, -mssse3 or -march=native to enable them.
+#if defined(__AVX2__) || defined(__SSSE3__)
+template <size_t W>
+inline __m128i swap_mask() {
+	return W == 2 ? _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14)
+		: W == 4 ? _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12)
+		: _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+}
+#endif
+
+template <size_t W>
+inline void swap_copy(uint8_t* dst, const uint8_t* src, size_t n) {
+	size_t i = 0, bytes = n * W;
+#if defined(__AVX2__)
+	const __m256i mask32 = _mm256_broadcastsi128_si256(swap_mask<W>());
+	for (; i + 32 <= bytes; i += 32) {
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_shuffle_epi8(v, mask32));
+	}
+#endif
+#if defined(__AVX2__) || defined(__SSSE3__)
+	const __m128i mask = swap_mask<W>();
+	for (; i + 16 <= bytes; i += 16) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_shuffle_epi8(v, mask));
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 16 <= bytes; i += 16) {
+		uint8x16_t v = vld1q_u8(src + i);
+		vst1q_u8(dst + i, W == 2 ? vrev16q_u8(v) : W == 4 ? vrev32q_u8(v) : vrev64q_u8(v));
+	}
+#endif
+	for (; i < bytes; i += W) {
+		typename bigendian::host::Uint<W>::type u;
+		memcpy(&u, src + i, W);
+		u = bigendian::host::Uint<W>::swap(u);
+		memcpy(dst + i, &u, W);
+	}
+}
+
+template <typename T>
+inline size_t encode_array(uint8_t* buf, const T* arr, size_t n) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	swap_copy<sizeof(T)>(buf, reinterpret_cast<const uint8_t*>(arr), n);
+#else
+	std::copy_n(reinterpret_cast<const uint8_t*>(arr), sizeof(T)*n, buf);
+#endif
+	return sizeof(T)*n;
+}
+
+template <typename T>
+inline size_t decode_array(T* arr, const uint8_t* buf, size_t n) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	swap_copy<sizeof(T)>(reinterpret_cast<uint8_t*>(arr), buf, n);
+#else
+	std::copy_n(buf, sizeof(T)*n, reinterpret_cast<uint8_t*>(arr));
+#endif
+	return sizeof(T)*n;
+}
+
+} // namespace detail
+{{- end}}`
@@ -3,9 +3,11 @@ package generator
 import (
 	"bytes"
 	"fmt"
+	"sort"
 	"strconv"
 	"strings"
 	"text/template"
+	"time"
 
 	"github.com/dspasibenko/pargus/pkg/parser"
 	"golang.org/x/text/cases"
@@ -17,13 +19,59 @@ const goTemplate = `
 package {{.Package}}
 
 import (
-    "encoding/binary"
-    "fmt"
+{{- range .Imports}}
+    "{{.}}"
+{{- end}}
 )
 
 {{- range .Doc}}
 {{.}}
 {{- end}}
+{{- if .Stats}}
+
+// Codec is the register codec reported to the Hook
+type Codec uint8
+
+const (
+    CodecSerializeRead Codec = iota
+    CodecSerializeWrite
+    CodecDeserializeRead
+    CodecDeserializeWrite
+)
+
+// Hook observes the register codecs, e.g. to export their calls, failures and bytes as metrics.
+// OnCodec gets the register ID, the codec and its results.
+type Hook interface {
+    OnCodec(id uint8, codec Codec, n int, err error)
+}
+
+var hook Hook
+
+// SetHook sets the hook called by the codecs of all the registers, nil removes it. It must not
+// be called concurrently with the codecs.
+func SetHook(h Hook) {
+    hook = h
+}
+{{- end}}
+{{- if .Crc}}
+
+// CrcSize is the size of the {{.Crc.Title}} checksum which follows the wire data of the Crc codecs
+const CrcSize = {{.Crc.Size}}
+{{- end}}
+{{- if .Batch}}
+
+// Register IDs
+{{- range .Registers}}
+const Reg_{{.Name}}_ID uint8 = {{.ID}}
+{{- end}}
+{{- end}}
+
+// LayoutHash is the hash of the wire layout of all registers, the comments and the names of the
+// registers and their fields don't change it
+const LayoutHash uint64 = {{.LayoutHash}}
+
+// HandshakeSize is the size of the device handshake, see Handshake
+const HandshakeSize = {{.HandshakeSize}}
 
 {{- range .Registers}}{{ $regName := .Name }}
 {{range .Doc}}{{.}}
@@ -35,6 +83,9 @@ type {{.Name}} struct {
     {{- end}}
     {{.Decl}} {{if .Trailing}} {{.Trailing}}{{end}}
 {{- end}}
+{{- if .Delta}}
+    dirty [{{.Delta.MaskSize}}]byte // the changed write fields, delta writes send only them
+{{- end}}
 }
 
 {{- range .Constants}}
@@ -42,6 +93,13 @@ type {{.Name}} struct {
 {{end -}}
 const {{.Name}} {{.Type}} = {{.Value}}
 {{- end}}
+{{- if .Delta}}
+
+// The indexes of the {{.Name}} write fields in the dirty mask
+{{- range .Delta.Fields}}
+const {{$regName}}_{{.Name}}_dirty = {{.Index}}
+{{- end}}
+{{- end}}
 
 {{- range .Fields}}
 {{- range .BitMasks}}
@@ -59,6 +117,11 @@ func (r *{{.Name}}) ID() uint8 {
 	return {{.ID}}
 }
 
+// LayoutHash returns the hash of the {{.Name}} register wire layout
+func (r *{{.Name}}) LayoutHash() uint64 {
+	return {{.LayoutHash}}
+}
+
 // BufSize4Read returns the buffer size required for read fields serialization
 func (r *{{.Name}}) BufSize4Read() int {
     size := {{.BufSize4ReadConst}}
@@ -85,7 +148,8 @@ func (r *{{.Name}}) BufSize4Write() int {
     return size
 }
 
-// Check validates the consistency of variable-length arrays with their size fields
+// Check validates the consistency of variable-length arrays with their size fields and the
+// values of the constrained fields
 func (r *{{.Name}}) Check() error {
 {{- range .Fields}}
 {{- range .ConsistencyChecks}}
@@ -95,51 +159,248 @@ func (r *{{.Name}}) Check() error {
     return nil
 }
 
+{{- if $.Stats}}
 // SerializeRead serializes read data to the wire buffer
 func (r *{{.Name}}) SerializeRead(buf []byte) (int, error) {
+    n, err := r.serializeRead(buf)
+    if hook != nil {
+        hook.OnCodec({{.ID}}, CodecSerializeRead, n, err)
+    }
+    return n, err
+}
+
+func (r *{{.Name}}) serializeRead(buf []byte) (int, error) {
+{{- else}}
+// SerializeRead serializes read data to the wire buffer
+func (r *{{.Name}}) SerializeRead(buf []byte) (int, error) {
+{{- end}}
     if err := r.Check(); err != nil {
         return 0, err
     }
     offset := 0
-{{- range .Fields}}{{- if .SerializeReadData}}
-    {{range .SerializeReadData}}{{.}}
-    {{end -}}
-{{- end}}{{- end}}
+{{- range .SerializeRead}}
+    {{.}}
+{{- end}}
     return offset, nil
 }
 
+{{- if $.Stats}}
+// SerializeWrite serializes write data to the wire buffer
+func (r *{{.Name}}) SerializeWrite(buf []byte) (int, error) {
+    n, err := r.serializeWrite(buf)
+    if hook != nil {
+        hook.OnCodec({{.ID}}, CodecSerializeWrite, n, err)
+    }
+    return n, err
+}
+
+func (r *{{.Name}}) serializeWrite(buf []byte) (int, error) {
+{{- else}}
 // SerializeWrite serializes write data to the wire buffer
 func (r *{{.Name}}) SerializeWrite(buf []byte) (int, error) {
+{{- end}}
     if err := r.Check(); err != nil {
         return 0, err
     }
     offset := 0
-{{- range .Fields}}{{- if .SerializeWriteData}}
-    {{range .SerializeWriteData}}{{.}}
-    {{end -}}
-{{- end}}{{- end}}
+{{- range .SerializeWrite}}
+    {{.}}
+{{- end}}
     return offset, nil
 }
 
+// AppendRead appends the serialized read data to dst and returns the extended slice. dst
+// grows only if its capacity is too small, so a pooled buffer may collect many registers.
+func (r *{{.Name}}) AppendRead(dst []byte) ([]byte, error) {
+    n := len(dst)
+    dst = growBuf(dst, r.BufSize4Read())
+    m, err := r.SerializeRead(dst[n:])
+    if err != nil {
+        return dst[:n], err
+    }
+    return dst[:n+m], nil
+}
+
+// AppendWrite appends the serialized write data to dst and returns the extended slice. dst
+// grows only if its capacity is too small, so a pooled buffer may collect many registers.
+func (r *{{.Name}}) AppendWrite(dst []byte) ([]byte, error) {
+    n := len(dst)
+    dst = growBuf(dst, r.BufSize4Write())
+    m, err := r.SerializeWrite(dst[n:])
+    if err != nil {
+        return dst[:n], err
+    }
+    return dst[:n+m], nil
+}
+
+{{- if $.Stats}}
 // DeserializeRead deserializes read data into the register
 func (r *{{.Name}}) DeserializeRead(buf []byte) (int, error) {
+    n, err := r.deserializeRead(buf)
+    if hook != nil {
+        hook.OnCodec({{.ID}}, CodecDeserializeRead, n, err)
+    }
+    return n, err
+}
+
+func (r *{{.Name}}) deserializeRead(buf []byte) (int, error) {
+{{- else}}
+// DeserializeRead deserializes read data into the register
+func (r *{{.Name}}) DeserializeRead(buf []byte) (int, error) {
+{{- end}}
     offset := 0
-{{- range .Fields}}{{- if .DeserializeReadData}}
-    {{range .DeserializeReadData}}{{.}}
-    {{end -}}
-{{- end}}{{- end}}
+{{- range .DeserializeRead}}
+    {{.}}
+{{- end}}
     return offset, nil
 }
 
+{{- if $.Stats}}
 // DeserializeWrite deserializes write data into the register
 func (r *{{.Name}}) DeserializeWrite(buf []byte) (int, error) {
+    n, err := r.deserializeWrite(buf)
+    if hook != nil {
+        hook.OnCodec({{.ID}}, CodecDeserializeWrite, n, err)
+    }
+    return n, err
+}
+
+func (r *{{.Name}}) deserializeWrite(buf []byte) (int, error) {
+{{- else}}
+// DeserializeWrite deserializes write data into the register
+func (r *{{.Name}}) DeserializeWrite(buf []byte) (int, error) {
+{{- end}}
     offset := 0
-{{- range .Fields}}{{- if .DeserializeWriteData}}
-    {{range .DeserializeWriteData}}{{.}}
-    {{end -}}
-{{- end}}{{- end}}
+{{- range .DeserializeWrite}}
+    {{.}}
+{{- end}}
+    return offset, nil
+}
+{{- if $.Crc}}
+
+// SerializeReadCrc serializes read data followed by the checksum
+func (r *{{.Name}}) SerializeReadCrc(buf []byte) (int, error) {
+    n, err := r.SerializeRead(buf)
+    if err != nil {
+        return n, err
+    }
+    return appendCrc(buf, n)
+}
+
+// SerializeWriteCrc serializes write data followed by the checksum
+func (r *{{.Name}}) SerializeWriteCrc(buf []byte) (int, error) {
+    n, err := r.SerializeWrite(buf)
+    if err != nil {
+        return n, err
+    }
+    return appendCrc(buf, n)
+}
+
+// DeserializeReadCrc deserializes read data followed by the checksum. The register is updated
+// before the checksum is checked, so it must not be used if the error is returned.
+func (r *{{.Name}}) DeserializeReadCrc(buf []byte) (int, error) {
+    n, err := r.DeserializeRead(buf)
+    if err != nil {
+        return n, err
+    }
+    return checkCrc(buf, n)
+}
+
+// DeserializeWriteCrc deserializes write data followed by the checksum. The register is updated
+// before the checksum is checked, so it must not be used if the error is returned.
+func (r *{{.Name}}) DeserializeWriteCrc(buf []byte) (int, error) {
+    n, err := r.DeserializeWrite(buf)
+    if err != nil {
+        return n, err
+    }
+    return checkCrc(buf, n)
+}
+{{- end}}
+{{- if .Delta}}
+
+// IsDirty returns true if the write field ({{.Name}}_<field>_dirty) was changed
+func (r *{{.Name}}) IsDirty(field int) bool {
+    return r.dirty[field/8]&(1<<(field%8)) != 0
+}
+
+// MarkDirty marks the write field ({{.Name}}_<field>_dirty) as changed
+func (r *{{.Name}}) MarkDirty(field int) {
+    r.dirty[field/8] |= 1 << (field % 8)
+}
+
+// ClearDirty marks all the write fields as unchanged, normally after the delta write is sent
+func (r *{{.Name}}) ClearDirty() {
+    r.dirty = [{{.Delta.MaskSize}}]byte{}
+}
+
+// deltaMask returns the presence mask of the delta write. The variable-length arrays are sent
+// together with their size fields.
+func (r *{{.Name}}) deltaMask() [{{.Delta.MaskSize}}]byte {
+    mask := r.dirty
+{{- range .Delta.MaskFix}}
+    {{.}}
+{{- end}}
+    return mask
+}
+
+// BufSize4WriteDelta returns the buffer size required for the delta write serialization
+func (r *{{.Name}}) BufSize4WriteDelta() int {
+    mask := r.deltaMask()
+    size := {{.Delta.MaskSize}}
+{{- range .Delta.Size}}
+    {{.}}
+{{- end}}
+    return size
+}
+
+// SerializeWriteDelta serializes the presence mask of the dirty write fields followed by
+// these fields only
+func (r *{{.Name}}) SerializeWriteDelta(buf []byte) (int, error) {
+    if err := r.Check(); err != nil {
+        return 0, err
+    }
+    if len(buf) < {{.Delta.MaskSize}} {
+        return 0, fmt.Errorf("buffer too small: need %d bytes, have %d", {{.Delta.MaskSize}}, len(buf))
+    }
+    mask := r.deltaMask()
+    copy(buf, mask[:])
+    offset := {{.Delta.MaskSize}}
+{{- range .Delta.Serialize}}
+    {{.}}
+{{- end}}
+    return offset, nil
+}
+
+// AppendWriteDelta appends the serialized delta write to dst and returns the extended slice
+func (r *{{.Name}}) AppendWriteDelta(dst []byte) ([]byte, error) {
+    n := len(dst)
+    dst = growBuf(dst, r.BufSize4WriteDelta())
+    m, err := r.SerializeWriteDelta(dst[n:])
+    if err != nil {
+        return dst[:n], err
+    }
+    return dst[:n+m], nil
+}
+
+// DeserializeWriteDelta deserializes the sent write fields, the received presence mask
+// becomes the dirty mask
+func (r *{{.Name}}) DeserializeWriteDelta(buf []byte) (int, error) {
+    if len(buf) < {{.Delta.MaskSize}} {
+        return 0, fmt.Errorf("buffer too small: need %d bytes, have %d", {{.Delta.MaskSize}}, len(buf))
+    }
+    var mask [{{.Delta.MaskSize}}]byte
+    copy(mask[:], buf)
+{{- range .Delta.MaskCheck}}
+    {{.}}
+{{- end}}
+    offset := {{.Delta.MaskSize}}
+{{- range .Delta.Deserialize}}
+    {{.}}
+{{- end}}
+    r.dirty = mask
     return offset, nil
 }
+{{- end}}
 
 {{- range .Fields}}
 // Get{{.CapitalizedName}} returns value for {{.Name}}
@@ -150,146 +411,842 @@ func (r *{{$regName}}) Get{{.CapitalizedName}}() {{.Type}} {
 // Set{{.CapitalizedName}} sets value for {{.Name}}
 func (r *{{$regName}}) Set{{.CapitalizedName}}(v {{.Type}}) {
     r.{{.Name}} = v
+{{- if .DirtyMark}}
+    {{.DirtyMark}}
+{{- end}}
 }
 {{- end}}
 
 {{- end}}
 
-type Integer interface {
-	~int8 | ~int16 | ~int32 | ~int64 | ~uint8 | ~uint16 | ~uint32 | ~uint64
+
+{{- if .Batch}}
+
+// ================= Batch frames =================
+// The batch frame carries several registers in one request or response: the entries count
+// followed by the entries [register ID][payload size, 2 bytes big-endian][payload]. The batch
+// read request is the registers count followed by their IDs.
+
+// BatchEntryHeaderSize is the size of the batch entry header: the register ID and the payload size
+const BatchEntryHeaderSize = 3
+
+{{template "register_interface"}}
+
+// NewRegister returns the new register with the ID, or nil if the ID is unknown
+func NewRegister(id uint8) Register {
+    switch id {
+{{- range .Registers}}
+    case Reg_{{.Name}}_ID:
+        return &{{.Name}}{}
+{{- end}}
+    }
+    return nil
 }
 
-func putNumber[T Integer](b []byte, v T) error {
-	size := binary.Size(v)
-	if len(b) < size {
-		return fmt.Errorf("buffer too small: need %d bytes, have %d", size, len(b))
+// wireSizeMax returns the maximal wire size of the read or write fields of the register with
+// the ID, 0 for the unknown ID
+func wireSizeMax(id uint8, read bool) uint64 {
+    switch id {
+{{- range .Registers}}
+    case Reg_{{.Name}}_ID:
+        if read {
+            return {{.ReadWireSizeMax}}
+        }
+        return {{.WriteWireSizeMax}}
+{{- end}}
+    }
+    return 0
+}
+
+// AppendReadBatchRequest appends the batch read request of the registers with the IDs to dst
+func AppendReadBatchRequest(dst []byte, ids ...uint8) ([]byte, error) {
+    if len(ids) > 0xFF {
+        return dst, fmt.Errorf("too many batch entries: %d", len(ids))
+    }
+    dst = append(dst, byte(len(ids)))
+    return append(dst, ids...), nil
+}
+
+// AppendReadBatch appends the batch frame of the registers read fields to dst, e.g. the batch
+// read response
+func AppendReadBatch(dst []byte, regs ...Register) ([]byte, error) {
+    return appendBatch(dst, true, regs)
+}
+
+// AppendWriteBatch appends the batch frame of the registers write fields to dst, e.g. the batch
+// write request
+func AppendWriteBatch(dst []byte, regs ...Register) ([]byte, error) {
+    return appendBatch(dst, false, regs)
+}
+
+// DecodeReadBatch deserializes the batch frame of the read fields, e.g. the batch read response,
+// into the registers. The frame entries must follow the registers order. Returns the frame size.
+func DecodeReadBatch(buf []byte, regs ...Register) (int, error) {
+    return decodeBatch(buf, true, regs)
+}
+
+// DecodeWriteBatch deserializes the batch frame of the write fields into the registers. The
+// frame entries must follow the registers order. Returns the frame size.
+func DecodeWriteBatch(buf []byte, regs ...Register) (int, error) {
+    return decodeBatch(buf, false, regs)
+}
+
+func appendBatch(dst []byte, read bool, regs []Register) ([]byte, error) {
+    if len(regs) > 0xFF {
+        return dst, fmt.Errorf("too many batch entries: %d", len(regs))
+    }
+    start := len(dst)
+    dst = append(dst, byte(len(regs)))
+    for _, r := range regs {
+        size := r.BufSize4Write()
+        if read {
+            size = r.BufSize4Read()
+        }
+        if size > 0xFFFF {
+            return dst[:start], fmt.Errorf("register %d is too big for the batch entry: %d bytes", r.ID(), size)
+        }
+        n := len(dst)
+        dst = growBuf(dst, BatchEntryHeaderSize+size)
+        var m int
+        var err error
+        if read {
+            m, err = r.SerializeRead(dst[n+BatchEntryHeaderSize:])
+        } else {
+            m, err = r.SerializeWrite(dst[n+BatchEntryHeaderSize:])
+        }
+        if err != nil {
+            return dst[:start], err
+        }
+        dst[n] = r.ID()
+        binary.BigEndian.PutUint16(dst[n+1:], uint16(m))
+        dst = dst[:n+BatchEntryHeaderSize+m]
+    }
+    return dst, nil
+}
+
+func decodeBatch(buf []byte, read bool, regs []Register) (int, error) {
+    if len(buf) < 1 {
+        return 0, fmt.Errorf("buffer too small: need %d bytes, have %d", 1, len(buf))
+    }
+    if int(buf[0]) != len(regs) {
+        return 0, fmt.Errorf("the batch has %d entries, expected %d", buf[0], len(regs))
+    }
+    offset := 1
+    for _, r := range regs {
+        if len(buf) < offset+BatchEntryHeaderSize {
+            return offset, fmt.Errorf("buffer too small: need %d bytes, have %d", offset+BatchEntryHeaderSize, len(buf))
+        }
+        id := buf[offset]
+        size := int(binary.BigEndian.Uint16(buf[offset+1:]))
+        if id != r.ID() {
+            return offset, fmt.Errorf("the batch entry is register %d, expected %d", id, r.ID())
+        }
+        if uint64(size) > wireSizeMax(id, read) {
+            return offset, fmt.Errorf("the batch entry of register %d is too big: %d bytes", id, size)
+        }
+        offset += BatchEntryHeaderSize
+        if len(buf) < offset+size {
+            return offset, fmt.Errorf("buffer too small: need %d bytes, have %d", offset+size, len(buf))
+        }
+        var n int
+        var err error
+        if read {
+            n, err = r.DeserializeRead(buf[offset : offset+size])
+        } else {
+            n, err = r.DeserializeWrite(buf[offset : offset+size])
+        }
+        if err != nil {
+            return offset, err
+        }
+        if n != size {
+            return offset, fmt.Errorf("the batch entry of register %d has %d extra bytes", id, size-n)
+        }
+        offset += size
+    }
+    return offset, nil
+}
+{{- end}}
+{{- if .Client}}
+
+// ================= Client =================
+// Client is the typed client of the device registers. It pipelines the requests over the
+// Transport: every request gets a sequence number, and up to the window requests are in
+// flight at once, so the link is not idle during the round trips. The methods block until the
+// response, the concurrent calls from several goroutines are pipelined. The concurrent reads of
+// the same register are coalesced: the reads issued while the register read is in flight get
+// its response instead of sending another request, a write of the register ends it. A request
+// without the response in the timeout fails and frees its window slot, so the lost responses
+// don't stall the client.
+{{- if .Cached}} The reads
+// of the registers with the cache option are served from the cache until the response expires
+// or the register is written.
+{{- end}}
+type Client struct {
+    t       Transport
+    window  chan struct{} // holds a token per request in flight
+    timeout time.Duration // waiting for the response, 0 waits forever
+
+    sendMu sync.Mutex // orders the sequence numbers and the Send calls
+    mu     sync.Mutex
+    seq    uint16
+    calls  map[uint16]*clientCall // the requests in flight by the sequence number
+    reads  map[uint8]*clientCall  // the reads in flight by the register ID, joined by the other reads
+{{- if .Cached}}
+    cache  map[uint8]*clientCall  // the completed reads of the cached registers by the register ID
+{{- end}}
+    err    error                  // the transport error which stopped the client
+}
+{{- if not .Batch}}
+
+{{template "register_interface"}}
+{{- end}}
+
+// Request is the register read or write request sent by the Client
+type Request struct {
+    Seq     uint16 // the sequence number, the response must carry it
+    ID      uint8  // the register ID
+    Write   bool
+    Payload []byte // the serialized write fields of the write request, empty for the read request
+}
+
+// Response is the device answer to the request with the same sequence number. The responses
+// may come in any order.
+type Response struct {
+    Seq     uint16
+    Payload []byte // the serialized read fields of the read response, the client keeps it
+    Err     error  // the request failed on the device or on the way
+}
+
+// Transport carries the requests to the device and the responses back, e.g. over a TCP bridge or
+// a CAN bus. The Client calls Send from one goroutine at a time, in the sequence numbers order,
+// and Recv from its receive goroutine. The Recv error stops the client: the requests in flight
+// and the following ones fail with it, so closing the transport stops the client.
+type Transport interface {
+    Send(req Request) error
+    Recv() (Response, error)
+}
+
+// clientCall is the request in flight, done is closed once the response is received
+type clientCall struct {
+    id      uint8
+    done    chan struct{}
+    payload []byte
+    err     error
+    aborted bool        // the caller ctx was done before the request was sent
+    timer   *time.Timer // fails the call after the timeout
+{{- if .Cached}}
+    expires time.Time // the cached read response is served until then
+{{- end}}
+}
+
+// NewClient returns the client which keeps up to window requests in flight over the transport,
+// 1 disables the pipelining. The request fails if its response doesn't come in the timeout, 0
+// waits forever and a lost response holds its window slot then.
+func NewClient(t Transport, window int, timeout time.Duration) *Client {
+    c := &Client{
+        t:       t,
+        window:  make(chan struct{}, min(max(window, 1), 0xFFFF)),
+        timeout: timeout,
+        calls:   make(map[uint16]*clientCall),
+        reads:   make(map[uint8]*clientCall),
+{{- if .Cached}}
+        cache:   make(map[uint8]*clientCall),
+{{- end}}
+    }
+    go c.recvLoop()
+    return c
+}
+{{- range .Registers}}
+{{- if .Readable}}
+
+// Read{{.Name}} reads the {{.Name}} register
+func (c *Client) Read{{.Name}}(ctx context.Context) (*{{.Name}}, error) {
+    r := &{{.Name}}{}
+    if err := c.Read(ctx, r); err != nil {
+        return nil, err
+    }
+    return r, nil
+}
+{{- end}}
+{{- if .Writable}}
+
+// Write{{.Name}} writes the write fields of the {{.Name}} register
+func (c *Client) Write{{.Name}}(ctx context.Context, r *{{.Name}}) error {
+    return c.Write(ctx, r)
+}
+{{- end}}
+{{- end}}
+
+// Read reads the register read fields into r
+func (c *Client) Read(ctx context.Context, r Register) error {
+    id := r.ID()
+    call, err := c.read(ctx, id)
+    // the joined read was not sent because its caller gave up, the live caller sends it again
+    for err != nil && ctx.Err() == nil && call.aborted {
+        call, err = c.read(ctx, id)
+    }
+    if err != nil {
+        return err
+    }
+    n, err := r.DeserializeRead(call.payload)
+    if err == nil && n != len(call.payload) {
+        err = fmt.Errorf("the response of register %d has %d extra bytes", id, len(call.payload)-n)
+    }
+{{- if .Cached}}
+    if err != nil {
+        c.mu.Lock()
+        if c.cache[id] == call {
+            delete(c.cache, id)
+        }
+        c.mu.Unlock()
+    }
+{{- end}}
+    return err
+}
+
+// read sends the register read or joins the read in flight and waits for its response
+func (c *Client) read(ctx context.Context, id uint8) (*clientCall, error) {
+    c.mu.Lock()
+{{- if .Cached}}
+    call := c.cache[id]
+    if call != nil && !time.Now().Before(call.expires) {
+        delete(c.cache, id)
+        call = nil
+    }
+    if call == nil {
+        call = c.reads[id]
+    }
+{{- else}}
+    call := c.reads[id]
+{{- end}}
+    if call == nil {
+        call = &clientCall{id: id, done: make(chan struct{})}
+        c.reads[id] = call
+        c.mu.Unlock()
+        c.send(ctx, call, Request{ID: id})
+    } else {
+        c.mu.Unlock()
+    }
+    return call, c.wait(ctx, call)
+}
+
+// Write writes the register write fields
+func (c *Client) Write(ctx context.Context, r Register) error {
+    buf := make([]byte, r.BufSize4Write())
+    n, err := r.SerializeWrite(buf)
+    if err != nil {
+        return err
+    }
+    call := &clientCall{id: r.ID(), done: make(chan struct{})}
+    c.mu.Lock()
+    // the reads issued after the write must not get the response of the earlier read
+    delete(c.reads, call.id)
+{{- if .Cached}}
+    delete(c.cache, call.id)
+{{- end}}
+    c.mu.Unlock()
+    c.send(ctx, call, Request{ID: call.id, Write: true, Payload: buf[:n]})
+    return c.wait(ctx, call)
+}
+
+// send sends the request of the call once the window allows, the call fails if it can't be sent
+func (c *Client) send(ctx context.Context, call *clientCall, req Request) {
+    select {
+    case c.window <- struct{}{}:
+    case <-ctx.Done():
+        call.aborted = true
+        c.finish(call, nil, ctx.Err())
+        return
+    }
+    c.sendMu.Lock()
+    defer c.sendMu.Unlock()
+    c.mu.Lock()
+    if c.err != nil {
+        err := c.err
+        c.mu.Unlock()
+        <-c.window
+        c.finish(call, nil, err)
+        return
+    }
+    // skip the sequence numbers of the requests still in flight after the wrap around
+    for c.seq++; c.calls[c.seq] != nil; c.seq++ {
+    }
+    req.Seq = c.seq
+    c.calls[req.Seq] = call
+    if c.timeout > 0 {
+        call.timer = time.AfterFunc(c.timeout, func() { c.expire(req.Seq, call) })
+    }
+    c.mu.Unlock()
+    if err := c.t.Send(req); err != nil {
+        c.complete(req.Seq, nil, err)
+    }
+}
+
+// wait waits for the response of the call, the call stays in flight if ctx is done first
+func (c *Client) wait(ctx context.Context, call *clientCall) error {
+    select {
+    case <-call.done:
+        return call.err
+    case <-ctx.Done():
+        return ctx.Err()
+    }
+}
+
+func (c *Client) recvLoop() {
+    for {
+        resp, err := c.t.Recv()
+        if err != nil {
+            c.mu.Lock()
+            c.err = err
+            calls := c.calls
+            c.calls = make(map[uint16]*clientCall)
+            c.mu.Unlock()
+            for _, call := range calls {
+                c.release(call, nil, err)
+            }
+            return
+        }
+        c.complete(resp.Seq, resp.Payload, resp.Err)
+    }
+}
+
+// complete finishes the call with the sequence number and releases its window token, the
+// unknown sequence numbers are ignored
+func (c *Client) complete(seq uint16, payload []byte, err error) {
+    c.mu.Lock()
+    call := c.calls[seq]
+    delete(c.calls, seq)
+    c.mu.Unlock()
+    if call == nil {
+        return
+    }
+    c.release(call, payload, err)
+}
+
+// expire fails the call still waiting for the response after the timeout, the late response
+// is ignored as the unknown sequence number
+func (c *Client) expire(seq uint16, call *clientCall) {
+    c.mu.Lock()
+    if c.calls[seq] != call {
+        c.mu.Unlock()
+        return
+    }
+    delete(c.calls, seq)
+    c.mu.Unlock()
+    c.release(call, nil, fmt.Errorf("no response of register %d in %v", call.id, c.timeout))
+}
+
+// release stops the timer of the call removed from the calls in flight, releases its window
+// token and finishes it
+func (c *Client) release(call *clientCall, payload []byte, err error) {
+    if call.timer != nil {
+        call.timer.Stop()
+    }
+    <-c.window
+    c.finish(call, payload, err)
+}
+
+func (c *Client) finish(call *clientCall, payload []byte, err error) {
+    c.mu.Lock()
+    if c.reads[call.id] == call {
+        delete(c.reads, call.id)
+{{- if .Cached}}
+        if ttl := cacheTTL(call.id); ttl > 0 && err == nil {
+            call.expires = time.Now().Add(ttl)
+            c.cache[call.id] = call
+        }
+{{- end}}
+    }
+    c.mu.Unlock()
+    call.payload, call.err = payload, err
+    close(call.done)
+}
+{{- if .Cached}}
+
+// cacheTTL returns how long the read response of the register with the ID is cached, 0 if the
+// register is not cached
+func cacheTTL(id uint8) time.Duration {
+    switch id {
+{{- range .Registers}}
+{{- if .CacheTTL}}
+    case {{.ID}}:
+        return {{.CacheTTL}}
+{{- end}}
+{{- end}}
+    }
+    return 0
+}
+{{- end}}
+{{- end}}
+
+{{- if .Capture}}
+
+// ================= Capture decoding =================
+// Registers holds a register of every kind for decoding the captured register traffic, Decode
+// deserializes the payload into the register with the ID and reuses its memory, so the replay
+// doesn't allocate once the arrays reached their sizes. *Registers implements the Decoder of
+// the github.com/dspasibenko/pargus/pkg/capture package.
+type Registers struct {
+{{- range .Registers}}
+    {{.Name}} {{.Name}}
+{{- end}}
+}
+{{- if not (or .Batch .Client)}}
+
+{{template "register_interface"}}
+{{- end}}
+
+// Register returns the register with the ID, or nil if the ID is unknown
+func (rs *Registers) Register(id uint8) Register {
+    switch id {
+{{- range .Registers}}
+    case {{.ID}}:
+        return &rs.{{.Name}}
+{{- end}}
+    }
+    return nil
+}
+
+// Decode deserializes the read fields, or the write fields if write is true, of the register
+// with the ID from the payload, which must be consumed completely
+func (rs *Registers) Decode(id uint8, write bool, payload []byte) error {
+    r := rs.Register(id)
+    if r == nil {
+        return fmt.Errorf("unknown register %d", id)
+    }
+    var n int
+    var err error
+    if write {
+        n, err = r.DeserializeWrite(payload)
+    } else {
+        n, err = r.DeserializeRead(payload)
+    }
+    if err == nil && n != len(payload) {
+        err = fmt.Errorf("the payload of register %d has %d extra bytes", id, len(payload)-n)
+    }
+    return err
+}
+{{- end}}
+
+// ================= Handshake =================
+// Handshake is the layout hashes the device answers once per connection: LayoutHash followed by
+// the [register ID][register layout hash] entries in the ID order, big-endian. The gateway
+// compares it with the hashes of the generated packages and picks the codecs of the device
+// schema before the first request.
+type Handshake struct {
+    LayoutHash uint64
+    Registers  map[uint8]uint64 // the register layout hashes by the register ID
+}
+
+// handshake is the handshake of the registers of the package
+var handshake = [HandshakeSize]byte{
+{{- range .Handshake}}
+    {{.}}
+{{- end}}
+}
+
+// SerializeHandshake writes the handshake of the registers of the package, e.g. for a device
+// simulator, and returns HandshakeSize
+func SerializeHandshake(buf []byte) (int, error) {
+    if len(buf) < HandshakeSize {
+        return 0, fmt.Errorf("buffer too small for the handshake: %d < %d", len(buf), HandshakeSize)
+    }
+    return copy(buf, handshake[:]), nil
+}
+
+// DeserializeHandshake reads the handshake answered by the device, which may have the other
+// registers
+func DeserializeHandshake(buf []byte) (Handshake, error) {
+    if len(buf) < 8 || (len(buf)-8)%9 != 0 {
+        return Handshake{}, fmt.Errorf("invalid handshake size %d", len(buf))
+    }
+    h := Handshake{LayoutHash: binary.BigEndian.Uint64(buf), Registers: make(map[uint8]uint64, (len(buf)-8)/9)}
+    for n := 8; n < len(buf); n += 9 {
+        h.Registers[buf[n]] = binary.BigEndian.Uint64(buf[n+1:])
+    }
+    return h, nil
+}
+
+// Mismatched returns the IDs of the registers of the package which the device doesn't have or
+// codes the other way, in the ID order. It is empty if the device LayoutHash matches, the
+// other registers may still be used otherwise.
+func (h Handshake) Mismatched() []uint8 {
+    var ids []uint8
+    for n := 8; n < HandshakeSize; n += 9 {
+        if hash, ok := h.Registers[handshake[n]]; !ok || hash != binary.BigEndian.Uint64(handshake[n+1:]) {
+            ids = append(ids, handshake[n])
+        }
+    }
+    return ids
+}
+{{- if .Crc}}
+// crcSum returns the {{.Crc.Title}} checksum of p
+func crcSum(p []byte) uint32 {
+{{- if .Crc.IEEE}}
+	return crc32.ChecksumIEEE(p)
+{{- else}}
+	crc := uint32({{.Crc.Init}})
+	for _, b := range p {
+		{{.Crc.Step}}
 	}
-	
-	switch size {
-	case 1:
-		b[0] = byte(v)
-	case 2:
-		binary.BigEndian.PutUint16(b, uint16(v))
-	case 4:
-		binary.BigEndian.PutUint32(b, uint32(v))
-	case 8:
-		binary.BigEndian.PutUint64(b, uint64(v))
-	default:
-		return fmt.Errorf("unsupported type size: %d", size)
+	return crc ^ {{.Crc.XorOut}}
+{{- end}}
+}
+{{- if not .Crc.IEEE}}
+
+var crcTable = [256]uint32{
+{{- range .Crc.Table}}
+	{{.}}
+{{- end}}
+}
+{{- end}}
+
+// appendCrc writes the checksum of the n bytes of the wire data after them
+func appendCrc(buf []byte, n int) (int, error) {
+	if len(buf) < n+CrcSize {
+		return n, fmt.Errorf("buffer too small: need %d bytes, have %d", n+CrcSize, len(buf))
+	}
+	{{.Crc.Put}}
+	return n + CrcSize, nil
+}
+
+// checkCrc checks the checksum following the n bytes of the wire data
+func checkCrc(buf []byte, n int) (int, error) {
+	if len(buf) < n+CrcSize {
+		return n, fmt.Errorf("buffer too small: need %d bytes, have %d", n+CrcSize, len(buf))
+	}
+	if {{.Crc.Get}} != crcSum(buf[:n]) {
+		return n, fmt.Errorf("CRC mismatch")
+	}
+	return n + CrcSize, nil
+}
+
+{{end -}}
+// growBuf extends b by n bytes, reallocating it only if its capacity is too small. The
+// contents of the added bytes are not defined.
+func growBuf(b []byte, n int) []byte {
+	if cap(b)-len(b) >= n {
+		return b[:len(b)+n]
 	}
-	return nil
+	return append(b, make([]byte, n)...)
 }
+{{- if .VarArrays}}
 
-func getNumber[T Integer](b []byte, res *T) error {
-	size := binary.Size(*res)
-	if len(b) < size {
-		return fmt.Errorf("buffer too small: need %d bytes, have %d", size, len(b))
+// resize returns the slice of n elements for the variable-length array deserialization. The
+// slice memory is reused if its capacity allows, so the previously deserialized array is
+// overwritten.
+func resize[T any](s []T, n int) []T {
+	if cap(s) >= n {
+		return s[:n]
 	}
-	
-	switch size {
-	case 1:
-		*res = T(b[0])
-	case 2:
-		*res = T(binary.BigEndian.Uint16(b))
-	case 4:
-		*res = T(binary.BigEndian.Uint32(b))
-	case 8:
-		*res = T(binary.BigEndian.Uint64(b))
-	default:
-		return fmt.Errorf("unsupported type size: %d", size)
+	return make([]T, n)
+}
+{{- end}}
+{{- if .BulkArrays}}
+
+// putSlice writes the elements of s big-endian to buf. The memory of the slice is copied at
+// once and the bytes are swapped in place on the little-endian hosts, 8 bytes at a time.
+func putSlice[T int16 | uint16 | int32 | uint32 | int64 | uint64 | float32 | float64](buf []byte, s []T) {
+	if len(s) == 0 {
+		return
 	}
-	return nil
+	w := int(unsafe.Sizeof(s[0]))
+	n := copy(buf, unsafe.Slice((*byte)(unsafe.Pointer(unsafe.SliceData(s))), len(s)*w))
+	swapBytes(buf[:n], w)
 }
 
-func putSlice[T Integer](b []byte, s []T) error {
+// getSlice reads the big-endian elements of s from buf, see putSlice
+func getSlice[T int16 | uint16 | int32 | uint32 | int64 | uint64 | float32 | float64](s []T, buf []byte) {
 	if len(s) == 0 {
-		return nil
+		return
 	}
-	
-	size := binary.Size(s[0])
-	totalSize := size * len(s)
-	if len(b) < totalSize {
-		return fmt.Errorf("buffer too small: need %d bytes, have %d", totalSize, len(b))
-	}
-	
-	switch size {
-	case 1:
-		for i, val := range s {
-			b[i] = byte(val)
-		}
+	w := int(unsafe.Sizeof(s[0]))
+	raw := unsafe.Slice((*byte)(unsafe.Pointer(unsafe.SliceData(s))), len(s)*w)
+	n := copy(raw, buf)
+	swapBytes(raw[:n], w)
+}
+
+// swapBytes turns the w bytes elements of b from the host byte order to big-endian and back
+func swapBytes(b []byte, w int) {
+	if nativeBigEndian {
+		return
+	}
+	i := 0
+	switch w {
 	case 2:
-		for _, val := range s {
-			binary.BigEndian.PutUint16(b, uint16(val))
-			b = b[2:]
+		for ; i+8 <= len(b); i += 8 {
+			v := binary.LittleEndian.Uint64(b[i:])
+			binary.LittleEndian.PutUint64(b[i:], (v&0x00FF00FF00FF00FF)<<8|(v>>8)&0x00FF00FF00FF00FF)
+		}
+		for ; i+2 <= len(b); i += 2 {
+			b[i], b[i+1] = b[i+1], b[i]
 		}
 	case 4:
-		for _, val := range s {
-			binary.BigEndian.PutUint32(b, uint32(val))
-			b = b[4:]
+		for ; i+8 <= len(b); i += 8 {
+			v := bits.ReverseBytes64(binary.LittleEndian.Uint64(b[i:]))
+			binary.LittleEndian.PutUint64(b[i:], v<<32|v>>32)
+		}
+		for ; i+4 <= len(b); i += 4 {
+			binary.LittleEndian.PutUint32(b[i:], bits.ReverseBytes32(binary.LittleEndian.Uint32(b[i:])))
 		}
 	case 8:
-		for _, val := range s {
-			binary.BigEndian.PutUint64(b, uint64(val))
-			b = b[8:]
+		for ; i+8 <= len(b); i += 8 {
+			binary.LittleEndian.PutUint64(b[i:], bits.ReverseBytes64(binary.LittleEndian.Uint64(b[i:])))
 		}
-	default:
-		return fmt.Errorf("unsupported type size: %d", size)
 	}
-	return nil
 }
 
-func getSlice[T Integer](b []byte, s []T) error {
-	if len(s) == 0 {
-		return nil
+var nativeBigEndian = binary.NativeEndian.Uint16([]byte{0, 1}) == 1
+{{- end}}
+{{- if .Varints}}
+
+// getVarint reads the LEB128 varint of the integer type of the bits size
+func getVarint(b []byte, bits int) (uint64, int, error) {
+	v, n := binary.Uvarint(b)
+	switch {
+	case n == 0:
+		return 0, 0, fmt.Errorf("buffer too small: the varint is truncated")
+	case n < 0 || n > (bits+6)/7 || bits < 64 && v>>bits != 0:
+		return 0, 0, fmt.Errorf("the varint overflows %d bits", bits)
 	}
-	
-	size := binary.Size(s[0])
-	totalSize := size * len(s)
-	if len(b) < totalSize {
-		return fmt.Errorf("buffer too small: need %d bytes, have %d", totalSize, len(b))
-	}
-	
-	switch size {
-	case 1:
-		for i := range s {
-			s[i] = T(b[i])
-		}
-	case 2:
-		for i := range s {
-			s[i] = T(binary.BigEndian.Uint16(b))
-			b = b[2:]
-		}
-	case 4:
-		for i := range s {
-			s[i] = T(binary.BigEndian.Uint32(b))
-			b = b[4:]
-		}
-	case 8:
-		for i := range s {
-			s[i] = T(binary.BigEndian.Uint64(b))
-			b = b[8:]
-		}
-	default:
-		return fmt.Errorf("unsupported type size: %d", size)
+	return v, n, nil
+}
+
+// varintSize returns the number of bytes the LEB128 varint of v takes, the signed values are
+// ZigZag encoded first
+func varintSize(v uint64) int {
+	n := 1
+	for ; v >= 0x80; v >>= 7 {
+		n++
 	}
-	return nil
+	return n
 }
+
+func zigzag(v int64) uint64 {
+	return uint64(v<<1) ^ uint64(v>>63)
+}
+
+func unzigzag(v uint64) int64 {
+	return int64(v>>1) ^ -int64(v&1)
+}
+{{- end}}
+{{- if .BitPacking}}
+
+// putBits writes the n lowest bits of v at the bit position pos of a packed register, the
+// bits are stored most significant bit first and must be zeroed
+func putBits(b []byte, pos, n int, v uint64) {
+	for n > 0 {
+		room := 8 - pos%8
+		k := min(n, room)
+		n -= k
+		b[pos/8] |= byte((v>>n)&(1<<k-1)) << (room - k)
+		pos += k
+	}
+}
+
+// getBits reads n bits at the bit position pos of a packed register
+func getBits(b []byte, pos, n int) uint64 {
+	var v uint64
+	for n > 0 {
+		room := 8 - pos%8
+		k := min(n, room)
+		n -= k
+		v = v<<k | uint64(b[pos/8]>>(room-k))&(1<<k-1)
+		pos += k
+	}
+	return v
+}
+
+// signExtend restores the sign of the n bits two's complement value
+func signExtend(v uint64, n int) int64 {
+	m := uint64(1) << (n - 1)
+	return int64((v ^ m) - m)
+}
+{{- end}}
+
+{{- define "register_interface"}}// Register is implemented by all the registers of the device
+type Register interface {
+    ID() uint8
+    BufSize4Read() int
+    BufSize4Write() int
+    SerializeRead(buf []byte) (int, error)
+    SerializeWrite(buf []byte) (int, error)
+    DeserializeRead(buf []byte) (int, error)
+    DeserializeWrite(buf []byte) (int, error)
+}
+{{- end}}
 `
 
 type GoDevice struct {
-	Doc       []string
-	Package   string
-	Registers []GoRegister
+	Doc        []string
+	Package    string
+	Imports    []string
+	Registers  []GoRegister
+	BitPacking bool // the bit codecs of the packed registers are used
+	Varints    bool // the varint codecs are used
+	VarArrays  bool // the variable-length arrays are used
+	BulkArrays bool // the arrays of the multi-byte elements use the unsafe bulk codecs
+	Batch      bool // the batch frames codec is generated
+	Client     bool // the pipelined Client is generated
+	Cached     bool // the Client caches the reads of some registers
+	Capture    bool // the Registers decoder of the captured traffic is generated
+	Crc        *GoCrc
+	Stats      bool // the codecs call the Hook
+
+	LayoutHash    string // the hash of the wire layout of all registers
+	HandshakeSize int
+	Handshake     []string // the rows of the handshake bytes
+}
+
+// GoCrc is the checksum of the Crc codecs
+type GoCrc struct {
+	Title  string
+	Size   int
+	IEEE   bool   // CRC-32 of hash/crc32
+	Init   string // the initial value and the final xor of the other checksums
+	XorOut string
+	Step   string   // updates crc with the byte b
+	Table  []string // the rows of crcTable
+	Put    string   // writes the checksum of buf[:n] to buf[n:]
+	Get    string   // reads the checksum from buf[n:]
 }
 
 type GoRegister struct {
 	Name               string
 	ID                 uint8
+	LayoutHash         string // the hash of the register wire layout
 	Doc                []string
+	Readable           bool   // the register may be read (not write-only)
+	Writable           bool   // the register may be written (not read-only)
+	CacheTTL           string // the cache time expression of the Client reads, empty if not cached
 	Constants          []GoConstant
 	Fields             []GoField
 	BufSize4ReadConst  int
 	BufSize4WriteConst int
+	ReadWireSizeMax    uint64   // the maximal wire size of the read fields
+	WriteWireSizeMax   uint64   // the maximal wire size of the write fields
+	SerializeRead      []string // Body of SerializeRead function
+	SerializeWrite     []string // Body of SerializeWrite function
+	DeserializeRead    []string // Body of DeserializeRead function
+	DeserializeWrite   []string // Body of DeserializeWrite function
+	Delta              *GoDelta // Delta writes, nil if the register is not delta encoded
+}
+
+// GoDelta describes the delta writes of the register
+type GoDelta struct {
+	MaskSize    int
+	Fields      []GoDirtyField
+	MaskFix     []string // marks the variable-length arrays together with their size fields
+	MaskCheck   []string // checks the received mask has the arrays together with their size fields
+	Size        []string // Body of BufSize4WriteDelta function
+	Serialize   []string // Body of SerializeWriteDelta function
+	Deserialize []string // Body of DeserializeWriteDelta function
+}
+
+// GoDirtyField is the index of the write field in the dirty mask
+type GoDirtyField struct {
+	Name  string
+	Index int
 }
 
 type GoConstant struct {
@@ -308,30 +1265,78 @@ type GoField struct {
 	BitMasks             []string
 	IsReadable           bool
 	IsWritable           bool
-	SerializeReadData    []string // Code for SerializeRead function
-	SerializeWriteData   []string // Code for SerializeWrite function
-	DeserializeReadData  []string // Code for DeserializeRead function
-	DeserializeWriteData []string // Code for DeserializeWrite function
+	SerializeReadData    *GoCodec // Code for SerializeRead function
+	SerializeWriteData   *GoCodec // Code for SerializeWrite function
+	DeserializeReadData  *GoCodec // Code for DeserializeRead function
+	DeserializeWriteData *GoCodec // Code for DeserializeWrite function
 	Trailing             string
 	BufSize4ReadExpr     string   // Expression for variable size (empty if constant)
 	BufSize4WriteExpr    string   // Expression for variable size (empty if constant)
-	ConsistencyChecks    []string // Checks for variable-length arrays
+	ConsistencyChecks    []string // Checks for variable-length arrays and the field constraints
+	DirtyMark            string   // marks the field as changed in the delta registers
+}
+
+// GoCodec is the code which encodes or decodes one field, the same way as CppCodec. The
+// buffer length checks are not part of the code, goCoalesceChecks emits them for whole runs of
+// the static fields.
+type GoCodec struct {
+	Prologue   []string // code preceding the length check, e.g. calculation of the array size
+	SizeExpr   string   // run-time wire size expression, empty if the field doesn't need the check
+	StaticSize int      // compile-time wire size, or -1 if the size is known at run-time only
+	Code       []string
+	Epilogue   []string
+}
+
+// GoOptions controls the Go code generation
+type GoOptions struct {
+	// Batch generates the batch frames codec, which carries several registers in one request or
+	// response, see CppOptions.Batch.
+	Batch bool
+	// Crc adds the Crc codecs, see CppOptions.Crc
+	Crc string
+	// Stats makes the codecs of the registers report their results to the Hook set by SetHook, the
+	// Go counterpart of CppOptions.Stats
+	Stats bool
+	// Unsafe codes the arrays of the multi-byte elements by copying the memory of the slices at
+	// once, with the bytes swapped in place on the little-endian hosts, instead of the loop of
+	// the element codecs. The generated code imports unsafe.
+	Unsafe bool
+	// Client generates the typed Client of the device registers, which pipelines the requests
+	// over the Transport implemented by the application
+	Client bool
+	// Capture generates Registers, the decoder of the captured register traffic by the register
+	// ID for the capture package, see CppOptions.Capture
+	Capture bool
 }
 
+// The template is parsed once, it may be executed concurrently
+var tplGo = template.Must(template.New("go").Parse(goTemplate))
+
 func GenerateGo(dev *parser.Device, pkg string) (string, error) {
-	tpl, err := template.New("go").Parse(goTemplate)
+	return GenerateGoWithOptions(dev, pkg, GoOptions{})
+}
+
+// GenerateGoWithOptions generates the Go file contents
+func GenerateGoWithOptions(dev *parser.Device, pkg string, opts GoOptions) (string, error) {
+	out := GoDevice{Package: pkg, Batch: opts.Batch, Client: opts.Client, Capture: opts.Capture, Stats: opts.Stats}
+	crc, err := findCrcAlgo(opts.Crc)
 	if err != nil {
 		return "", err
 	}
-
-	out := GoDevice{Package: pkg}
+	out.Crc = goCrc(crc)
 	out.Doc = flattenComments(dev.Doc)
 
 	for _, reg := range dev.Registers {
 		gr := GoRegister{
-			Name: reg.Name,
-			ID:   uint8(reg.Number()),
-			Doc:  flattenComments(reg.Doc),
+			Name:             reg.Name,
+			ID:               uint8(reg.Number()),
+			LayoutHash:       goHash(layoutHash(dev, reg)),
+			Doc:              flattenComments(reg.Doc),
+			Readable:         reg.Specifier != "w",
+			Writable:         reg.Specifier != "r",
+			CacheTTL:         goDuration(reg.CacheTTL()),
+			ReadWireSizeMax:  registerMaxWireSize(dev, reg, true),
+			WriteWireSizeMax: registerMaxWireSize(dev, reg, false),
 		}
 
 		// Process constants
@@ -345,6 +1350,9 @@ func GenerateGo(dev *parser.Device, pkg string) (string, error) {
 			gr.Constants = append(gr.Constants, gc)
 		}
 
+		readBits, readPacked := packedLayout(reg, true)
+		writeBits, writePacked := packedLayout(reg, false)
+		out.BitPacking = out.BitPacking || reg.IsPacked()
 		for _, f := range reg.Body.Fields() {
 			gf := GoField{
 				Doc:             flattenComments(f.Doc),
@@ -355,41 +1363,35 @@ func GenerateGo(dev *parser.Device, pkg string) (string, error) {
 				IsWritable:      f.Specifier == "w" || f.Specifier == "",
 			}
 
+			var serCode, deserCode *GoCodec
 			switch {
 			case f.Type.Simple != nil && f.Type.Simple.IsRegisterRef():
 				refRegName := f.Type.Simple.Name
+				refReg := dev.FindRegisterByName(refRegName)
 				gf.Type = refRegName
 				gf.Decl = fmt.Sprintf("%s %s", f.Name, refRegName)
 
-				// For RegisterRef, populate the appropriate contexts
-				if gf.IsReadable {
-					gf.SerializeReadData = append(gf.SerializeReadData,
-						fmt.Sprintf("if n, err := r.%s.SerializeRead(buf[offset:]); err != nil {", f.Name),
-						"    return offset, err",
-						"} else {",
-						"    offset += n",
-						"}")
-					gf.DeserializeReadData = append(gf.DeserializeReadData,
-						fmt.Sprintf("if n, err := r.%s.DeserializeRead(buf[offset:]); err != nil {", f.Name),
+				// For RegisterRef, populate the appropriate contexts. The nested register checks
+				// its buffer itself, but if its size is static it joins the run of the static fields.
+				nestedCall := func(method string) []string {
+					return []string{
+						fmt.Sprintf("if n, err := r.%s.%s(buf[offset:]); err != nil {", f.Name, method),
 						"    return offset, err",
 						"} else {",
 						"    offset += n",
-						"}")
+						"}",
+					}
+				}
+				if gf.IsReadable {
+					size := registerWireSize(dev, refReg, true)
+					gf.SerializeReadData = &GoCodec{StaticSize: size, Code: nestedCall("SerializeRead")}
+					gf.DeserializeReadData = &GoCodec{StaticSize: size, Code: nestedCall("DeserializeRead")}
 					gf.BufSize4ReadExpr = fmt.Sprintf("r.%s.BufSize4Read()", f.Name)
 				}
 				if gf.IsWritable {
-					gf.SerializeWriteData = append(gf.SerializeWriteData,
-						fmt.Sprintf("if n, err := r.%s.SerializeWrite(buf[offset:]); err != nil {", f.Name),
-						"    return offset, err",
-						"} else {",
-						"    offset += n",
-						"}")
-					gf.DeserializeWriteData = append(gf.DeserializeWriteData,
-						fmt.Sprintf("if n, err := r.%s.DeserializeWrite(buf[offset:]); err != nil {", f.Name),
-						"    return offset, err",
-						"} else {",
-						"    offset += n",
-						"}")
+					size := registerWireSize(dev, refReg, false)
+					gf.SerializeWriteData = &GoCodec{StaticSize: size, Code: nestedCall("SerializeWrite")}
+					gf.DeserializeWriteData = &GoCodec{StaticSize: size, Code: nestedCall("DeserializeWrite")}
 					gf.BufSize4WriteExpr = fmt.Sprintf("r.%s.BufSize4Write()", f.Name)
 				}
 
@@ -422,131 +1424,108 @@ func GenerateGo(dev *parser.Device, pkg string) (string, error) {
 						fmt.Sprintf("const %s_%s_%s_bm %s = 0x%X", reg.Name,
 							f.Name, bm.Name, base, mask))
 				}
-				size := typeSize(base)
-				serCode := []string{
-					fmt.Sprintf("if err := putNumber(buf[offset:], r.%s); err != nil {", f.Name),
-					"    return offset, err",
-					"}",
-					fmt.Sprintf("offset += %d", size),
-				}
-				deserCode := []string{
-					fmt.Sprintf("if err := getNumber(buf[offset:], &r.%s); err != nil {", f.Name),
-					"    return offset, err",
-					"}",
-					fmt.Sprintf("offset += %d", size),
-				}
+				serCode, deserCode = goValueCodecs(base, "r."+f.Name)
 
-				// Bitfield code is the same for read and write contexts
+				// Bitfield buffer size is constant - add directly to register
 				if gf.IsReadable {
-					gf.SerializeReadData = append(gf.SerializeReadData, serCode...)
-					gf.DeserializeReadData = append(gf.DeserializeReadData, deserCode...)
-					gr.BufSize4ReadConst += size
+					gr.BufSize4ReadConst += serCode.StaticSize
 				}
 				if gf.IsWritable {
-					gf.SerializeWriteData = append(gf.SerializeWriteData, serCode...)
-					gf.DeserializeWriteData = append(gf.DeserializeWriteData, deserCode...)
-					gr.BufSize4WriteConst += size
+					gr.BufSize4WriteConst += serCode.StaticSize
 				}
 
 			case f.Type.Array != nil && f.Type.Array.Size.Constant != nil:
 				elem := toGoTypes(f.Type.Array.Type.Name)
+				out.BulkArrays = out.BulkArrays || opts.Unsafe && typeSize(elem) > 1
 				sz := *f.Type.Array.Size.Constant
 				gf.Type = fmt.Sprintf("[%s]%s", sz, elem)
 				gf.Decl = fmt.Sprintf("%s %s", f.Name, gf.Type)
-				elemSize := typeSize(elem)
-				serCode := []string{
-					fmt.Sprintf("if err := putSlice(buf[offset:], r.%s[:]); err != nil {", f.Name),
-					"    return offset, err",
-					"}",
-					fmt.Sprintf("offset += %s * %d", sz, elemSize),
-				}
-				deserCode := []string{
-					fmt.Sprintf("if err := getSlice(buf[offset:], r.%s[:]); err != nil {", f.Name),
-					"    return offset, err",
-					"}",
-					fmt.Sprintf("offset += %s * %d", sz, elemSize),
-				}
 
 				// Constant array buffer size: array size * element size - add directly to register
-				szInt, _ := strconv.Atoi(sz)
-				bufSizeConst := szInt * elemSize
+				bufSizeConst := fieldWireSize(dev, f, true)
+				serCode = &GoCodec{StaticSize: bufSizeConst, Code: goArrayEncode(elem, fmt.Sprintf("r.%s[:]", f.Name), opts.Unsafe)}
+				serCode.Code = append(serCode.Code, fmt.Sprintf("offset += %d", bufSizeConst))
+				deserCode = &GoCodec{StaticSize: bufSizeConst, Code: goArrayDecode(elem, fmt.Sprintf("r.%s[:]", f.Name), opts.Unsafe)}
+				deserCode.Code = append(deserCode.Code, fmt.Sprintf("offset += %d", bufSizeConst))
 				if gf.IsReadable {
-					gf.SerializeReadData = append(gf.SerializeReadData, serCode...)
-					gf.DeserializeReadData = append(gf.DeserializeReadData, deserCode...)
 					gr.BufSize4ReadConst += bufSizeConst
 				}
 				if gf.IsWritable {
-					gf.SerializeWriteData = append(gf.SerializeWriteData, serCode...)
-					gf.DeserializeWriteData = append(gf.DeserializeWriteData, deserCode...)
 					gr.BufSize4WriteConst += bufSizeConst
 				}
 
 			case f.Type.Array != nil && f.Type.Array.Size.Variable != nil:
 				elem := toGoTypes(f.Type.Array.Type.Name)
+				out.BulkArrays = out.BulkArrays || opts.Unsafe && typeSize(elem) > 1
 				refField := *f.Type.Array.Size.Variable
 				gf.Type = "[]" + elem
 				gf.Decl = fmt.Sprintf("%s %s", f.Name, gf.Type)
 				elemSize := typeSize(elem)
+				out.VarArrays = true
 
 				fld, bm := reg.FindFieldByName(refField, len(gr.Fields))
 
 				var bufSizeExpr string
-				var serCode, deserCode []string
-
 				if bm != nil {
-					serCode = []string{
+					// the size is kept in the bit mask field
+					elems := []string{
 						"{",
-						fmt.Sprintf("    elems := (r.%s&%s_%s_%s_bm)>>%d", fld.Name, reg.Name, fld.Name, bm.Name, bm.StartBit()),
-						fmt.Sprintf("    if err := putSlice(buf[offset:], r.%s); err != nil {", f.Name),
-						"        return offset, err",
-						"    }",
-						fmt.Sprintf("    offset += int(elems) * %d", elemSize),
-						"}",
+						fmt.Sprintf("    elems := int((r.%s&%s_%s_%s_bm)>>%d)", fld.Name, reg.Name, fld.Name, bm.Name, bm.StartBit()),
 					}
-					deserCode = []string{
-						"{",
-						fmt.Sprintf("    elems := (r.%s&%s_%s_%s_bm)>>%d", fld.Name, reg.Name, fld.Name, bm.Name, bm.StartBit()),
-						fmt.Sprintf("    r.%s = make([]%s, int(elems))", f.Name, elem),
-						fmt.Sprintf("    if err := getSlice(buf[offset:], r.%s); err != nil {", f.Name),
-						"        return offset, err",
-						"    }",
-						fmt.Sprintf("    offset += int(elems) * %d", elemSize),
-						"}",
+					serCode = &GoCodec{
+						Prologue:   elems,
+						SizeExpr:   goTimes("elems", elemSize),
+						StaticSize: -1,
+						Code:       indentLines(goArrayEncode(elem, "r."+f.Name, opts.Unsafe), "    "),
+						Epilogue:   []string{"}"},
+					}
+					deserCode = &GoCodec{
+						Prologue:   elems,
+						SizeExpr:   goTimes("elems", elemSize),
+						StaticSize: -1,
+						Code: indentLines(append([]string{fmt.Sprintf("r.%s = resize(r.%s, elems)", f.Name, f.Name)},
+							goArrayDecode(elem, "r."+f.Name, opts.Unsafe)...), "    "),
+						Epilogue: []string{"}"},
 					}
 					// Variable array buffer size: element size * bitfield value
 					bufSizeExpr = fmt.Sprintf("(int((r.%s&%s_%s_%s_bm)>>%d) * %d)",
 						fld.Name, reg.Name, fld.Name, bm.Name, bm.StartBit(), elemSize)
 				} else {
-					serCode = []string{
-						"{",
-						fmt.Sprintf("    elems := r.%s", refField),
-						fmt.Sprintf("    if err := putSlice(buf[offset:], r.%s); err != nil {", f.Name),
-						"        return offset, err",
-						"    }",
-						fmt.Sprintf("    offset += int(elems) * %d", elemSize),
-						"}",
+					elems := fmt.Sprintf("int(r.%s)", refField)
+					serCode = &GoCodec{
+						SizeExpr:   goTimes(elems, elemSize),
+						StaticSize: -1,
+						Code:       goArrayEncode(elem, "r."+f.Name, opts.Unsafe),
 					}
-					deserCode = []string{
-						"{",
-						fmt.Sprintf("    elems := r.%s", refField),
-						fmt.Sprintf("    r.%s = make([]%s, int(elems))", f.Name, elem),
-						fmt.Sprintf("    if err := getSlice(buf[offset:], r.%s); err != nil {", f.Name),
-						"        return offset, err",
-						"    }",
-						fmt.Sprintf("    offset += int(elems) * %d", elemSize),
-						"}",
+					deserCode = &GoCodec{
+						SizeExpr:   goTimes(elems, elemSize),
+						StaticSize: -1,
+						Code: append([]string{fmt.Sprintf("r.%s = resize(r.%s, %s)", f.Name, f.Name, elems)},
+							goArrayDecode(elem, "r."+f.Name, opts.Unsafe)...),
 					}
 					// Variable array buffer size: element size * reference field
 					bufSizeExpr = fmt.Sprintf("(int(r.%s) * %d)", refField, elemSize)
 				}
-
-				if gf.IsReadable {
-					gf.SerializeReadData = append(gf.SerializeReadData, serCode...)
-					gf.DeserializeReadData = append(gf.DeserializeReadData, deserCode...)
+				advance := fmt.Sprintf("offset += %s", goTimes(fmt.Sprintf("len(r.%s)", f.Name), elemSize))
+				if bm != nil {
+					advance = "    " + advance
 				}
-				if gf.IsWritable {
-					gf.SerializeWriteData = append(gf.SerializeWriteData, serCode...)
-					gf.DeserializeWriteData = append(gf.DeserializeWriteData, deserCode...)
+				serCode.Code = append(serCode.Code, advance)
+				deserCode.Code = append(deserCode.Code, advance)
+				if c := f.Type.Array.Capacity(); c > 0 {
+					// the bounded array rejects the bigger counts
+					elems, indent := fmt.Sprintf("int(r.%s)", refField), ""
+					if bm != nil {
+						elems, indent = "elems", "    "
+					}
+					deserCode.Prologue = append(append([]string{}, deserCode.Prologue...),
+						fmt.Sprintf("%sif %s > %d {", indent, elems, c),
+						fmt.Sprintf("%s    return offset, fmt.Errorf(\"array %s has %%d elements, the capacity is %d\", %s)", indent, f.Name, c, elems),
+						indent+"}")
+					gf.ConsistencyChecks = append(gf.ConsistencyChecks,
+						fmt.Sprintf("if len(r.%s) > %d {", f.Name, c),
+						fmt.Sprintf("    return fmt.Errorf(\"array %s has %%d elements, the capacity is %d\", len(r.%s))", f.Name, c, f.Name),
+						"}")
 				}
 
 				// Generate consistency checks for variable-length arrays
@@ -572,34 +1551,50 @@ func GenerateGo(dev *parser.Device, pkg string) (string, error) {
 					gf.BufSize4WriteExpr = bufSizeExpr
 				}
 
-			case f.Type.Simple != nil:
+			case f.Type.Simple != nil && f.IsVarint():
 				elem := toGoTypes(f.Type.Simple.Name)
 				gf.Type = elem
 				gf.Decl = fmt.Sprintf("%s %s", f.Name, elem)
-				size := typeSize(elem)
-				serCode := []string{
-					fmt.Sprintf("if err := putNumber(buf[offset:], r.%s); err != nil {", f.Name),
-					"    return offset, err",
-					"}",
-					fmt.Sprintf("offset += %d", size),
+				out.Varints = true
+				value := fmt.Sprintf("uint64(r.%s)", f.Name)
+				decoded := fmt.Sprintf("%s(v)", elem)
+				if strings.HasPrefix(elem, "int") {
+					value = fmt.Sprintf("zigzag(int64(r.%s))", f.Name)
+					decoded = fmt.Sprintf("%s(unzigzag(v))", elem)
 				}
-				deserCode := []string{
-					fmt.Sprintf("if err := getNumber(buf[offset:], &r.%s); err != nil {", f.Name),
+				size := fmt.Sprintf("varintSize(%s)", value)
+				serCode = &GoCodec{SizeExpr: size, StaticSize: -1, Code: []string{
+					fmt.Sprintf("offset += binary.PutUvarint(buf[offset:], %s)", value),
+				}}
+				// the decoder checks the buffer itself, the varint size is unknown before
+				deserCode = &GoCodec{StaticSize: -1, Code: []string{
+					fmt.Sprintf("if v, n, err := getVarint(buf[offset:], %d); err != nil {", typeSize(elem)*8),
 					"    return offset, err",
+					"} else {",
+					fmt.Sprintf("    r.%s = %s", f.Name, decoded),
+					"    offset += n",
 					"}",
-					fmt.Sprintf("offset += %d", size),
+				}}
+
+				if gf.IsReadable {
+					gf.BufSize4ReadExpr = size
+				}
+				if gf.IsWritable {
+					gf.BufSize4WriteExpr = size
 				}
 
+			case f.Type.Simple != nil:
+				elem := toGoTypes(f.Type.Simple.Name)
+				gf.Type = elem
+				gf.Decl = fmt.Sprintf("%s %s", f.Name, elem)
+				serCode, deserCode = goValueCodecs(elem, "r."+f.Name)
+
 				// Simple type buffer size is constant - add directly to register
 				if gf.IsReadable {
-					gf.SerializeReadData = append(gf.SerializeReadData, serCode...)
-					gf.DeserializeReadData = append(gf.DeserializeReadData, deserCode...)
-					gr.BufSize4ReadConst += size
+					gr.BufSize4ReadConst += serCode.StaticSize
 				}
 				if gf.IsWritable {
-					gf.SerializeWriteData = append(gf.SerializeWriteData, serCode...)
-					gf.DeserializeWriteData = append(gf.DeserializeWriteData, deserCode...)
-					gr.BufSize4WriteConst += size
+					gr.BufSize4WriteConst += serCode.StaticSize
 				}
 
 			default:
@@ -607,19 +1602,492 @@ func GenerateGo(dev *parser.Device, pkg string) (string, error) {
 				gf.Decl = fmt.Sprintf("// unsupported field %s", f.Name)
 			}
 
+			if serCode != nil {
+				if gf.IsReadable {
+					gf.SerializeReadData = serCode
+					gf.DeserializeReadData = deserCode
+				}
+				if gf.IsWritable {
+					gf.SerializeWriteData = serCode
+					gf.DeserializeWriteData = deserCode
+				}
+			}
+			if reg.IsPacked() {
+				i := len(gr.Fields)
+				if gf.IsReadable {
+					gf.SerializeReadData, gf.DeserializeReadData = goPackedCodecs(f, readBits, readPacked, i)
+				}
+				if gf.IsWritable {
+					gf.SerializeWriteData, gf.DeserializeWriteData = goPackedCodecs(f, writeBits, writePacked, i)
+				}
+			}
+			if cond, msg := goConstraint(f); cond != "" {
+				// the decoded value is checked before the following fields are decoded, so the
+				// frame is rejected before their arrays are allocated
+				gf.ConsistencyChecks = append(gf.ConsistencyChecks,
+					fmt.Sprintf("if %s {", cond), "    return "+msg, "}")
+				check := []string{fmt.Sprintf("if %s {", cond), "    return offset, " + msg, "}"}
+				gf.DeserializeReadData = goWithCheck(gf.DeserializeReadData, check)
+				gf.DeserializeWriteData = goWithCheck(gf.DeserializeWriteData, check)
+			}
+
 			gr.Fields = append(gr.Fields, gf)
 		}
+		if reg.IsPacked() {
+			gr.BufSize4ReadConst, gr.BufSize4WriteConst = readPacked, writePacked
+		}
+
+		var serRead, serWrite, deserRead, deserWrite []*GoCodec
+		for _, gf := range gr.Fields {
+			serRead = appendGoCodec(serRead, gf.SerializeReadData)
+			serWrite = appendGoCodec(serWrite, gf.SerializeWriteData)
+			deserRead = appendGoCodec(deserRead, gf.DeserializeReadData)
+			deserWrite = appendGoCodec(deserWrite, gf.DeserializeWriteData)
+		}
+		gr.SerializeRead = goCoalesceChecks(serRead)
+		gr.SerializeWrite = goCoalesceChecks(serWrite)
+		gr.DeserializeRead = goCoalesceChecks(deserRead)
+		gr.DeserializeWrite = goCoalesceChecks(deserWrite)
+
+		if reg.FindOption("delta") != nil {
+			gr.Delta = goDelta(dev, reg, gr.Fields)
+		}
 
+		out.Cached = out.Cached || opts.Client && gr.CacheTTL != ""
 		out.Registers = append(out.Registers, gr)
 	}
+	out.LayoutHash = goHash(deviceLayoutHash(dev))
+	out.HandshakeSize = handshakeSize(dev)
+	out.Handshake = handshakeRows(dev, "LayoutHash", func(reg string) string { return reg + ".LayoutHash()" })
+	out.Imports = goImports(&out)
 
 	var buf bytes.Buffer
-	if err := tpl.Execute(&buf, out); err != nil {
+	if err := tplGo.Execute(&buf, out); err != nil {
 		return "", err
 	}
 	return strings.TrimSpace(buf.String()) + "\n", nil
 }
 
+// goConstraint returns the condition of the invalid value of the constrained field and the
+// error describing it, empty if the field has no constraint
+func goConstraint(f *parser.Field) (string, string) {
+	c := f.Constraint()
+	if c == nil {
+		return "", ""
+	}
+	value := "r." + f.Name
+	var conds []string
+	var desc string
+	if len(c.Enum) > 0 {
+		for _, v := range c.Enum {
+			conds = append(conds, fmt.Sprintf("%s != %s", value, v))
+		}
+		return strings.Join(conds, " && "),
+			fmt.Sprintf("fmt.Errorf(\"field %s value %%d is not one of %s\", %s)", f.Name, strings.Join(c.Enum, ", "), value)
+	}
+	if c.Min != "" {
+		conds = append(conds, fmt.Sprintf("%s < %s", value, c.Min))
+		desc = "min " + c.Min
+	}
+	if c.Max != "" {
+		conds = append(conds, fmt.Sprintf("%s > %s", value, c.Max))
+		desc = strings.TrimPrefix(desc+", max "+c.Max, ", ")
+	}
+	return strings.Join(conds, " || "),
+		fmt.Sprintf("fmt.Errorf(\"field %s value %%d violates %s\", %s)", f.Name, desc, value)
+}
+
+// goWithCheck returns the copy of the deserialization codec followed by the check
+func goWithCheck(c *GoCodec, check []string) *GoCodec {
+	if c == nil {
+		return nil
+	}
+	cc := *c
+	if len(cc.Epilogue) > 0 {
+		cc.Epilogue = append(append([]string{}, cc.Epilogue...), check...)
+	} else {
+		cc.Code = append(append([]string{}, cc.Code...), check...)
+	}
+	return &cc
+}
+
+func appendGoCodec(codecs []*GoCodec, c *GoCodec) []*GoCodec {
+	if c == nil {
+		return codecs
+	}
+	return append(codecs, c)
+}
+
+// goCoalesceChecks builds the function body from the fields codecs, checking the buffer length
+// once per run of the static fields, see coalesceBoundsChecks
+func goCoalesceChecks(codecs []*GoCodec) []string {
+	var res []string
+	i := 0
+	for i <= len(codecs) {
+		// the segment head is either the function entry or a field with the run-time size
+		var head *GoCodec
+		if i > 0 {
+			head = codecs[i-1]
+		}
+		runSize := 0
+		j := i
+		for ; j < len(codecs) && codecs[j].StaticSize >= 0; j++ {
+			runSize += codecs[j].StaticSize
+		}
+
+		switch {
+		case head == nil:
+			if runSize > 0 {
+				res = append(res, goLenCheck("", strconv.Itoa(runSize))...)
+			}
+		case head.SizeExpr != "":
+			need := "offset+" + head.SizeExpr
+			if runSize > 0 {
+				need = fmt.Sprintf("%s+%d", need, runSize)
+			}
+			res = append(res, head.Prologue...)
+			res = append(res, goLenCheck(goBlockIndent(head), need)...)
+			res = append(res, head.Code...)
+			res = append(res, head.Epilogue...)
+		default:
+			res = append(res, head.Prologue...)
+			res = append(res, head.Code...)
+			res = append(res, head.Epilogue...)
+			if runSize > 0 {
+				res = append(res, goLenCheck("", fmt.Sprintf("offset+%d", runSize))...)
+			}
+		}
+
+		for _, c := range codecs[i:j] {
+			res = append(res, c.Prologue...)
+			res = append(res, c.Code...)
+			res = append(res, c.Epilogue...)
+		}
+		i = j + 1
+	}
+	return res
+}
+
+// goCheckedCode returns the code of the single field with its own buffer length check
+func goCheckedCode(c *GoCodec) []string {
+	res := append([]string{}, c.Prologue...)
+	switch {
+	case c.SizeExpr != "":
+		res = append(res, goLenCheck(goBlockIndent(c), "offset+"+c.SizeExpr)...)
+	case c.StaticSize > 0:
+		res = append(res, goLenCheck("", fmt.Sprintf("offset+%d", c.StaticSize))...)
+	}
+	res = append(res, c.Code...)
+	return append(res, c.Epilogue...)
+}
+
+// goLenCheck returns the check that the buffer holds at least need bytes
+func goLenCheck(indent, need string) []string {
+	return []string{
+		fmt.Sprintf("%sif len(buf) < %s {", indent, need),
+		fmt.Sprintf("%s    return offset, fmt.Errorf(\"buffer too small: need %%d bytes, have %%d\", %s, len(buf))", indent, need),
+		indent + "}",
+	}
+}
+
+// goBlockIndent returns the indentation of the length check for the codecs enclosed into a block
+func goBlockIndent(c *GoCodec) string {
+	if len(c.Epilogue) > 0 {
+		return "    "
+	}
+	return ""
+}
+
+// goValueCodecs returns the codecs of the simple type value
+func goValueCodecs(typ, value string) (*GoCodec, *GoCodec) {
+	size := typeSize(typ)
+	advance := fmt.Sprintf("offset += %d", size)
+	ser := &GoCodec{StaticSize: size, Code: []string{goPutValue(typ, "offset", value), advance}}
+	deser := &GoCodec{StaticSize: size, Code: []string{fmt.Sprintf("%s = %s", value, goGetValue(typ, "offset")), advance}}
+	return ser, deser
+}
+
+// goPutValue returns the statement writing the value of the simple type at buf[at:]
+func goPutValue(typ, at, value string) string {
+	size := typeSize(typ)
+	if size == 1 {
+		if typ != "uint8" {
+			value = fmt.Sprintf("byte(%s)", value)
+		}
+		return fmt.Sprintf("buf[%s] = %s", at, value)
+	}
+	bits := strconv.Itoa(size * 8)
+	switch {
+	case strings.HasPrefix(typ, "float"):
+		value = fmt.Sprintf("math.Float%sbits(%s)", bits, value)
+	case typ != "uint"+bits:
+		value = fmt.Sprintf("uint%s(%s)", bits, value)
+	}
+	return fmt.Sprintf("binary.BigEndian.PutUint%s(buf[%s:], %s)", bits, at, value)
+}
+
+// goGetValue returns the expression reading the value of the simple type from buf[at:]
+func goGetValue(typ, at string) string {
+	size := typeSize(typ)
+	if size == 1 {
+		if typ != "uint8" {
+			return fmt.Sprintf("%s(buf[%s])", typ, at)
+		}
+		return fmt.Sprintf("buf[%s]", at)
+	}
+	bits := strconv.Itoa(size * 8)
+	value := fmt.Sprintf("binary.BigEndian.Uint%s(buf[%s:])", bits, at)
+	switch {
+	case strings.HasPrefix(typ, "float"):
+		return fmt.Sprintf("math.Float%sfrombits(%s)", bits, value)
+	case typ != "uint"+bits:
+		return fmt.Sprintf("%s(%s)", typ, value)
+	}
+	return value
+}
+
+// goArrayEncode returns the code writing the array elements at buf[offset:], the offset is
+// not moved. The bulk code copies the memory of the multi-byte elements at once.
+func goArrayEncode(typ, arr string, bulk bool) []string {
+	switch {
+	case typ == "uint8":
+		return []string{fmt.Sprintf("copy(buf[offset:], %s)", arr)}
+	case bulk && typeSize(typ) > 1:
+		return []string{fmt.Sprintf("putSlice(buf[offset:], %s)", arr)}
+	}
+	return []string{
+		fmt.Sprintf("for i, v := range %s {", arr),
+		"    " + goPutValue(typ, goElemOffset(typ), "v"),
+		"}",
+	}
+}
+
+// goArrayDecode returns the code reading the array elements from buf[offset:], the offset is
+// not moved, see goArrayEncode
+func goArrayDecode(typ, arr string, bulk bool) []string {
+	switch {
+	case typ == "uint8":
+		return []string{fmt.Sprintf("copy(%s, buf[offset:])", arr)}
+	case bulk && typeSize(typ) > 1:
+		return []string{fmt.Sprintf("getSlice(%s, buf[offset:])", arr)}
+	}
+	arr = strings.TrimSuffix(arr, "[:]")
+	return []string{
+		fmt.Sprintf("for i := range %s {", arr),
+		fmt.Sprintf("    %s[i] = %s", arr, goGetValue(typ, goElemOffset(typ))),
+		"}",
+	}
+}
+
+// goElemOffset returns the buffer index of the array element i
+func goElemOffset(typ string) string {
+	return "offset+" + goTimes("i", typeSize(typ))
+}
+
+// goTimes returns the expression of the value multiplied by n
+func goTimes(value string, n int) string {
+	if n == 1 {
+		return value
+	}
+	return fmt.Sprintf("%s*%d", value, n)
+}
+
+// goHash returns the Go literal of the layout hash
+func goHash(h uint64) string {
+	return fmt.Sprintf("0x%016X", h)
+}
+
+func indentLines(lines []string, indent string) []string {
+	res := make([]string, 0, len(lines))
+	for _, line := range lines {
+		res = append(res, indent+line)
+	}
+	return res
+}
+
+// goCrc returns the checksum of the Crc codecs
+func goCrc(a *crcAlgo) *GoCrc {
+	if a == nil {
+		return nil
+	}
+	c := &GoCrc{Title: a.Title, Size: a.Width / 8, IEEE: a.Reflected}
+	if c.IEEE {
+		c.Put = "binary.BigEndian.PutUint32(buf[n:], crcSum(buf[:n]))"
+		c.Get = "binary.BigEndian.Uint32(buf[n:])"
+		return c
+	}
+	hex := func(v uint32) string { return fmt.Sprintf("0x%0*X", a.Width/4, v) }
+	c.Init, c.XorOut = hex(a.Init), hex(a.XorOut)
+	t := a.slicingTables()[0]
+	for i := 0; i < 256; i += 8 {
+		var row []string
+		for _, v := range t[i : i+8] {
+			row = append(row, hex(v))
+		}
+		c.Table = append(c.Table, strings.Join(row, ", ")+",")
+	}
+	if a.Width == 8 {
+		c.Step = "crc = crcTable[byte(crc)^b]"
+		c.Put = "buf[n] = byte(crcSum(buf[:n]))"
+		c.Get = "uint32(buf[n])"
+	} else {
+		c.Step = "crc = (crc<<8 ^ crcTable[byte(crc>>8)^b]) & 0xFFFF"
+		c.Put = "binary.BigEndian.PutUint16(buf[n:], uint16(crcSum(buf[:n])))"
+		c.Get = "uint32(binary.BigEndian.Uint16(buf[n:]))"
+	}
+	return c
+}
+
+// goImports returns the packages used by the generated code
+func goImports(dev *GoDevice) []string {
+	var code []string
+	for _, gr := range dev.Registers {
+		code = append(code, gr.SerializeRead...)
+		code = append(code, gr.SerializeWrite...)
+		code = append(code, gr.DeserializeRead...)
+		code = append(code, gr.DeserializeWrite...)
+		for _, gf := range gr.Fields {
+			code = append(code, gf.ConsistencyChecks...)
+		}
+		if gr.Delta != nil {
+			code = append(code, "fmt.Errorf")
+		}
+	}
+	// the handshake
+	code = append(code, "binary.BigEndian", "fmt.Errorf")
+	if dev.Varints {
+		code = append(code, "binary.Uvarint", "fmt.Errorf")
+	}
+	if dev.Batch {
+		code = append(code, "binary.BigEndian", "fmt.Errorf")
+	}
+	if dev.BulkArrays {
+		code = append(code, "binary.LittleEndian")
+	}
+	if dev.Client {
+		code = append(code, "context.Context", "fmt.Errorf", "sync.Mutex", "time.Duration")
+	}
+	if dev.Capture {
+		code = append(code, "fmt.Errorf")
+	}
+	if dev.Cached {
+		code = append(code, "time.Now")
+	}
+	if dev.Crc != nil {
+		code = append(code, dev.Crc.Put, dev.Crc.Get, "fmt.Errorf")
+		if dev.Crc.IEEE {
+			code = append(code, "crc32.ChecksumIEEE")
+		}
+	}
+	all := strings.Join(code, "\n")
+	var res []string
+	for _, pkg := range []string{"context", "encoding/binary", "fmt", "hash/crc32", "math", "sync", "time"} {
+		name := pkg[strings.LastIndex(pkg, "/")+1:]
+		if strings.Contains(all, name+".") {
+			res = append(res, pkg)
+		}
+	}
+	if dev.BulkArrays {
+		res = append(res, "math/bits", "unsafe")
+		sort.Strings(res)
+	}
+	return res
+}
+
+// goDuration returns the Go expression of the duration in the biggest whole units, empty for 0,
+// the cache option durations are whole milliseconds
+func goDuration(d time.Duration) string {
+	for _, u := range []struct {
+		d    time.Duration
+		name string
+	}{{time.Hour, "Hour"}, {time.Minute, "Minute"}, {time.Second, "Second"}, {time.Millisecond, "Millisecond"}} {
+		if d > 0 && d%u.d == 0 {
+			return fmt.Sprintf("%d * time.%s", d/u.d, u.name)
+		}
+	}
+	return ""
+}
+
+// goDelta builds the delta writes of the register and makes the setters of the write fields
+// mark them dirty. See cppDelta for the encoding.
+func goDelta(dev *parser.Device, reg *parser.Register, fields []GoField) *GoDelta {
+	d := &GoDelta{}
+	dirty, pairs := deltaLayout(reg)
+	bit := func(index int) string {
+		return fmt.Sprintf("mask[%d]&0x%02X != 0", index/8, 1<<(index%8))
+	}
+	for i, f := range reg.Body.Fields() {
+		if dirty[i] < 0 {
+			continue
+		}
+		d.Fields = append(d.Fields, GoDirtyField{Name: f.Name, Index: dirty[i]})
+		fields[i].DirtyMark = fmt.Sprintf("r.dirty[%d] |= 0x%02X", dirty[i]/8, 1<<(dirty[i]%8))
+
+		size := fields[i].BufSize4WriteExpr
+		if fs := fieldWireSize(dev, f, false); fs >= 0 {
+			size = strconv.Itoa(fs)
+		}
+		d.Size = append(d.Size, fmt.Sprintf("if %s {", bit(dirty[i])), "    size += "+size, "}")
+		d.Serialize = append(d.Serialize, goDirtyBlock(bit(dirty[i]), fields[i].SerializeWriteData)...)
+		d.Deserialize = append(d.Deserialize, goDirtyBlock(bit(dirty[i]), fields[i].DeserializeWriteData)...)
+	}
+	d.MaskSize = max((len(d.Fields)+7)/8, 1)
+
+	for _, p := range pairs {
+		d.MaskFix = append(d.MaskFix,
+			fmt.Sprintf("if %s || %s {", bit(p[0]), bit(p[1])),
+			fmt.Sprintf("    mask[%d] |= 0x%02X", p[0]/8, 1<<(p[0]%8)),
+			fmt.Sprintf("    mask[%d] |= 0x%02X", p[1]/8, 1<<(p[1]%8)),
+			"}")
+		d.MaskCheck = append(d.MaskCheck,
+			fmt.Sprintf("if (%s) != (%s) {", bit(p[0]), bit(p[1])),
+			fmt.Sprintf("    return 0, fmt.Errorf(\"array %s is sent without its size field\")", reg.Body.Fields()[indexOf(dirty, p[0])].Name),
+			"}")
+	}
+	return d
+}
+
+// goDirtyBlock returns the field code which runs only if the field bit of the mask is set.
+// The field checks the buffer itself.
+func goDirtyBlock(cond string, c *GoCodec) []string {
+	res := []string{fmt.Sprintf("if %s {", cond)}
+	res = append(res, indentLines(goCheckedCode(c), "    ")...)
+	return append(res, "}")
+}
+
+// goPackedCodecs returns the codecs of the field i of the packed register. The bit positions
+// of the fields and the wire size come from packedLayout. The first field of the direction
+// carries the wire size for the length check and zeroes the bits, the last one moves the offset.
+func goPackedCodecs(f *parser.Field, bitPos []int, size, i int) (*GoCodec, *GoCodec) {
+	first, last := true, true
+	for j, pos := range bitPos {
+		first = first && (j >= i || pos < 0)
+		last = last && (j <= i || pos < 0)
+	}
+	typ := packedType(f)
+	n := f.Bits()
+	ser := &GoCodec{Code: []string{
+		fmt.Sprintf("putBits(buf[offset:], %d, %d, uint64(r.%s))", bitPos[i], n, f.Name),
+	}}
+	value := fmt.Sprintf("getBits(buf[offset:], %d, %d)", bitPos[i], n)
+	if strings.HasPrefix(typ, "int") {
+		value = fmt.Sprintf("signExtend(%s, %d)", value, n)
+	}
+	deser := &GoCodec{Code: []string{
+		fmt.Sprintf("r.%s = %s(%s)", f.Name, toGoTypes(typ), value),
+	}}
+	if first {
+		ser.StaticSize, deser.StaticSize = size, size
+		ser.Code = append([]string{fmt.Sprintf("clear(buf[offset : offset+%d])", size)}, ser.Code...)
+	}
+	if last {
+		advance := fmt.Sprintf("offset += %d", size)
+		ser.Code = append(ser.Code, advance)
+		deser.Code = append(deser.Code, advance)
+	}
+	return ser, deser
+}
+
 //
 // Helpers
 //
@@ -650,18 +2118,3 @@ func toGoTypes(typ string) string {
 		return "interface{}"
 	}
 }
-
-func typeSize(goType string) int {
-	switch goType {
-	case "int8", "uint8":
-		return 1
-	case "int16", "uint16":
-		return 2
-	case "int32", "uint32", "float32":
-		return 4
-	case "int64", "uint64", "float64":
-		return 8
-	default:
-		return 0
-	}
-}
@@ -0,0 +1,247 @@
+package generator
+
+import (
+	"fmt"
+	"io"
+	"regexp"
+	"strings"
+	"text/tabwriter"
+
+	"github.com/dspasibenko/pargus/pkg/parser"
+)
+
+// The report of the C++ codecs shows what the registers cost on the wire, in the memory and on
+// the AVR, so the options of the register (packed, varint, table) may be chosen by the numbers.
+// The bounds checks and the calls are counted in the generated code. The AVR flash and cycles
+// are the estimates of a simple model of avr-gcc -Os: 2 bytes per instruction, 1-2 cycles per
+// instruction. Only the four regular codecs of the registers and their tables are estimated, the
+// report names the rest of the generated code (the shared helpers, the other codecs, the
+// dispatch, the handshake) as not counted. The numbers compare the registers and the options,
+// not predict the exact size.
+const (
+	avrCodecFlash, avrCodecCycles = 16, 12 // the function prologue and epilogue, the offset
+	avrCheckFlash, avrCheckCycles = 10, 5  // a bounds check
+	avrCallFlash, avrCallCycles   = 12, 10 // a call of a helper or a nested register codec
+	avrValueFlash, avrValueCycles = 8, 6   // the check of a constrained value
+	avrByteFlash, avrByteCycles   = 4, 4   // a byte of a scalar field: the load and the store
+	avrDescFlash                  = 12     // the Field_Desc of a table register field
+	avrCopyCycles                 = 7      // a byte copied by memcpy or the element loop
+	avrBitCycles                  = 6      // a bit of a packed field
+	avrVarintCycles               = 14     // a byte of a varint
+	avrTableCycles                = 45     // a field of the table interpreter
+)
+
+// CppReport is the report of the device codecs
+type CppReport struct {
+	Device     string              `json:"device"`
+	Namespace  string              `json:"namespace"`
+	AvrFlash   int                 `json:"avr_flash"`   // the regular codecs and the tables, if they are linked
+	NotCounted []string            `json:"not_counted"` // the generated code the AVR flash leaves out
+	Registers  []CppRegisterReport `json:"registers"`
+}
+
+// CppRegisterReport is the report of the register codecs
+type CppRegisterReport struct {
+	Register   string           `json:"register"`
+	ID         int              `json:"id"`
+	Sizeof     int              `json:"sizeof"`      // the struct size on the 32-bit targets
+	TableFlash int              `json:"table_flash"` // the fields descriptors of the table register
+	Codecs     []CppCodecReport `json:"codecs"`
+}
+
+// CppCodecReport is the report of the codec of one direction: serialize_read,
+// deserialize_read, serialize_write or deserialize_write
+type CppCodecReport struct {
+	Codec        string `json:"codec"`
+	WireSize     int    `json:"wire_size"` // -1 if it is known at run-time only
+	WireSizeMax  uint64 `json:"wire_size_max"`
+	BoundsChecks int    `json:"bounds_checks"` // the buffer size and the array capacity checks
+	Calls        int    `json:"calls"`         // the calls of the codecs and the nested registers
+	AvrFlash     int    `json:"avr_flash"`
+	AvrCycles    uint64 `json:"avr_cycles"`     // the variable-length arrays empty, the shortest varints
+	AvrCyclesMax uint64 `json:"avr_cycles_max"` // the biggest wire size
+}
+
+var (
+	// cppCheck matches the failure branch of the codec body, also passed to PARGUS_COUNT by the
+	// stats option, the helper results and the value constraints are not the bounds checks
+	cppCheck = regexp.MustCompile(`\bif \((.*?)\) return (?:-1|PARGUS_COUNT\(\w+, -1\));`)
+	cppCall  = regexp.MustCompile(`\b(?:bigendian|detail)::\w+\(|\bmemcpy\(|\.\w*serialize_\w+\(`)
+)
+
+// GenerateCppReport builds the C++ code of the device with the options and reports its codecs
+func GenerateCppReport(dev *parser.Device, namespace string, opts CppOptions) (*CppReport, error) {
+	out, err := cppDevice(dev, namespace, namespace+".h", opts)
+	if err != nil {
+		return nil, err
+	}
+	rep := &CppReport{Device: dev.Name, Namespace: namespace, NotCounted: cppNotCounted(out)}
+	for i, reg := range dev.Registers {
+		cr := out.Registers[i]
+		rr := CppRegisterReport{
+			Register: reg.Name,
+			ID:       cr.Number,
+			Sizeof:   cppRegisterLayout(dev, reg, opts.SortFields).size,
+		}
+		if cr.Table != nil {
+			rr.TableFlash = avrDescFlash * (len(cr.Table.Read) + len(cr.Table.Write))
+		}
+		codec := func(name string, body []string, read, deser bool) {
+			cc := CppCodecReport{
+				Codec:       name,
+				WireSize:    registerWireSize(dev, reg, read),
+				WireSizeMax: registerMaxWireSize(dev, reg, read),
+			}
+			for _, l := range body {
+				for _, m := range cppCheck.FindAllStringSubmatch(l, -1) {
+					if m[1] != "res < 0" && !strings.Contains(m[1], "valid_") {
+						cc.BoundsChecks++
+					}
+				}
+				cc.Calls += len(cppCall.FindAllString(l, -1))
+			}
+			cost := avrCost{flash: avrCodecFlash + avrCheckFlash*cc.BoundsChecks}
+			cost.add(0, avrCodecCycles+avrCheckCycles*uint64(cc.BoundsChecks), 0)
+			if cr.Table != nil {
+				cost.add(avrCallFlash, avrCallCycles, 0)
+				cost.addCycles(avrFieldsCost(dev, reg, read, deser), true)
+			} else {
+				cost.addCycles(avrFieldsCost(dev, reg, read, deser), false)
+			}
+			cc.AvrFlash, cc.AvrCycles, cc.AvrCyclesMax = cost.flash, cost.cycles, cost.cyclesMax
+			rep.AvrFlash += cc.AvrFlash
+			rr.Codecs = append(rr.Codecs, cc)
+		}
+		if cr.Readable {
+			codec("serialize_read", cr.SerializeRead, true, false)
+			codec("deserialize_read", cr.DeserializeRead, true, true)
+		}
+		if cr.Writable {
+			codec("serialize_write", cr.SerializeWrite, false, false)
+			codec("deserialize_write", cr.DeserializeWrite, false, true)
+		}
+		rep.AvrFlash += rr.TableFlash
+		rep.Registers = append(rep.Registers, rr)
+	}
+	return rep, nil
+}
+
+// cppNotCounted lists the generated code of the device, which the estimated AVR flash leaves out
+func cppNotCounted(out *CppDevice) []string {
+	var res []string
+	add := func(used bool, what string) {
+		if used {
+			res = append(res, what)
+		}
+	}
+	add(out.BitPacking, "bit codecs")
+	add(out.Varints, "varint codecs")
+	add(out.ArrayKernels, "array kernels")
+	add(out.Tables, "table interpreter")
+	for _, cr := range out.Registers {
+		add(cr.Delta != nil, cr.Name+" _delta codecs")
+		add(cr.Stream != nil, cr.Name+" _chunk codecs")
+	}
+	add(out.Crc != nil, "_crc codecs")
+	add(out.Stats, "PARGUS_STATS counters")
+	add(out.Dispatch, "dispatch")
+	add(out.Batch, "batch frames")
+	add(out.Capture, "capture reader")
+	res = append(res, "handshake")
+	return res
+}
+
+// WriteText writes the report as the table of the codecs
+func (r *CppReport) WriteText(w io.Writer) error {
+	fmt.Fprintf(w, "%s (%s): estimated AVR flash of the register codecs %d bytes\n", r.Device, r.Namespace, r.AvrFlash)
+	if len(r.NotCounted) > 0 {
+		fmt.Fprintf(w, "not counted: %s\n", strings.Join(r.NotCounted, ", "))
+	}
+	tw := tabwriter.NewWriter(w, 0, 0, 2, ' ', 0)
+	fmt.Fprintln(tw, "register\tcodec\twire\twire max\tsizeof\tchecks\tcalls\tAVR cycles\tAVR flash")
+	for _, rr := range r.Registers {
+		for _, c := range rr.Codecs {
+			wire := "-"
+			if c.WireSize >= 0 {
+				wire = fmt.Sprint(c.WireSize)
+			}
+			cycles := fmt.Sprint(c.AvrCycles)
+			if c.AvrCyclesMax != c.AvrCycles {
+				cycles += ".." + fmt.Sprint(c.AvrCyclesMax)
+			}
+			fmt.Fprintf(tw, "%s\t%s\t%s\t%d\t%d\t%d\t%d\t%s\t%d\n", rr.Register, c.Codec, wire, c.WireSizeMax, rr.Sizeof, c.BoundsChecks, c.Calls, cycles, c.AvrFlash)
+		}
+		if rr.TableFlash > 0 {
+			fmt.Fprintf(tw, "%s\tfields tables\t\t\t\t\t\t\t%d\n", rr.Register, rr.TableFlash)
+		}
+	}
+	return tw.Flush()
+}
+
+// avrCost is the estimated AVR flash bytes and cycles of the code, from the empty
+// variable-length arrays and the shortest varints (cycles) to the biggest wire size (cyclesMax)
+type avrCost struct {
+	flash             int
+	cycles, cyclesMax uint64
+}
+
+// add adds the code executed once, cyclesMax 0 is the same as cycles
+func (c *avrCost) add(flash int, cycles, cyclesMax uint64) {
+	if cyclesMax == 0 {
+		cyclesMax = cycles
+	}
+	c.flash += flash
+	c.cycles = satAdd(c.cycles, cycles)
+	c.cyclesMax = satAdd(c.cyclesMax, cyclesMax)
+}
+
+// addCycles adds the cycles of the other code, and its flash unless it is shared
+func (c *avrCost) addCycles(o avrCost, shared bool) {
+	if shared {
+		o.flash = 0
+	}
+	c.add(o.flash, o.cycles, o.cyclesMax)
+}
+
+// avrFieldsCost returns the cost of coding the register fields of the direction (read == true
+// for the read fields), the deserialization checks the constrained values
+func avrFieldsCost(dev *parser.Device, reg *parser.Register, read, deser bool) avrCost {
+	var cost avrCost
+	if reg.IsPacked() && !deser {
+		// the buffer is cleared before the bits are put
+		cost.add(avrCallFlash, avrCallCycles, 0)
+	}
+	for i, f := range reg.Body.Fields() {
+		if !fieldInDirection(f, read) {
+			continue
+		}
+		switch {
+		case reg.IsTable():
+			size := fieldMaxWireSize(dev, reg, i, f, read)
+			fixed := uint64(max(fieldWireSize(dev, f, read), 0))
+			cost.add(0, avrTableCycles+avrCopyCycles*fixed, satAdd(avrTableCycles, satMul(avrCopyCycles, size)))
+		case reg.IsPacked():
+			cost.add(avrCallFlash, avrCallCycles+avrBitCycles*uint64(f.Bits()), 0)
+		case f.IsVarint():
+			n := uint64(varintMaxSize(f.Type.Simple.Name))
+			cost.add(avrCallFlash, avrCallCycles+avrVarintCycles, avrCallCycles+avrVarintCycles*n)
+		case f.Type.Bitfield != nil:
+			n := uint64(typeSize(f.Type.Bitfield.Base))
+			cost.add(avrByteFlash*int(n), avrByteCycles*n, 0)
+		case f.Type.Array != nil:
+			fixed := uint64(max(fieldWireSize(dev, f, read), 0))
+			size := fieldMaxWireSize(dev, reg, i, f, read)
+			cost.add(avrCallFlash, avrCallCycles+avrCopyCycles*fixed, satAdd(avrCallCycles, satMul(avrCopyCycles, size)))
+		case f.Type.Simple.IsRegisterRef():
+			cost.add(avrCallFlash, avrCallCycles+avrCodecCycles, 0)
+			cost.addCycles(avrFieldsCost(dev, dev.FindRegisterByName(f.Type.Simple.Name), read, deser), true)
+		default:
+			n := uint64(typeSize(f.Type.Simple.Name))
+			cost.add(avrByteFlash*int(n), avrByteCycles*n, 0)
+		}
+		if deser && f.Constraint() != nil {
+			cost.add(avrValueFlash, avrValueCycles, 0)
+		}
+	}
+	return cost
+}
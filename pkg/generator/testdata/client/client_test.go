@@ -0,0 +1,298 @@
+package client
+
+import (
+	"context"
+	"errors"
+	"strings"
+	"testing"
+	"time"
+)
+
+// The tests run the Client generated from client.pa by TestGoClientRun against the in-memory
+// transport, which hands the requests to the test and the test answers them in any order.
+
+type memTransport struct {
+	reqs  chan Request
+	resps chan Response
+	errs  chan error
+}
+
+func newMemTransport() *memTransport {
+	return &memTransport{reqs: make(chan Request, 16), resps: make(chan Response, 16), errs: make(chan error, 1)}
+}
+
+func (m *memTransport) Send(req Request) error {
+	m.reqs <- req
+	return nil
+}
+
+func (m *memTransport) Recv() (Response, error) {
+	select {
+	case resp := <-m.resps:
+		return resp, nil
+	case err := <-m.errs:
+		return Response{}, err
+	}
+}
+
+// request returns the next request sent by the client
+func (m *memTransport) request(t *testing.T) Request {
+	t.Helper()
+	select {
+	case req := <-m.reqs:
+		return req
+	case <-time.After(time.Second):
+		t.Fatal("no request")
+		return Request{}
+	}
+}
+
+// noRequest checks the client doesn't send a request for a while
+func (m *memTransport) noRequest(t *testing.T) {
+	t.Helper()
+	select {
+	case req := <-m.reqs:
+		t.Fatalf("unexpected request %+v", req)
+	case <-time.After(50 * time.Millisecond):
+	}
+}
+
+func (m *memTransport) respond(req Request, payload ...byte) {
+	m.resps <- Response{Seq: req.Seq, Payload: payload}
+}
+
+type result struct {
+	value uint8
+	err   error
+}
+
+func readStatus(ctx context.Context, c *Client) chan result {
+	res := make(chan result, 1)
+	go func() {
+		r, err := c.ReadStatus(ctx)
+		if err != nil {
+			res <- result{err: err}
+			return
+		}
+		res <- result{value: r.value}
+	}()
+	return res
+}
+
+func get[T any](t *testing.T, ch chan T) T {
+	t.Helper()
+	select {
+	case v := <-ch:
+		return v
+	case <-time.After(time.Second):
+		t.Fatal("no result")
+		var v T
+		return v
+	}
+}
+
+func call(f func() error) chan error {
+	res := make(chan error, 1)
+	go func() { res <- f() }()
+	return res
+}
+
+func TestOutOfOrderResponses(t *testing.T) {
+	m := newMemTransport()
+	c := NewClient(m, 4, 0)
+	ctx := context.Background()
+
+	status := readStatus(ctx, c)
+	req1 := m.request(t)
+	logs := make(chan *Log, 1)
+	go func() {
+		r, _ := c.ReadLog(ctx)
+		logs <- r
+	}()
+	req2 := m.request(t)
+	if req1.ID != 1 || req2.ID != 3 || req1.Seq == req2.Seq {
+		t.Fatalf("requests %+v %+v", req1, req2)
+	}
+
+	m.respond(req2, 0, 2, 7, 8)
+	if r := get(t, logs); r == nil || r.size != 2 || len(r.data) != 2 || r.data[1] != 8 {
+		t.Fatalf("log %+v", r)
+	}
+	m.respond(req1, 5)
+	if r := get(t, status); r.err != nil || r.value != 5 {
+		t.Fatalf("status %+v", r)
+	}
+}
+
+func TestWindow(t *testing.T) {
+	m := newMemTransport()
+	c := NewClient(m, 1, 0)
+	ctx := context.Background()
+
+	write := call(func() error { return c.WriteCmd(ctx, &Cmd{op: 3}) })
+	req1 := m.request(t)
+	if !req1.Write || req1.ID != 2 || string(req1.Payload) != "\x03" {
+		t.Fatalf("request %+v", req1)
+	}
+	status := readStatus(ctx, c)
+	m.noRequest(t)
+
+	m.respond(req1)
+	if err := get(t, write); err != nil {
+		t.Fatal(err)
+	}
+	req2 := m.request(t)
+	m.respond(req2, 1)
+	if r := get(t, status); r.err != nil || r.value != 1 {
+		t.Fatalf("status %+v", r)
+	}
+}
+
+func TestReadCoalescing(t *testing.T) {
+	m := newMemTransport()
+	c := NewClient(m, 4, 0)
+	ctx := context.Background()
+
+	first := readStatus(ctx, c)
+	req := m.request(t)
+	joined := []chan result{readStatus(ctx, c), readStatus(ctx, c)}
+	m.noRequest(t)
+
+	m.respond(req, 9)
+	for _, ch := range append(joined, first) {
+		if r := get(t, ch); r.err != nil || r.value != 9 {
+			t.Fatalf("status %+v", r)
+		}
+	}
+
+	// the completed read is not reused
+	next := readStatus(ctx, c)
+	m.respond(m.request(t), 10)
+	if r := get(t, next); r.err != nil || r.value != 10 {
+		t.Fatalf("status %+v", r)
+	}
+}
+
+func TestWriteDetachesRead(t *testing.T) {
+	m := newMemTransport()
+	c := NewClient(m, 4, 0)
+	ctx := context.Background()
+
+	read := call(func() error { _, err := c.ReadLog(ctx); return err })
+	readReq := m.request(t)
+	write := call(func() error { return c.WriteLog(ctx, &Log{size: 1, data: []uint8{4}}) })
+	writeReq := m.request(t)
+	if !writeReq.Write || writeReq.ID != 3 {
+		t.Fatalf("request %+v", writeReq)
+	}
+
+	// the read issued after the write doesn't join the earlier read
+	logs := make(chan *Log, 1)
+	go func() {
+		r, _ := c.ReadLog(ctx)
+		logs <- r
+	}()
+	nextReq := m.request(t)
+	if nextReq.Write || nextReq.ID != 3 {
+		t.Fatalf("request %+v", nextReq)
+	}
+
+	m.respond(readReq, 0, 0)
+	m.respond(writeReq)
+	m.respond(nextReq, 0, 1, 4)
+	if err := get(t, read); err != nil {
+		t.Fatal(err)
+	}
+	if err := get(t, write); err != nil {
+		t.Fatal(err)
+	}
+	if r := get(t, logs); r == nil || len(r.data) != 1 || r.data[0] != 4 {
+		t.Fatalf("log %+v", r)
+	}
+}
+
+func TestRecvError(t *testing.T) {
+	m := newMemTransport()
+	c := NewClient(m, 4, 0)
+	ctx := context.Background()
+	closed := errors.New("closed")
+
+	status := readStatus(ctx, c)
+	m.request(t)
+	write := call(func() error { return c.WriteCmd(ctx, &Cmd{}) })
+	m.request(t)
+
+	m.errs <- closed
+	if r := get(t, status); !errors.Is(r.err, closed) {
+		t.Fatalf("status %+v", r)
+	}
+	if err := get(t, write); !errors.Is(err, closed) {
+		t.Fatal(err)
+	}
+
+	// the stopped client fails the following requests without sending them
+	if r := get(t, readStatus(ctx, c)); !errors.Is(r.err, closed) {
+		t.Fatalf("status %+v", r)
+	}
+	m.noRequest(t)
+}
+
+func TestTimeout(t *testing.T) {
+	m := newMemTransport()
+	c := NewClient(m, 1, 200*time.Millisecond)
+	ctx := context.Background()
+
+	status := readStatus(ctx, c)
+	lost := m.request(t)
+	if r := get(t, status); r.err == nil || !strings.Contains(r.err.Error(), "no response of register 1") {
+		t.Fatalf("status %+v", r)
+	}
+
+	// the lost request released its window slot, its late response is ignored
+	write := call(func() error { return c.WriteCmd(ctx, &Cmd{}) })
+	req := m.request(t)
+	m.respond(lost, 1)
+	time.Sleep(20 * time.Millisecond)
+	select {
+	case err := <-write:
+		t.Fatalf("the write completed by the late response: %v", err)
+	default:
+	}
+	m.respond(req)
+	if err := get(t, write); err != nil {
+		t.Fatal(err)
+	}
+}
+
+func TestCancelledReadRetried(t *testing.T) {
+	m := newMemTransport()
+	c := NewClient(m, 1, 0)
+	ctx := context.Background()
+
+	// the write holds the window, the reads wait for it
+	write := call(func() error { return c.WriteCmd(ctx, &Cmd{}) })
+	writeReq := m.request(t)
+	cancelCtx, cancel := context.WithCancel(ctx)
+	first := readStatus(cancelCtx, c)
+	time.Sleep(20 * time.Millisecond)
+	joined := readStatus(ctx, c)
+	time.Sleep(20 * time.Millisecond)
+
+	// the read whose sender gave up is sent by the live reader
+	cancel()
+	if r := get(t, first); !errors.Is(r.err, context.Canceled) {
+		t.Fatalf("status %+v", r)
+	}
+	m.respond(writeReq)
+	if err := get(t, write); err != nil {
+		t.Fatal(err)
+	}
+	req := m.request(t)
+	if req.ID != 1 {
+		t.Fatalf("request %+v", req)
+	}
+	m.respond(req, 6)
+	if r := get(t, joined); r.err != nil || r.value != 6 {
+		t.Fatalf("status %+v", r)
+	}
+}
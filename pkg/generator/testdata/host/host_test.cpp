@@ -0,0 +1,38 @@
+// The checks of the host registers generated from host.pa by TestCppHostRun, built with
+// -fsanitize=undefined where the compiler supports it
+#include <new>
+#include <stdio.h>
+#include <string.h>
+
+#include "host.h"
+
+using namespace host;
+
+#define CHECK(c) do { if (!(c)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #c); return 1; } } while (0)
+
+int main() {
+	// the default-constructed register has no dirty fields, even on the reused memory
+	alignas(Del) unsigned char mem[sizeof(Del)];
+	memset(mem, 0xFF, sizeof(mem));
+	Del* d = new (mem) Del;
+	d->mark_dirty(Del::mode_dirty);
+	uint8_t buf[Del::kWriteDeltaWireSizeMax];
+	int n = d->serialize_write_delta(buf, sizeof(buf));
+	CHECK(n == 2);
+	CHECK(buf[0] == 0x01);
+	d->~Del();
+
+	// the empty vectors round trip
+	Bytes b;
+	uint8_t wire[Bytes::kWriteWireSizeMax];
+	n = b.serialize_write(wire, sizeof(wire));
+	CHECK(n == 1);
+	Bytes c;
+	c.data.assign(3, 1);
+	CHECK(c.deserialize_write(wire, n) == 1);
+	CHECK(c.n == 0 && c.data.empty() && c.words.empty());
+	n = b.serialize_read(wire, sizeof(wire));
+	CHECK(n == 1);
+	CHECK(c.deserialize_read(wire, n) == 1);
+	return 0;
+}
@@ -1,6 +1,18 @@
 package generator
 
-import "github.com/dspasibenko/pargus/pkg/parser"
+import (
+	"encoding/binary"
+	"fmt"
+	"hash/fnv"
+	"io"
+	"math"
+	"math/bits"
+	"sort"
+	"strconv"
+	"strings"
+
+	"github.com/dspasibenko/pargus/pkg/parser"
+)
 
 func bitMask(start, end int) uint64 {
 	width := end - start + 1
@@ -29,3 +41,484 @@ func safeString(s *string) string {
 	}
 	return *s
 }
+
+// typeSize returns the wire size of the simple type. The Pargus simple type names match the
+// Go type names, so it accepts both
+func typeSize(goType string) int {
+	switch goType {
+	case "int8", "uint8":
+		return 1
+	case "int16", "uint16":
+		return 2
+	case "int32", "uint32", "float32":
+		return 4
+	case "int64", "uint64", "float64":
+		return 8
+	default:
+		return 0
+	}
+}
+
+// fieldWireSize returns the number of bytes the field takes on the wire, or -1 if it is known
+// at run-time only (variable-length arrays, or registers which contain them). The read flag
+// selects which fields of the referenced registers are serialized.
+func fieldWireSize(dev *parser.Device, f *parser.Field, read bool) int {
+	switch {
+	case f.Type.Bitfield != nil:
+		return typeSize(f.Type.Bitfield.Base)
+	case f.Type.Array != nil:
+		if f.Type.Array.Size.Constant == nil {
+			return -1
+		}
+		n, _ := strconv.ParseInt(*f.Type.Array.Size.Constant, 0, 64)
+		return int(n) * typeSize(f.Type.Array.Type.Name)
+	case f.Type.Simple != nil && f.Type.Simple.IsRegisterRef():
+		return registerWireSize(dev, dev.FindRegisterByName(f.Type.Simple.Name), read)
+	case f.Type.Simple != nil && f.IsVarint():
+		return -1
+	case f.Type.Simple != nil:
+		return typeSize(f.Type.Simple.Name)
+	}
+	return -1
+}
+
+// registerWireSize returns the wire size of the register read (read == true) or write fields,
+// or -1 if the size is known at run-time only
+func registerWireSize(dev *parser.Device, reg *parser.Register, read bool) int {
+	if reg == nil {
+		return -1
+	}
+	if reg.IsPacked() {
+		_, size := packedLayout(reg, read)
+		return size
+	}
+	size := 0
+	for _, f := range reg.Body.Fields() {
+		if !fieldInDirection(f, read) {
+			continue
+		}
+		fs := fieldWireSize(dev, f, read)
+		if fs < 0 {
+			return -1
+		}
+		size += fs
+	}
+	return size
+}
+
+// fieldMaxWireSize returns the maximal number of bytes the field may take on the wire. The
+// variable-length arrays are limited by their capacity or by the biggest value their size
+// field may hold. The field index is needed to resolve the array size field. The result
+// saturates at MaxUint64.
+func fieldMaxWireSize(dev *parser.Device, reg *parser.Register, index int, f *parser.Field, read bool) uint64 {
+	if f.Type.Array != nil && f.Type.Array.Size.Variable != nil {
+		var elems uint64 = math.MaxUint64
+		field, bm := reg.FindFieldByName(*f.Type.Array.Size.Variable, index)
+		switch {
+		case bm != nil:
+			elems = bitMask(0, bm.EndBit()-bm.StartBit())
+		case field != nil && field.Type.Simple != nil:
+			elems = maxTypeValue(field.Type.Simple.Name)
+		}
+		if c := f.Type.Array.Capacity(); c > 0 {
+			elems = min(elems, uint64(c))
+		}
+		return satMul(elems, uint64(typeSize(f.Type.Array.Type.Name)))
+	}
+	if f.Type.Simple != nil && f.Type.Simple.IsRegisterRef() {
+		return registerMaxWireSize(dev, dev.FindRegisterByName(f.Type.Simple.Name), read)
+	}
+	if f.Type.Simple != nil && f.IsVarint() {
+		return uint64(varintMaxSize(f.Type.Simple.Name))
+	}
+	return uint64(fieldWireSize(dev, f, read))
+}
+
+// registerMaxWireSize returns the maximal wire size of the register read (read == true)
+// or write fields
+func registerMaxWireSize(dev *parser.Device, reg *parser.Register, read bool) uint64 {
+	if reg == nil {
+		return 0
+	}
+	if reg.IsPacked() {
+		return uint64(registerWireSize(dev, reg, read))
+	}
+	var size uint64
+	for i, f := range reg.Body.Fields() {
+		if fieldInDirection(f, read) {
+			size = satAdd(size, fieldMaxWireSize(dev, reg, i, f, read))
+		}
+	}
+	return size
+}
+
+// packedLayout returns the first bit of every field of the packed register in the read
+// (read == true) or write direction, and the wire size in bytes. The fields are packed
+// contiguously, the bits are counted from the most significant bit of the first byte. The
+// fields of the other direction get -1.
+func packedLayout(reg *parser.Register, read bool) ([]int, int) {
+	var pos []int
+	bits := 0
+	for _, f := range reg.Body.Fields() {
+		if !fieldInDirection(f, read) {
+			pos = append(pos, -1)
+			continue
+		}
+		pos = append(pos, bits)
+		bits += f.Bits()
+	}
+	return pos, (bits + 7) / 8
+}
+
+// packedType returns the integer type of the packed register field
+func packedType(f *parser.Field) string {
+	if f.Type.Bitfield != nil {
+		return f.Type.Bitfield.Base
+	}
+	return f.Type.Simple.Name
+}
+
+// deltaLayout returns the index of every write field of the delta register in the dirty mask,
+// -1 for the read-only fields, and the pairs of the variable-length arrays and their size
+// fields indexes, which must be sent together
+func deltaLayout(reg *parser.Register) ([]int, [][2]int) {
+	var dirty []int
+	var pairs [][2]int
+	fields := reg.Body.Fields()
+	next := 0
+	for i, f := range fields {
+		if !fieldInDirection(f, false) {
+			dirty = append(dirty, -1)
+			continue
+		}
+		dirty = append(dirty, next)
+		next++
+		if f.Type.Array == nil || f.Type.Array.Size.Variable == nil {
+			continue
+		}
+		sizeField, _ := reg.FindFieldByName(*f.Type.Array.Size.Variable, i)
+		for j := 0; j < i; j++ {
+			if fields[j] == sizeField && dirty[j] >= 0 {
+				pairs = append(pairs, [2]int{dirty[i], dirty[j]})
+			}
+		}
+	}
+	return dirty, pairs
+}
+
+// indexOf returns the index of the value in the slice, or -1 if it is not there
+func indexOf(values []int, v int) int {
+	for i, x := range values {
+		if x == v {
+			return i
+		}
+	}
+	return -1
+}
+
+// varintMaxSize returns the biggest number of bytes the varint of the integer type takes:
+// every byte carries 7 bits of the value
+func varintMaxSize(typ string) int {
+	return (typeSize(typ)*8 + 6) / 7
+}
+
+// maxTypeValue returns the biggest value of the simple type, the integer types only
+func maxTypeValue(typ string) uint64 {
+	switch typ {
+	case "int8", "int16", "int32", "int64":
+		return 1<<(typeSize(typ)*8-1) - 1
+	case "uint8", "uint16", "uint32":
+		return 1<<(typeSize(typ)*8) - 1
+	default:
+		return math.MaxUint64
+	}
+}
+
+func satAdd(a, b uint64) uint64 {
+	sum, carry := bits.Add64(a, b, 0)
+	if carry != 0 {
+		return math.MaxUint64
+	}
+	return sum
+}
+
+func satMul(a, b uint64) uint64 {
+	hi, lo := bits.Mul64(a, b)
+	if hi != 0 {
+		return math.MaxUint64
+	}
+	return lo
+}
+
+// fieldInDirection returns whether the field is serialized for read (read == true) or write
+func fieldInDirection(f *parser.Field, read bool) bool {
+	if read {
+		return f.Specifier == "r" || f.Specifier == ""
+	}
+	return f.Specifier == "w" || f.Specifier == ""
+}
+
+// cppLayout is the size and the alignment of a C++ struct member on the 32-bit targets (ESP32,
+// SAMD and the other ARM ones): 4 bytes pointers, the 64-bit values are aligned to 8 bytes
+type cppLayout struct {
+	size  int
+	align int
+}
+
+// cppFieldLayout returns the layout of the field member, sorted tells whether the referenced
+// registers have the sorted members
+func cppFieldLayout(dev *parser.Device, f *parser.Field, sorted bool) cppLayout {
+	switch {
+	case f.Type.Simple != nil && f.Type.Simple.IsRegisterRef():
+		return cppRegisterLayout(dev, dev.FindRegisterByName(f.Type.Simple.Name), sorted)
+	case f.Type.Bitfield != nil:
+		n := typeSize(f.Type.Bitfield.Base)
+		return cppLayout{n, n}
+	case f.Type.Array != nil && f.Type.Array.Capacity() > 0:
+		n := typeSize(f.Type.Array.Type.Name)
+		return cppLayout{n * f.Type.Array.Capacity(), n}
+	case f.Type.Array != nil && f.Type.Array.Size.Constant == nil:
+		return cppLayout{4, 4}
+	case f.Type.Array != nil:
+		n := typeSize(f.Type.Array.Type.Name)
+		count, _ := strconv.ParseInt(*f.Type.Array.Size.Constant, 0, 64)
+		return cppLayout{n * int(count), n}
+	default:
+		n := typeSize(f.Type.Simple.Name)
+		return cppLayout{n, n}
+	}
+}
+
+// cppRegisterLayout returns the layout of the register struct with the members in the
+// declaration order, or sorted by the alignment if sorted is true
+func cppRegisterLayout(dev *parser.Device, reg *parser.Register, sorted bool) cppLayout {
+	var members []cppLayout
+	for _, f := range reg.Body.Fields() {
+		members = append(members, cppFieldLayout(dev, f, sorted))
+	}
+	if sorted {
+		sort.SliceStable(members, func(i, j int) bool { return members[i].align > members[j].align })
+	}
+	if reg.FindOption("delta") != nil {
+		dirty, _ := deltaLayout(reg)
+		n := 0
+		for _, d := range dirty {
+			if d >= 0 {
+				n++
+			}
+		}
+		members = append(members, cppLayout{max((n+7)/8, 1), 1})
+	}
+	l := cppLayout{0, 1}
+	for _, m := range members {
+		l.size = (l.size+m.align-1)/m.align*m.align + m.size
+		l.align = max(l.align, m.align)
+	}
+	l.size = max((l.size+l.align-1)/l.align*l.align, 1)
+	return l
+}
+
+// crcAlgo is the checksum of the wire data selected by the crc generator option
+type crcAlgo struct {
+	Title     string
+	Width     int // the CRC width in bits: 8, 16 or 32
+	Poly      uint32
+	Init      uint32
+	XorOut    uint32
+	Reflected bool // the bits are processed least significant first
+}
+
+var crcAlgos = map[string]crcAlgo{
+	"crc8":  {Title: "CRC-8/SMBUS", Width: 8, Poly: 0x07},
+	"crc16": {Title: "CRC-16/CCITT-FALSE", Width: 16, Poly: 0x1021, Init: 0xFFFF},
+	"crc32": {Title: "CRC-32", Width: 32, Poly: 0xEDB88320, Init: 0xFFFFFFFF, XorOut: 0xFFFFFFFF, Reflected: true},
+}
+
+// findCrcAlgo returns the checksum of the crc option value, nil for the empty value
+func findCrcAlgo(name string) (*crcAlgo, error) {
+	if name == "" {
+		return nil, nil
+	}
+	a, ok := crcAlgos[name]
+	if !ok {
+		return nil, fmt.Errorf("unknown checksum '%s', expected crc8, crc16 or crc32", name)
+	}
+	return &a, nil
+}
+
+// slicingTables returns the slicing-by-4 tables of the CRC: table k is the CRC of the byte
+// followed by k zero bytes
+func (a *crcAlgo) slicingTables() [4][256]uint32 {
+	var t [4][256]uint32
+	mask := uint32(1)<<a.Width - 1
+	if a.Width == 32 {
+		mask = 0xFFFFFFFF
+	}
+	top := uint32(1) << (a.Width - 1)
+	for i := range t[0] {
+		c := uint32(i)
+		if !a.Reflected {
+			c <<= a.Width - 8
+		}
+		for k := 0; k < 8; k++ {
+			switch {
+			case a.Reflected && c&1 != 0:
+				c = c>>1 ^ a.Poly
+			case a.Reflected:
+				c >>= 1
+			case c&top != 0:
+				c = (c<<1 ^ a.Poly) & mask
+			default:
+				c = c << 1 & mask
+			}
+		}
+		t[0][i] = c
+	}
+	for k := 1; k < 4; k++ {
+		for i := range t[k] {
+			c := t[k-1][i]
+			if a.Reflected {
+				t[k][i] = c>>8 ^ t[0][c&0xFF]
+			} else {
+				t[k][i] = (c<<8 ^ t[0][c>>(a.Width-8)&0xFF]) & mask
+			}
+		}
+	}
+	return t
+}
+
+// layoutHash returns the 64-bit FNV-1a hash of the register wire layout: the register ID, the
+// specifiers, the packed and delta options and the fields in the wire order with their types,
+// sizes, bits and accepted values. The names, the comments and the constants are not hashed,
+// so renaming a field keeps the hash. The referenced registers are hashed in place.
+func layoutHash(dev *parser.Device, reg *parser.Register) uint64 {
+	h := fnv.New64a()
+	fmt.Fprintf(h, "%d:", reg.Number())
+	writeLayout(h, dev, reg)
+	return h.Sum64()
+}
+
+// deviceLayoutHash returns the hash of the register IDs and their layout hashes in the ID
+// order, so it doesn't depend on the order of the declarations
+func deviceLayoutHash(dev *parser.Device) uint64 {
+	regs := append([]*parser.Register(nil), dev.Registers...)
+	sort.Slice(regs, func(i, j int) bool { return regs[i].Number() < regs[j].Number() })
+	h := fnv.New64a()
+	for _, reg := range regs {
+		fmt.Fprintf(h, "%d=%016x;", reg.Number(), layoutHash(dev, reg))
+	}
+	return h.Sum64()
+}
+
+// handshakeSize returns the size of the device handshake: the device layout hash and the
+// [register ID][register layout hash] entries
+func handshakeSize(dev *parser.Device) int {
+	return 8 + 9*len(dev.Registers)
+}
+
+// handshakeRows returns the rows of the handshake bytes literal, the same in C++ and Go: the
+// device layout hash and the entries of the registers in the ID order, commented with the
+// names of the hashes
+func handshakeRows(dev *parser.Device, devHash string, regHash func(reg string) string) []string {
+	row := func(v uint64, comment string) string {
+		var b [8]byte
+		binary.BigEndian.PutUint64(b[:], v)
+		var hex []string
+		for _, x := range b {
+			hex = append(hex, fmt.Sprintf("0x%02X,", x))
+		}
+		return strings.Join(hex, " ") + " // " + comment
+	}
+	regs := append([]*parser.Register(nil), dev.Registers...)
+	sort.Slice(regs, func(i, j int) bool { return regs[i].Number() < regs[j].Number() })
+	rows := []string{row(deviceLayoutHash(dev), devHash)}
+	for _, reg := range regs {
+		rows = append(rows, fmt.Sprintf("0x%02X, %s", reg.Number(), row(layoutHash(dev, reg), regHash(reg.Name))))
+	}
+	return rows
+}
+
+// writeLayout writes the canonical description of the register fields to w, e.g.
+// "r{:uint8;r:[@0]uint16;}" for the read-only register of the count and the array
+func writeLayout(w io.Writer, dev *parser.Device, reg *parser.Register) {
+	fmt.Fprint(w, reg.Specifier)
+	for _, o := range []string{"packed", "delta"} {
+		if reg.FindOption(o) != nil {
+			fmt.Fprint(w, " ", o)
+		}
+	}
+	fmt.Fprint(w, "{")
+	fields := reg.Body.Fields()
+	for i, f := range fields {
+		fmt.Fprint(w, f.Specifier, ":")
+		switch {
+		case f.Type.Bitfield != nil:
+			fmt.Fprint(w, f.Type.Bitfield.Base, "{")
+			for k := range f.Type.Bitfield.Bits {
+				fmt.Fprint(w, bitsLayout(&f.Type.Bitfield.Bits[k]), ",")
+			}
+			fmt.Fprint(w, "}")
+		case f.Type.Array != nil:
+			at := f.Type.Array
+			if at.Size.Constant != nil {
+				fmt.Fprintf(w, "[%s]", canonicalInt(*at.Size.Constant))
+			} else {
+				// the size field by its index, and the bits of the bit field member
+				sizeField, bm := reg.FindFieldByName(*at.Size.Variable, i)
+				ref := ""
+				for j := 0; j < i; j++ {
+					if fields[j] == sizeField {
+						ref = strconv.Itoa(j)
+					}
+				}
+				if bm != nil {
+					ref += "." + bitsLayout(bm)
+				}
+				if c := at.Capacity(); c > 0 {
+					ref += "<=" + strconv.Itoa(c)
+				}
+				fmt.Fprintf(w, "[@%s]", ref)
+			}
+			writeTypeLayout(w, dev, at.Type.Name)
+		default:
+			writeTypeLayout(w, dev, f.Type.Simple.Name)
+		}
+		if f.IsVarint() {
+			fmt.Fprint(w, " varint")
+		}
+		if reg.IsPacked() {
+			fmt.Fprintf(w, " bits(%d)", f.Bits())
+		}
+		if c := f.Constraint(); c != nil {
+			fmt.Fprintf(w, " min(%s) max(%s) enum(%s)", c.Min, c.Max, strings.Join(c.Enum, ","))
+		}
+		fmt.Fprint(w, ";")
+	}
+	fmt.Fprint(w, "}")
+}
+
+// writeTypeLayout writes the simple type name, or the layout of the referenced register
+func writeTypeLayout(w io.Writer, dev *parser.Device, name string) {
+	if ref := dev.FindRegisterByName(name); !parser.IsBuiltinType(name) && ref != nil {
+		writeLayout(w, dev, ref)
+		return
+	}
+	fmt.Fprint(w, name)
+}
+
+// bitsLayout returns the bits of the bit field member, e.g. "1-3"
+func bitsLayout(bm *parser.BitMember) string {
+	end := bm.Start
+	if bm.End != nil {
+		end = *bm.End
+	}
+	return canonicalInt(bm.Start) + "-" + canonicalInt(end)
+}
+
+// canonicalInt returns the decimal form of the integer literal, e.g. "16" for "0x10"
+func canonicalInt(s string) string {
+	if v, err := strconv.ParseInt(s, 0, 64); err == nil {
+		return strconv.FormatInt(v, 10)
+	}
+	return s
+}
@@ -0,0 +1,211 @@
+package parser
+
+import (
+	"fmt"
+	"io"
+	"strings"
+	"unicode/utf8"
+
+	"github.com/alecthomas/participle/v2/lexer"
+)
+
+// paLexer is the hand-written lexer of the .pa files. It produces the same tokens as
+// lexer.MustSimple with the rules below, which are tried in this order at every position, but
+// without matching the regular expressions:
+//
+//	End         ;([ \t]+//[^\r\n]*)?
+//	Comment     //[^\r\n]*
+//	EmptyLine   \n\s*\n
+//	Keyword     \b(const|device|register)\b
+//	Ident       [a-zA-Z_][a-zA-Z0-9_-]*
+//	Duration    \d+(ms|s|m|h)\b
+//	Int         0[xX][0-9a-fA-F]+|0[bB][01]+|\d+
+//	Punct       <=|[{}();:,\[\]=\-]
+//	Whitespace  \s+
+var paLexer lexer.Definition = paDefinition{}
+
+const (
+	tokEnd lexer.TokenType = lexer.EOF - 1 - iota
+	tokComment
+	tokEmptyLine
+	tokKeyword
+	tokIdent
+	tokDuration
+	tokInt
+	tokPunct
+	tokWhitespace
+)
+
+var paSymbols = map[string]lexer.TokenType{
+	"EOF":        lexer.EOF,
+	"End":        tokEnd,
+	"Comment":    tokComment,
+	"EmptyLine":  tokEmptyLine,
+	"Keyword":    tokKeyword,
+	"Ident":      tokIdent,
+	"Duration":   tokDuration,
+	"Int":        tokInt,
+	"Punct":      tokPunct,
+	"Whitespace": tokWhitespace,
+}
+
+type paDefinition struct{}
+
+func (paDefinition) Symbols() map[string]lexer.TokenType {
+	return paSymbols
+}
+
+func (d paDefinition) Lex(filename string, r io.Reader) (lexer.Lexer, error) {
+	b, err := io.ReadAll(r)
+	if err != nil {
+		return nil, err
+	}
+	return d.LexString(filename, string(b))
+}
+
+func (paDefinition) LexString(filename string, input string) (lexer.Lexer, error) {
+	return &paTokens{input: input, pos: lexer.Position{Filename: filename, Line: 1, Column: 1}}, nil
+}
+
+// paTokens is the lexer state: the input and the position of the next token
+type paTokens struct {
+	input string
+	pos   lexer.Position
+}
+
+func (l *paTokens) Next() (lexer.Token, error) {
+	rest := l.input[l.pos.Offset:]
+	if rest == "" {
+		return lexer.Token{Type: lexer.EOF, Pos: l.pos}, nil
+	}
+	typ, n := matchToken(rest)
+	if n == 0 {
+		if len(rest) > 10 {
+			rest = rest[:10] + "..."
+		}
+		return lexer.Token{}, fmt.Errorf("%d:%d: invalid input text %q", l.pos.Line, l.pos.Column, rest)
+	}
+	tok := lexer.Token{Type: typ, Value: rest[:n], Pos: l.pos}
+
+	// advance the position over the token
+	span := rest[:n]
+	l.pos.Offset += n
+	if lines := strings.Count(span, "\n"); lines == 0 {
+		l.pos.Column += utf8.RuneCountInString(span)
+	} else {
+		l.pos.Line += lines
+		l.pos.Column = utf8.RuneCountInString(span[strings.LastIndexByte(span, '\n'):])
+	}
+	return tok, nil
+}
+
+// matchToken returns the type and the length of the token at the beginning of s, the length is
+// 0 if s doesn't start with a token
+func matchToken(s string) (lexer.TokenType, int) {
+	c := s[0]
+	switch {
+	case c == ';':
+		i := 1
+		for i < len(s) && (s[i] == ' ' || s[i] == '\t') {
+			i++
+		}
+		if i > 1 && strings.HasPrefix(s[i:], "//") {
+			return tokEnd, i + lineLen(s[i:])
+		}
+		return tokEnd, 1
+	case strings.HasPrefix(s, "//"):
+		return tokComment, lineLen(s)
+	case c == '\n':
+		// the whitespaces up to the last new line in them
+		last := 0
+		for i := 1; i < len(s) && isSpace(s[i]); i++ {
+			if s[i] == '\n' {
+				last = i
+			}
+		}
+		if last > 0 {
+			return tokEmptyLine, last + 1
+		}
+		return tokWhitespace, spaceLen(s)
+	case isLetter(c):
+		n := 1
+		for n < len(s) && (isLetter(s[n]) || isDigit(s[n]) || s[n] == '-') {
+			n++
+		}
+		for _, kw := range [...]string{"const", "device", "register"} {
+			if strings.HasPrefix(s, kw) && (len(s) == len(kw) || !isWord(s[len(kw)])) {
+				return tokKeyword, len(kw)
+			}
+		}
+		return tokIdent, n
+	case isDigit(c):
+		if c == '0' && len(s) > 2 {
+			switch {
+			case s[1] == 'x' || s[1] == 'X':
+				if n := prefixLen(s[2:], isHexDigit); n > 0 {
+					return tokInt, n + 2
+				}
+			case s[1] == 'b' || s[1] == 'B':
+				if n := prefixLen(s[2:], func(c byte) bool { return c == '0' || c == '1' }); n > 0 {
+					return tokInt, n + 2
+				}
+			}
+		}
+		n := prefixLen(s, isDigit)
+		for _, unit := range [...]string{"ms", "s", "m", "h"} {
+			if end := n + len(unit); strings.HasPrefix(s[n:], unit) && (len(s) == end || !isWord(s[end])) {
+				return tokDuration, end
+			}
+		}
+		return tokInt, n
+	case strings.HasPrefix(s, "<="):
+		return tokPunct, 2
+	case strings.IndexByte("{}();:,[]=-", c) >= 0:
+		return tokPunct, 1
+	case isSpace(c):
+		return tokWhitespace, spaceLen(s)
+	}
+	return 0, 0
+}
+
+// lineLen returns the length of s up to the end of the line
+func lineLen(s string) int {
+	if i := strings.IndexAny(s, "\r\n"); i >= 0 {
+		return i
+	}
+	return len(s)
+}
+
+func spaceLen(s string) int {
+	return prefixLen(s, isSpace)
+}
+
+func prefixLen(s string, f func(c byte) bool) int {
+	n := 0
+	for n < len(s) && f(s[n]) {
+		n++
+	}
+	return n
+}
+
+// isSpace matches \s of the regular expressions
+func isSpace(c byte) bool {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f'
+}
+
+func isLetter(c byte) bool {
+	return c >= 'a' && c <= 'z' || c >= 'A' && c <= 'Z' || c == '_'
+}
+
+func isDigit(c byte) bool {
+	return c >= '0' && c <= '9'
+}
+
+func isHexDigit(c byte) bool {
+	return isDigit(c) || c >= 'a' && c <= 'f' || c >= 'A' && c <= 'F'
+}
+
+// isWord matches \w, the characters of the word boundary \b
+func isWord(c byte) bool {
+	return isLetter(c) || isDigit(c)
+}
@@ -2,8 +2,10 @@ package parser
 
 import (
 	"fmt"
+	"math/big"
 	"strconv"
 	"strings"
+	"time"
 
 	"github.com/alecthomas/participle/v2"
 	"github.com/alecthomas/participle/v2/lexer"
@@ -29,6 +31,8 @@ type Device struct {
 	Doc       *CommentGroup `@@?`
 	Name      string        `"device" @Ident`
 	Registers []*Register   `@@*`
+
+	registers map[string]*Register // the registers by name, built by Parse
 }
 
 type Register struct {
@@ -37,11 +41,17 @@ type Register struct {
 	Name      string        `"register" @Ident`
 	NumberStr string        `"(" @Int ")"`
 	Specifier string        `( ":" @("r"|"w") )?`
+	Options   []*Option     `@@*`
 	Body      *RegisterBody `@@`
+
+	fieldIndex map[string]fieldRef // the fields which may be referenced by name, see FindFieldByName
 }
 
 type RegisterBody struct {
 	Items []*BodyItem `"{" ( @@ )* "}" ";"`
+
+	fields []*Field // the fields of Items, cached by Parse
+	cached bool
 }
 
 type BodyItem struct {
@@ -63,7 +73,26 @@ type Field struct {
 	Name            string        `@Ident`
 	Specifier       string        `( ":" @("r"|"w") )?`
 	Type            *TypeUnion    `@@`
+	Options         []*Option     `@@*`
 	TrailingComment *string       `@End`
+
+	constraint *Constraint // the valid values given by the min, max and enum options, built by Parse
+}
+
+// Constraint is the set of the valid values of an integer field given by the `min`, `max` and
+// `enum` field options. The values are decimal, Min and Max are empty if the field type limits
+// them, Enum is empty if any value between them is valid.
+type Constraint struct {
+	Min, Max string
+	Enum     []string
+}
+
+// Option tunes the encoding of a register or a field, for example `packed`, `bits(3)` or
+// `cache(60s)`
+type Option struct {
+	Pos  lexer.Position
+	Name string   `@Ident`
+	Args []string `( "(" @("-"? Int | Ident | Duration) ( "," @("-"? Int | Ident | Duration) )* ")" )?`
 }
 
 //
@@ -79,8 +108,9 @@ type SimpleType struct {
 }
 
 type ArrayType struct {
-	Size ArraySize  `"[" @@ "]"`
-	Type SimpleType `@@`
+	Size        ArraySize  `"[" @@`
+	CapacityStr *string    `( "<=" @Int )? "]"`
+	Type        SimpleType `@@`
 }
 
 type ArraySize struct {
@@ -88,6 +118,19 @@ type ArraySize struct {
 	Variable *string `| @Ident`
 }
 
+// Capacity returns the maximal number of elements of the bounded variable-length array, the
+// array is stored in the register then. It returns 0 for the unbounded arrays.
+func (at *ArrayType) Capacity() int {
+	if at.CapacityStr == nil {
+		return 0
+	}
+	val, err := strconv.ParseInt(*at.CapacityStr, 0, 64)
+	if err != nil {
+		panic(fmt.Sprintf("invalid array capacity %s", *at.CapacityStr))
+	}
+	return int(val)
+}
+
 type BitField struct {
 	Base string      `@("uint8"|"uint16"|"uint32"|"uint64")`
 	Bits []BitMember `"{" @@ ("," @@)* "}"`
@@ -120,16 +163,7 @@ func (*TypeUnion) isType()  {} // for compatibility
 //
 
 var parser = participle.MustBuild[Device](
-	participle.Lexer(lexer.MustSimple([]lexer.SimpleRule{
-		{"End", `;([ \t]+//[^\r\n]*)?`},
-		{"Comment", `//[^\r\n]*`},
-		{"EmptyLine", `\n\s*\n`},
-		{"Keyword", `\b(const|device|register)\b`},
-		{"Ident", `[a-zA-Z_][a-zA-Z0-9_-]*`},
-		{"Int", `0[xX][0-9a-fA-F]+|0[bB][01]+|\d+`},
-		{"Punct", `[{}();:,\[\]=\-]`},
-		{"Whitespace", `\s+`},
-	})),
+	participle.Lexer(paLexer),
 	participle.Elide("Whitespace"),
 	participle.Union[Type](&SimpleType{}, &ArrayType{}, &BitField{}),
 	participle.UseLookahead(4),
@@ -175,6 +209,25 @@ func Parse(input string) (*Device, error) {
 		}
 	}
 
+	// Join the signs of the negative option arguments with the numbers
+	for _, r := range device.Registers {
+		r.Options = joinSigns(r.Options)
+		for _, field := range r.Body.Fields() {
+			field.Options = joinSigns(field.Options)
+		}
+	}
+
+	// Build the name indexes, the validation and the generators look the registers and the fields
+	// up by name
+	device.registers = make(map[string]*Register, len(device.Registers))
+	for _, r := range device.Registers {
+		if _, ok := device.registers[r.Name]; !ok {
+			device.registers[r.Name] = r
+		}
+		r.Body.fields, r.Body.cached = r.Body.Fields(), true
+		r.indexFields()
+	}
+
 	// Validate register numbers are unique
 	registerNumbers := make(map[int64]bool)
 	for _, r := range device.Registers {
@@ -184,30 +237,37 @@ func Parse(input string) (*Device, error) {
 		}
 		registerNumbers[val] = true
 
-		// Validate field specifiers compatibility with register specifier
-		if err := r.validateAndUpdateFieldSpecifiers(); err != nil {
-			return nil, err
-		}
-
-		// Validate bit fields
-		if err := r.validateBitFields(); err != nil {
-			return nil, err
-		}
-
-		// Validate arrays
-		if err := r.validateArrays(); err != nil {
+		if err := r.validate(device); err != nil {
 			return nil, err
 		}
 	}
 
-	// Validate register references and check for circular dependencies
-	if err := device.validateRegisterReferences(); err != nil {
+	// Check for circular dependencies of the register references
+	if err := device.validateCycles(); err != nil {
 		return nil, err
 	}
 
 	return device, nil
 }
 
+// joinSigns joins the "-" option arguments with the numbers following them, the lexer returns
+// them as separate tokens
+func joinSigns(opts []*Option) []*Option {
+	for _, o := range opts {
+		args := o.Args[:0]
+		for i := 0; i < len(o.Args); i++ {
+			if o.Args[i] == "-" && i+1 < len(o.Args) {
+				i++
+				args = append(args, "-"+o.Args[i])
+				continue
+			}
+			args = append(args, o.Args[i])
+		}
+		o.Args = args
+	}
+	return opts
+}
+
 func trimString(input string) string {
 	// Split into lines
 	lines := strings.Split(input, "\n")
@@ -244,6 +304,9 @@ func (rb *RegisterBody) Constants() []*Constant {
 }
 
 func (rb *RegisterBody) Fields() []*Field {
+	if rb.cached {
+		return rb.fields
+	}
 	var fields []*Field
 	for _, item := range rb.Items {
 		if item.Field != nil {
@@ -261,77 +324,355 @@ func (r *Register) Number() int64 {
 	return val
 }
 
-// validateAndUpdateFieldSpecifiers checks if field specifiers are compatible with register specifier
-func (r *Register) validateAndUpdateFieldSpecifiers() error {
+// validate checks the register in one walk over its fields: the field specifiers compatibility
+// with the register specifier (fields without the specifier inherit it), the bit fields, the
+// arrays, the register references and the options
+func (r *Register) validate(d *Device) error {
+	for _, o := range r.Options {
+		switch o.Name {
+		case "packed", "delta", "stream", "table":
+			if len(o.Args) != 0 {
+				return fmt.Errorf("option '%s' of register '%s' takes no arguments", o.Name, r.Name)
+			}
+		case "cache":
+			if len(o.Args) != 1 {
+				return fmt.Errorf("option 'cache' of register '%s' takes one argument", r.Name)
+			}
+			if d, err := time.ParseDuration(o.Args[0]); err != nil || d <= 0 {
+				return fmt.Errorf("option 'cache' of register '%s': invalid duration '%s'", r.Name, o.Args[0])
+			}
+			if r.Specifier == "w" {
+				return fmt.Errorf("option 'cache' of register '%s' requires the read fields", r.Name)
+			}
+		default:
+			return fmt.Errorf("unknown option '%s' of register '%s'", o.Name, r.Name)
+		}
+	}
+	packed, delta, stream, table := r.IsPacked(), r.FindOption("delta") != nil, r.IsStream(), r.IsTable()
+	switch {
+	case delta && packed:
+		return fmt.Errorf("options 'delta' and 'packed' of register '%s' cannot be combined", r.Name)
+	case stream && packed:
+		return fmt.Errorf("options 'stream' and 'packed' of register '%s' cannot be combined", r.Name)
+	case table && packed:
+		return fmt.Errorf("options 'table' and 'packed' of register '%s' cannot be combined", r.Name)
+	}
+
+	writable := false
+	for i, field := range r.Body.Fields() {
+		if err := r.validateSpecifier(field); err != nil {
+			return err
+		}
+		writable = writable || field.Specifier != "r"
+
+		switch {
+		case field.Type.Bitfield != nil:
+			if err := r.validateBitField(field); err != nil {
+				return err
+			}
+		case field.Type.Array != nil:
+			if err := r.validateArray(field, i); err != nil {
+				return err
+			}
+		case field.Type.Simple.IsRegisterRef():
+			refName := field.Type.Simple.Name
+			if d.FindRegisterByName(refName) == nil {
+				return fmt.Errorf("field '%s' in register '%s' references undefined register '%s'",
+					field.Name, r.Name, refName)
+			}
+			if stream {
+				return fmt.Errorf("field '%s' of stream register '%s' cannot be a register reference", field.Name, r.Name)
+			}
+			if table {
+				return fmt.Errorf("field '%s' of table register '%s' cannot be a register reference", field.Name, r.Name)
+			}
+		}
+
+		if err := r.validateFieldOptions(field, packed); err != nil {
+			return err
+		}
+	}
+	if delta && (r.Specifier == "r" || !writable) {
+		return fmt.Errorf("option 'delta' of register '%s' requires the write fields", r.Name)
+	}
+	return nil
+}
+
+// validateSpecifier checks if the field specifier is compatible with the register specifier
+func (r *Register) validateSpecifier(field *Field) error {
 	registerSpec := r.Specifier
 	// If register has no specifier, field can have any specifier or none
 	if registerSpec == "" {
 		return nil
 	}
+	fieldSpec := field.Specifier
+
+	// If field has no specifier, it inherits register specifier (valid)
+	if fieldSpec == "" {
+		field.Specifier = registerSpec // inherit register specifier
+		return nil
+	}
+
+	// Check compatibility
+	if registerSpec == "r" && fieldSpec == "w" {
+		return fmt.Errorf("field '%s' in register '%s' cannot be write-only because register is read-only", field.Name, r.Name)
+	}
+
+	if registerSpec == "w" && fieldSpec == "r" {
+		return fmt.Errorf("field '%s' in register '%s' cannot be read-only because register is write-only", field.Name, r.Name)
+	}
+	return nil
+}
+
+// validateBitField validates that the bit field uses only unsigned integer types and that bit
+// ranges don't exceed the size of the base type
+func (r *Register) validateBitField(field *Field) error {
+	bitField := field.Type.Bitfield
+
+	// Check that base type is unsigned
+	if !isUnsignedType(bitField.Base) {
+		return fmt.Errorf("bit field '%s' in register '%s' must use unsigned integer type, got '%s'",
+			field.Name, r.Name, bitField.Base)
+	}
 
-	for _, field := range r.Body.Fields() {
-		fieldSpec := field.Specifier
+	// Get the size of the base type in bits
+	baseTypeBits := getTypeSizeInBits(bitField.Base)
 
-		// If field has no specifier, it inherits register specifier (valid)
-		if fieldSpec == "" {
-			field.Specifier = registerSpec // inherit register specifier
-			continue
+	// Validate each bit member
+	for _, bitMember := range bitField.Bits {
+		endBit := bitMember.EndBit()
+
+		// Check that bit range doesn't exceed base type size
+		if endBit >= baseTypeBits {
+			return fmt.Errorf("bit field '%s' in register '%s': bit range %s-%d exceeds size of base type '%s' (%d bits)",
+				field.Name, r.Name, bitMember.Start, endBit, bitField.Base, baseTypeBits)
+		}
+
+		// Check that start bit is not negative
+		if bitMember.StartBit() < 0 {
+			return fmt.Errorf("bit field '%s' in register '%s': bit position cannot be negative, got %s",
+				field.Name, r.Name, bitMember.Start)
 		}
 
-		// Check compatibility
-		if registerSpec == "r" && fieldSpec == "w" {
-			return fmt.Errorf("field '%s' in register '%s' cannot be write-only because register is read-only", field.Name, r.Name)
+		// Check that start <= end
+		if bitMember.StartBit() > endBit {
+			return fmt.Errorf("bit field '%s' in register '%s': start bit %s cannot be greater than end bit %d",
+				field.Name, r.Name, bitMember.Start, endBit)
 		}
+	}
+	return nil
+}
 
-		if registerSpec == "w" && fieldSpec == "r" {
-			return fmt.Errorf("field '%s' in register '%s' cannot be read-only because register is write-only", field.Name, r.Name)
+// validateArray validates that the variable-length array references the field declared before
+// it, and the capacity of the bounded array
+func (r *Register) validateArray(field *Field, index int) error {
+	arrayType := field.Type.Array
+	if arrayType.Size.Variable == nil {
+		// this is a constant-length array
+		if arrayType.CapacityStr != nil {
+			return fmt.Errorf("fixed-size array '%s' in register '%s' cannot have a capacity", field.Name, r.Name)
 		}
+		return nil
 	}
 
+	// This is a field reference - check if the referenced field exists and is declared before this array
+	fieldName := cast.String(arrayType.Size.Variable, "")
+	exists, _ := r.FindFieldByName(fieldName, index)
+	if exists == nil {
+		return fmt.Errorf("variable-length array '%s' in register '%s' references undefined field '%s'",
+			field.Name, r.Name, fieldName)
+	}
+	if arrayType.CapacityStr != nil {
+		if c, err := strconv.ParseInt(*arrayType.CapacityStr, 0, 64); err != nil || c < 1 || c > 0xFFFF {
+			return fmt.Errorf("capacity of variable-length array '%s' in register '%s' must be 1..65535",
+				field.Name, r.Name)
+		}
+	}
 	return nil
 }
 
-// validateBitFields validates that bit fields use only unsigned integer types
-// and that bit ranges don't exceed the size of the base type
-func (r *Register) validateBitFields() error {
-	for _, field := range r.Body.Fields() {
-		if field.Type.Bitfield != nil {
-			bitField := field.Type.Bitfield
+// validateFieldOptions validates that the field uses the known options with the proper
+// arguments, and that the field of a packed register may be packed
+func (r *Register) validateFieldOptions(field *Field, packed bool) error {
+	for _, o := range field.Options {
+		switch o.Name {
+		case "bits":
+			if !packed {
+				return fmt.Errorf("option 'bits' of field '%s' in register '%s' requires the packed register", field.Name, r.Name)
+			}
+			if len(o.Args) != 1 {
+				return fmt.Errorf("option 'bits' of field '%s' in register '%s' takes one argument", field.Name, r.Name)
+			}
+			if _, err := strconv.ParseInt(o.Args[0], 0, 64); err != nil {
+				return fmt.Errorf("option 'bits' of field '%s' in register '%s': invalid number of bits '%s'", field.Name, r.Name, o.Args[0])
+			}
+		case "min", "max":
+			if len(o.Args) != 1 {
+				return fmt.Errorf("option '%s' of field '%s' in register '%s' takes one argument", o.Name, field.Name, r.Name)
+			}
+		case "enum":
+			if len(o.Args) == 0 {
+				return fmt.Errorf("option 'enum' of field '%s' in register '%s' takes at least one value", field.Name, r.Name)
+			}
+		case "varint":
+			if len(o.Args) != 0 {
+				return fmt.Errorf("option 'varint' of field '%s' in register '%s' takes no arguments", field.Name, r.Name)
+			}
+			if packed {
+				return fmt.Errorf("option 'varint' of field '%s' is not allowed in packed register '%s'", field.Name, r.Name)
+			}
+			if field.Type.Simple == nil || getTypeSizeInBits(field.Type.Simple.Name) < 16 {
+				return fmt.Errorf("option 'varint' of field '%s' in register '%s' requires a 16, 32 or 64 bits integer", field.Name, r.Name)
+			}
+		default:
+			return fmt.Errorf("unknown option '%s' of field '%s' in register '%s'", o.Name, field.Name, r.Name)
+		}
+	}
+	if err := r.validateConstraint(field); err != nil {
+		return err
+	}
+	if !packed {
+		return nil
+	}
+
+	var typeBits, minBits int
+	switch {
+	case field.Type.Bitfield != nil:
+		typeBits = getTypeSizeInBits(field.Type.Bitfield.Base)
+		for _, bm := range field.Type.Bitfield.Bits {
+			minBits = max(minBits, bm.EndBit()+1)
+		}
+	case field.Type.Simple != nil && IsBuiltinType(field.Type.Simple.Name) && !strings.HasPrefix(field.Type.Simple.Name, "float"):
+		typeBits = getTypeSizeInBits(field.Type.Simple.Name)
+		minBits = 1
+	default:
+		return fmt.Errorf("field '%s' in packed register '%s' must be an integer or a bit field", field.Name, r.Name)
+	}
+	bits := field.Bits()
+	if bits < minBits || bits > typeBits {
+		return fmt.Errorf("field '%s' in packed register '%s': %d bits do not fit the field type, expected %d-%d",
+			field.Name, r.Name, bits, minBits, typeBits)
+	}
+	if bits > maxPackedBits {
+		return fmt.Errorf("field '%s' in packed register '%s' takes %d bits, at most %d bits are allowed, use the bits option",
+			field.Name, r.Name, bits, maxPackedBits)
+	}
+	return nil
+}
+
+// validateConstraint checks the min, max and enum options of the integer field: the values fit
+// the field type, min is not above max and the enum values are between them. The values may be
+// the register constants. The constraint is kept in the field, see Field.Constraint.
+func (r *Register) validateConstraint(field *Field) error {
+	lo, hi, en := field.FindOption("min"), field.FindOption("max"), field.FindOption("enum")
+	if lo == nil && hi == nil && en == nil {
+		return nil
+	}
+	typ := ""
+	if field.Type.Simple != nil {
+		typ = field.Type.Simple.Name
+	}
+	bits := getTypeSizeInBits(typ)
+	if bits == 0 {
+		return fmt.Errorf("options 'min', 'max' and 'enum' of field '%s' in register '%s' require an integer field", field.Name, r.Name)
+	}
 
-			// Check that base type is unsigned
-			if !isUnsignedType(bitField.Base) {
-				return fmt.Errorf("bit field '%s' in register '%s' must use unsigned integer type, got '%s'",
-					field.Name, r.Name, bitField.Base)
+	// the values are compared as big integers, so the uint64 and the int64 ranges fit
+	typeMin, typeMax := new(big.Int), new(big.Int).Lsh(big.NewInt(1), uint(bits))
+	if isUnsignedType(typ) {
+		typeMax.Sub(typeMax, big.NewInt(1))
+	} else {
+		typeMax.Rsh(typeMax, 1)
+		typeMin.Neg(typeMax)
+		typeMax.Sub(typeMax, big.NewInt(1))
+	}
+	value := func(o *Option, arg string) (*big.Int, error) {
+		for _, c := range r.Body.Constants() {
+			if c.Name == arg {
+				arg = c.ValueStr
 			}
+		}
+		v, ok := new(big.Int).SetString(arg, 0)
+		if !ok {
+			return nil, fmt.Errorf("option '%s' of field '%s' in register '%s': invalid value '%s'", o.Name, field.Name, r.Name, arg)
+		}
+		if v.Cmp(typeMin) < 0 || v.Cmp(typeMax) > 0 {
+			return nil, fmt.Errorf("option '%s' of field '%s' in register '%s': value %s does not fit %s", o.Name, field.Name, r.Name, v, typ)
+		}
+		return v, nil
+	}
 
-			// Get the size of the base type in bits
-			baseTypeBits := getTypeSizeInBits(bitField.Base)
-
-			// Validate each bit member
-			for _, bitMember := range bitField.Bits {
-				endBit := bitMember.EndBit()
-
-				// Check that bit range doesn't exceed base type size
-				if endBit >= baseTypeBits {
-					return fmt.Errorf("bit field '%s' in register '%s': bit range %s-%d exceeds size of base type '%s' (%d bits)",
-						field.Name, r.Name, bitMember.Start, &endBit, bitField.Base, baseTypeBits)
-				}
-
-				// Check that start bit is not negative
-				if bitMember.StartBit() < 0 {
-					return fmt.Errorf("bit field '%s' in register '%s': bit position cannot be negative, got %s",
-						field.Name, r.Name, bitMember.Start)
-				}
-
-				// Check that start <= end
-				if bitMember.StartBit() > endBit {
-					return fmt.Errorf("bit field '%s' in register '%s': start bit %s cannot be greater than end bit %d",
-						field.Name, r.Name, bitMember.Start, endBit)
-				}
+	c := &Constraint{}
+	minV, maxV := typeMin, typeMax
+	if lo != nil {
+		v, err := value(lo, lo.Args[0])
+		if err != nil {
+			return err
+		}
+		if minV = v; v.Cmp(typeMin) != 0 {
+			c.Min = v.String()
+		}
+	}
+	if hi != nil {
+		v, err := value(hi, hi.Args[0])
+		if err != nil {
+			return err
+		}
+		if maxV = v; v.Cmp(typeMax) != 0 {
+			c.Max = v.String()
+		}
+	}
+	if minV.Cmp(maxV) > 0 {
+		return fmt.Errorf("field '%s' in register '%s': min %s is above max %s", field.Name, r.Name, minV, maxV)
+	}
+	if en != nil {
+		for _, arg := range en.Args {
+			v, err := value(en, arg)
+			if err != nil {
+				return err
+			}
+			if v.Cmp(minV) < 0 || v.Cmp(maxV) > 0 {
+				return fmt.Errorf("option 'enum' of field '%s' in register '%s': value %s is out of %s..%s", field.Name, r.Name, v, minV, maxV)
 			}
+			c.Enum = append(c.Enum, v.String())
 		}
 	}
+	if c.Min != "" || c.Max != "" || len(c.Enum) > 0 {
+		field.constraint = c
+	}
+	return nil
+}
 
+// validateCycles checks that the register references have no circular dependencies. It is one
+// DFS over all the registers: a register explored completely is not explored again.
+func (d *Device) validateCycles() error {
+	const (
+		unvisited = iota
+		inStack
+		done
+	)
+	state := make(map[*Register]int, len(d.Registers))
+	var visit func(reg *Register) bool
+	visit = func(reg *Register) bool {
+		state[reg] = inStack
+		for _, field := range reg.Body.Fields() {
+			if field.Type.Simple == nil || !field.Type.Simple.IsRegisterRef() {
+				continue
+			}
+			ref := d.FindRegisterByName(field.Type.Simple.Name)
+			// If we find a node in recursion stack, we have a cycle
+			if state[ref] == inStack || state[ref] == unvisited && visit(ref) {
+				return true
+			}
+		}
+		state[reg] = done
+		return false
+	}
+	for _, reg := range d.Registers {
+		if state[reg] == unvisited && visit(reg) {
+			return fmt.Errorf("circular dependency detected involving register '%s'", reg.Name)
+		}
+	}
 	return nil
 }
 
@@ -372,16 +713,16 @@ func isUnsignedType(typeName string) bool {
 	}
 }
 
-// getTypeSizeInBits returns the size of a type in bits
+// getTypeSizeInBits returns the size of an integer type in bits
 func getTypeSizeInBits(typeName string) int {
 	switch typeName {
-	case "uint8":
+	case "int8", "uint8":
 		return 8
-	case "uint16":
+	case "int16", "uint16":
 		return 16
-	case "uint32":
+	case "int32", "uint32":
 		return 32
-	case "uint64":
+	case "int64", "uint64":
 		return 64
 	default:
 		return 0
@@ -390,128 +731,130 @@ func getTypeSizeInBits(typeName string) int {
 
 // FindFieldByName finds a field by name in the register, checking both regular fields and bitfield members
 func (r *Register) FindFieldByName(fieldName string, currentFieldIndex int) (*Field, *BitMember) {
-	// Check regular fields declared before current field
-	fields := r.Body.Fields()
-	for i := 0; i < currentFieldIndex; i++ {
-		field := fields[i]
+	if r.fieldIndex == nil {
+		r.indexFields()
+	}
+	// only the fields declared before current field
+	ref, ok := r.fieldIndex[fieldName]
+	if !ok || ref.index >= currentFieldIndex {
+		return nil, nil
+	}
+	return ref.field, ref.bitMember
+}
 
-		// Check if it's a regular field with matching name
-		if field.Name == fieldName && field.Type.Simple != nil {
-			return field, nil
-		}
+// fieldRef is the field or the bit field member which may be referenced by name, e.g. as the
+// size of the variable-length array
+type fieldRef struct {
+	index     int
+	field     *Field
+	bitMember *BitMember
+}
 
-		// Check if it's a bitfield with matching member names
+// indexFields builds the index of the regular fields and the bitfield members
+// (fieldName_bitMemberName) of the register, the first declaration of the name wins
+func (r *Register) indexFields() {
+	r.fieldIndex = make(map[string]fieldRef)
+	add := func(name string, ref fieldRef) {
+		if _, ok := r.fieldIndex[name]; !ok {
+			r.fieldIndex[name] = ref
+		}
+	}
+	for i, field := range r.Body.Fields() {
+		if field.Type.Simple != nil {
+			add(field.Name, fieldRef{index: i, field: field})
+		}
 		if field.Type.Bitfield != nil {
-			for _, bitMember := range field.Type.Bitfield.Bits {
-				// Check if it's a bitfield reference (fieldName_bitMemberName)
-				bitFieldRefName := field.Name + "_" + bitMember.Name
-				if fieldName == bitFieldRefName {
-					return field, &bitMember
-				}
+			for k := range field.Type.Bitfield.Bits {
+				bm := &field.Type.Bitfield.Bits[k]
+				add(field.Name+"_"+bm.Name, fieldRef{index: i, field: field, bitMember: bm})
 			}
 		}
 	}
-
-	return nil, nil
 }
 
-// validateArrays validates that variable-length arrays use unsigned integer types for size
-// and that referenced fields are declared before the array
-func (r *Register) validateArrays() error {
-	fields := r.Body.Fields()
-	for i, field := range fields {
-		if field.Type.Array == nil {
-			continue
-		}
-		arrayType := field.Type.Array
-
-		if arrayType.Size.Variable == nil {
-			// this is a constant-length array
-			continue
-		}
+// FindOption returns the register option with the name, or nil if the register doesn't have it
+func (r *Register) FindOption(name string) *Option {
+	return findOption(r.Options, name)
+}
 
-		// Check if it's a variable-length array with field reference
-		fieldName := cast.String(arrayType.Size.Variable, "")
+// IsPacked returns true if the register fields are bit-packed on the wire
+func (r *Register) IsPacked() bool {
+	return r.FindOption("packed") != nil
+}
 
-		// This is a field reference - check if the referenced field exists and is declared before this array
-		exists, _ := r.FindFieldByName(fieldName, i)
-		if exists == nil {
-			return fmt.Errorf("variable-length array '%s' in register '%s' references undefined field '%s'",
-				field.Name, r.Name, fieldName)
-		}
-	}
-	return nil
+// IsStream returns true if the register may be serialized and deserialized in chunks
+func (r *Register) IsStream() bool {
+	return r.FindOption("stream") != nil
 }
 
-// validateRegisterReferences validates that all register references exist and there are no circular dependencies
-func (d *Device) validateRegisterReferences() error {
-	// Build a map of all registers
-	registerMap := make(map[string]*Register)
-	for _, reg := range d.Registers {
-		registerMap[reg.Name] = reg
-	}
+// IsTable returns true if the register is coded by the shared interpreter of its fields table
+// instead of the generated code of every field
+func (r *Register) IsTable() bool {
+	return r.FindOption("table") != nil
+}
 
-	// Validate that all referenced registers exist
-	for _, reg := range d.Registers {
-		for _, field := range reg.Body.Fields() {
-			if field.Type.Simple != nil && field.Type.Simple.IsRegisterRef() {
-				refName := field.Type.Simple.Name
-				if _, exists := registerMap[refName]; !exists {
-					return fmt.Errorf("field '%s' in register '%s' references undefined register '%s'",
-						field.Name, reg.Name, refName)
-				}
-			}
-		}
+// CacheTTL returns how long the clients may serve the register reads from the cache, given by
+// the cache option, 0 if the register is not cached
+func (r *Register) CacheTTL() time.Duration {
+	if o := r.FindOption("cache"); o != nil {
+		d, _ := time.ParseDuration(o.Args[0])
+		return d
 	}
+	return 0
+}
 
-	// Check for circular dependencies using DFS
-	for _, reg := range d.Registers {
-		visited := make(map[string]bool)
-		recursionStack := make(map[string]bool)
-		if hasCycle(reg.Name, registerMap, visited, recursionStack) {
-			return fmt.Errorf("circular dependency detected involving register '%s'", reg.Name)
-		}
-	}
+// Constraint returns the valid values of the field, or nil if the field has no min, max or enum
+// options
+func (f *Field) Constraint() *Constraint {
+	return f.constraint
+}
 
-	return nil
+// FindOption returns the field option with the name, or nil if the field doesn't have it
+func (f *Field) FindOption(name string) *Option {
+	return findOption(f.Options, name)
 }
 
-// hasCycle performs DFS to detect cycles in register dependencies
-func hasCycle(regName string, registerMap map[string]*Register, visited, recursionStack map[string]bool) bool {
-	visited[regName] = true
-	recursionStack[regName] = true
+// IsVarint returns true if the integer field is sent as the variable-length LEB128 integer
+func (f *Field) IsVarint() bool {
+	return f.FindOption("varint") != nil
+}
 
-	reg, exists := registerMap[regName]
-	if !exists {
-		return false
+// Bits returns the number of bits the field takes in a packed register: the bits(N) option
+// value, or the whole size of the field type
+func (f *Field) Bits() int {
+	if o := f.FindOption("bits"); o != nil {
+		val, err := strconv.ParseInt(o.Args[0], 0, 64)
+		if err != nil {
+			panic(fmt.Sprintf("invalid bits %s", o.Args[0]))
+		}
+		return int(val)
 	}
+	if f.Type.Bitfield != nil {
+		return getTypeSizeInBits(f.Type.Bitfield.Base)
+	}
+	if f.Type.Simple != nil {
+		return getTypeSizeInBits(f.Type.Simple.Name)
+	}
+	return 0
+}
 
-	// Check all fields for register references
-	for _, field := range reg.Body.Fields() {
-		if field.Type.Simple != nil && field.Type.Simple.IsRegisterRef() {
-			refName := field.Type.Simple.Name
-
-			// If we find a node in recursion stack, we have a cycle
-			if recursionStack[refName] {
-				return true
-			}
-
-			// If not visited, recursively check
-			if !visited[refName] {
-				if hasCycle(refName, registerMap, visited, recursionStack) {
-					return true
-				}
-			}
+func findOption(opts []*Option, name string) *Option {
+	for _, o := range opts {
+		if o.Name == name {
+			return o
 		}
 	}
-
-	// Remove from recursion stack before returning
-	recursionStack[regName] = false
-	return false
+	return nil
 }
 
+// maxPackedBits is the widest field of a packed register
+const maxPackedBits = 32
+
 // FindRegisterByName finds a register by name in the device
 func (d *Device) FindRegisterByName(name string) *Register {
+	if d.registers != nil {
+		return d.registers[name]
+	}
 	for _, reg := range d.Registers {
 		if reg.Name == name {
 			return reg
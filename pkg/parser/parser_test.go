@@ -1,8 +1,12 @@
 package parser
 
 import (
+	"fmt"
+	"strings"
 	"testing"
+	"time"
 
+	"github.com/alecthomas/participle/v2/lexer"
 	"github.com/stretchr/testify/assert"
 	"github.com/stretchr/testify/require"
 )
@@ -361,3 +365,295 @@ register Main(2) {
 	require.NotNil(t, rwConfigField.Type.Simple)
 	assert.True(t, rwConfigField.Type.Simple.IsRegisterRef())
 }
+
+func TestPackedRegister(t *testing.T) {
+	input := `
+device test
+
+register Status(1):r packed {
+    mode uint8 bits(2); // the mode
+    temp int16 bits(10);
+    flags uint8{on: 0, level: 1-2} bits(3);
+    counter uint16;
+};
+`
+	device, err := Parse(input)
+	require.NoError(t, err)
+
+	reg := device.Registers[0]
+	assert.Equal(t, "r", reg.Specifier)
+	assert.True(t, reg.IsPacked())
+	fields := reg.Body.Fields()
+	require.Len(t, fields, 4)
+	assert.Equal(t, []string{"2"}, fields[0].FindOption("bits").Args)
+	assert.Equal(t, "// the mode", *fields[0].TrailingComment)
+	assert.Equal(t, 2, fields[0].Bits())
+	assert.Equal(t, 10, fields[1].Bits())
+	assert.Equal(t, 3, fields[2].Bits())
+	assert.Equal(t, 16, fields[3].Bits())
+}
+
+func TestPackedRegisterErrors(t *testing.T) {
+	tests := []struct {
+		body string
+		err  string
+	}{
+		{"register R(1) compressed {\n f uint8;\n};", "unknown option 'compressed' of register 'R'"},
+		{"register R(1) {\n f uint8 bits(2);\n};", "requires the packed register"},
+		{"register R(1) packed {\n f uint8 bits;\n};", "takes one argument"},
+		{"register R(1) packed {\n f uint8 bits(9);\n};", "9 bits do not fit the field type"},
+		{"register R(1) packed {\n f uint8{a: 0, b: 3} bits(3);\n};", "3 bits do not fit the field type, expected 4-8"},
+		{"register R(1) packed {\n f uint64;\n};", "at most 32 bits are allowed"},
+		{"register R(1) packed {\n f float32;\n};", "must be an integer or a bit field"},
+		{"register R(1) packed {\n f [2]uint8;\n};", "must be an integer or a bit field"},
+	}
+	for _, tc := range tests {
+		_, err := Parse("device test\n\n" + tc.body)
+		require.Error(t, err, tc.body)
+		assert.Contains(t, err.Error(), tc.err)
+	}
+}
+
+func TestVarintErrors(t *testing.T) {
+	tests := []struct {
+		body string
+		err  string
+	}{
+		{"register R(1) {\n f uint8 varint;\n};", "requires a 16, 32 or 64 bits integer"},
+		{"register R(1) {\n f [2]uint16 varint;\n};", "requires a 16, 32 or 64 bits integer"},
+		{"register R(1) {\n f uint16 varint(2);\n};", "takes no arguments"},
+		{"register R(1) packed {\n f uint16 varint;\n};", "is not allowed in packed register"},
+	}
+	for _, tc := range tests {
+		_, err := Parse("device test\n\n" + tc.body)
+		require.Error(t, err, tc.body)
+		assert.Contains(t, err.Error(), tc.err)
+	}
+}
+
+func TestDeltaErrors(t *testing.T) {
+	tests := []struct {
+		body string
+		err  string
+	}{
+		{"register R(1):r delta {\n f uint8;\n};", "requires the write fields"},
+		{"register R(1) delta {\n f:r uint8;\n};", "requires the write fields"},
+		{"register R(1) delta packed {\n f uint8;\n};", "cannot be combined"},
+		{"register R(1) delta(1) {\n f uint8;\n};", "takes no arguments"},
+	}
+	for _, tc := range tests {
+		_, err := Parse("device test\n\n" + tc.body)
+		require.Error(t, err, tc.body)
+		assert.Contains(t, err.Error(), tc.err)
+	}
+}
+
+func TestStreamErrors(t *testing.T) {
+	tests := []struct {
+		body string
+		err  string
+	}{
+		{"register R(1) stream packed {\n f uint8;\n};", "cannot be combined"},
+		{"register R(1) stream(64) {\n f uint8;\n};", "takes no arguments"},
+		{"register A(1) {\n f uint8;\n};\nregister R(2) stream {\n a A;\n};", "cannot be a register reference"},
+	}
+	for _, tc := range tests {
+		_, err := Parse("device test\n\n" + tc.body)
+		require.Error(t, err, tc.body)
+		assert.Contains(t, err.Error(), tc.err)
+	}
+
+	d, err := Parse("device test\n\nregister R(1) stream delta {\n n uint16;\n v [n]int16;\n c uint32 varint;\n};")
+	require.NoError(t, err)
+	assert.True(t, d.Registers[0].IsStream())
+}
+
+func TestTableErrors(t *testing.T) {
+	tests := []struct {
+		body string
+		err  string
+	}{
+		{"register R(1) table packed {\n f uint8;\n};", "cannot be combined"},
+		{"register R(1) table(1) {\n f uint8;\n};", "takes no arguments"},
+		{"register A(1) {\n f uint8;\n};\nregister R(2) table {\n a A;\n};", "cannot be a register reference"},
+	}
+	for _, tc := range tests {
+		_, err := Parse("device test\n\n" + tc.body)
+		require.Error(t, err, tc.body)
+		assert.Contains(t, err.Error(), tc.err)
+	}
+}
+
+func TestCache(t *testing.T) {
+	d, err := Parse("device test\n\nregister Info(5): r cache(60s) {\n f uint8;\n};\n" +
+		"register Fast(6) cache(250ms) {\n f uint8;\n};\nregister Live(7) {\n f uint8;\n};")
+	require.NoError(t, err)
+	assert.Equal(t, time.Minute, d.Registers[0].CacheTTL())
+	assert.Equal(t, 250*time.Millisecond, d.Registers[1].CacheTTL())
+	assert.Equal(t, time.Duration(0), d.Registers[2].CacheTTL())
+
+	tests := []struct {
+		body string
+		err  string
+	}{
+		{"register R(1) cache {\n f uint8;\n};", "takes one argument"},
+		{"register R(1) cache(1s, 2s) {\n f uint8;\n};", "takes one argument"},
+		{"register R(1) cache(60) {\n f uint8;\n};", "invalid duration '60'"},
+		{"register R(1) cache(0s) {\n f uint8;\n};", "invalid duration '0s'"},
+		{"register R(1): w cache(1s) {\n f uint8;\n};", "requires the read fields"},
+	}
+	for _, tc := range tests {
+		_, err := Parse("device test\n\n" + tc.body)
+		require.Error(t, err, tc.body)
+		assert.Contains(t, err.Error(), tc.err)
+	}
+}
+
+func TestArrayCapacity(t *testing.T) {
+	d, err := Parse("device test\n\nregister R(1) {\n n uint8;\n v [n<=32]uint8;\n w [n]int16;\n};")
+	require.NoError(t, err)
+	fields := d.Registers[0].Body.Fields()
+	assert.Equal(t, 32, fields[1].Type.Array.Capacity())
+	assert.Equal(t, 0, fields[2].Type.Array.Capacity())
+
+	tests := []struct {
+		body string
+		err  string
+	}{
+		{"register R(1) {\n n uint8;\n v [n<=0]uint8;\n};", "must be 1..65535"},
+		{"register R(1) {\n n uint8;\n v [n<=65536]uint8;\n};", "must be 1..65535"},
+	}
+	for _, tc := range tests {
+		_, err := Parse("device test\n\n" + tc.body)
+		require.Error(t, err, tc.body)
+		assert.Contains(t, err.Error(), tc.err)
+	}
+}
+
+func TestConstraints(t *testing.T) {
+	d, err := Parse("device test\n\nregister R(1) {\n const kRun = uint8(2);\n mode uint8 min(1) max(5);\n" +
+		" state uint8 enum(0, kRun, 0x07);\n temp int16 min(-40) max(125) varint;\n any int8 min(-128);\n" +
+		" big uint64 max(18446744073709551615) min(1);\n};")
+	require.NoError(t, err)
+	fields := d.Registers[0].Body.Fields()
+	assert.Equal(t, &Constraint{Min: "1", Max: "5"}, fields[0].Constraint())
+	assert.Equal(t, &Constraint{Enum: []string{"0", "2", "7"}}, fields[1].Constraint())
+	assert.Equal(t, &Constraint{Min: "-40", Max: "125"}, fields[2].Constraint())
+	assert.Nil(t, fields[3].Constraint())
+	assert.Equal(t, &Constraint{Min: "1"}, fields[4].Constraint())
+
+	tests := []struct {
+		body string
+		err  string
+	}{
+		{"register R(1) {\n f uint8 min(1, 2);\n};", "takes one argument"},
+		{"register R(1) {\n f uint8 enum;\n};", "takes at least one value"},
+		{"register R(1) {\n f uint8 min(-1);\n};", "value -1 does not fit uint8"},
+		{"register R(1) {\n f int8 max(128);\n};", "value 128 does not fit int8"},
+		{"register R(1) {\n f uint8 min(5) max(1);\n};", "min 5 is above max 1"},
+		{"register R(1) {\n f uint8 max(3) enum(1, 4);\n};", "value 4 is out of 0..3"},
+		{"register R(1) {\n f uint8 enum(kIdle);\n};", "invalid value 'kIdle'"},
+		{"register R(1) {\n f float32 min(0);\n};", "require an integer field"},
+		{"register R(1) {\n f [2]uint8 max(1);\n};", "require an integer field"},
+	}
+	for _, tc := range tests {
+		_, err := Parse("device test\n\n" + tc.body)
+		require.Error(t, err, tc.body)
+		assert.Contains(t, err.Error(), tc.err)
+	}
+}
+
+func TestLexerMatchesSimpleRules(t *testing.T) {
+	simple := lexer.MustSimple([]lexer.SimpleRule{
+		{Name: "End", Pattern: `;([ \t]+//[^\r\n]*)?`},
+		{Name: "Comment", Pattern: `//[^\r\n]*`},
+		{Name: "EmptyLine", Pattern: `\n\s*\n`},
+		{Name: "Keyword", Pattern: `\b(const|device|register)\b`},
+		{Name: "Ident", Pattern: `[a-zA-Z_][a-zA-Z0-9_-]*`},
+		{Name: "Duration", Pattern: `\d+(ms|s|m|h)\b`},
+		{Name: "Int", Pattern: `0[xX][0-9a-fA-F]+|0[bB][01]+|\d+`},
+		{Name: "Punct", Pattern: `<=|[{}();:,\[\]=\-]`},
+		{Name: "Whitespace", Pattern: `\s+`},
+	})
+	tokens := func(def lexer.Definition, input string) []string {
+		names := map[lexer.TokenType]string{}
+		for n, t := range def.Symbols() {
+			names[t] = n
+		}
+		l, err := def.Lex("", strings.NewReader(input))
+		require.NoError(t, err)
+		var res []string
+		for {
+			tok, err := l.Next()
+			if err != nil {
+				return append(res, "error")
+			}
+			if tok.Type == lexer.EOF {
+				return res
+			}
+			res = append(res, fmt.Sprintf("%s %q %d:%d", names[tok.Type], tok.Value, tok.Pos.Line, tok.Pos.Column))
+		}
+	}
+	for _, input := range []string{
+		largeSpec(3),
+		"device d-1 // x\n\n \t\n\r\nregister R(0x1F): r packed {\n  a uint8 bits(0b101);  // c\n};\n",
+		"a;b; c;\t//d\r\nconst constx const-y registers device_ 5const 0x 0b2 0xZ 007",
+		"[n<=32]int8 <\n",
+		"cache(60s) 5ms 1h2 3m-x 7mx 0s 0x1s 10msec 2h_",
+		"x $",
+	} {
+		require.Equal(t, tokens(simple, input), tokens(paLexer, input), input)
+	}
+}
+
+// largeSpec returns the spec of n registers with the fields of all kinds
+func largeSpec(n int) string {
+	var sb strings.Builder
+	sb.WriteString("// generated device\ndevice big\n\n")
+	for i := 0; i < n; i++ {
+		fmt.Fprintf(&sb, `// Register %d
+register R%d(%d) {
+    const limit = uint16(%d);
+    mode uint8;
+    flags uint16{on: 0, level: 1-3};
+    size uint8;
+    data [size]int16; // samples
+    coeffs [4]float32;
+    bounded [flags_level<=7]uint8;
+`, i, i, i, i)
+		if i > 0 {
+			fmt.Fprintf(&sb, "    prev R%d;\n", i-1)
+		}
+		sb.WriteString("};\n\n")
+	}
+	return sb.String()
+}
+
+func BenchmarkParse(b *testing.B) {
+	input := largeSpec(1000)
+	b.SetBytes(int64(len(input)))
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		if _, err := Parse(input); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+func BenchmarkLexer(b *testing.B) {
+	input := largeSpec(1000)
+	b.SetBytes(int64(len(input)))
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		l, _ := paLexer.Lex("", strings.NewReader(input))
+		for {
+			tok, err := l.Next()
+			if err != nil {
+				b.Fatal(err)
+			}
+			if tok.Type == lexer.EOF {
+				break
+			}
+		}
+	}
+}